@@ -67,6 +67,7 @@ const bool                    datadefs::RF_DEFAULT_IS_RANDOM_SPLIT = true;
 const datadefs::num_t         datadefs::RF_DEFAULT_SHRINKAGE = 0.0;
 const vector<datadefs::num_t> datadefs::RF_DEFAULT_QUANTILES = {};
 const size_t                  datadefs::RF_DEFAULT_N_SAMPLES_FOR_QUANTILES = 0;
+const size_t                  datadefs::RF_DEFAULT_OOB_WINDOW = 20;
 
 // Random Forest default configuration
 const size_t                  datadefs::QRF_DEFAULT_N_TREES = 100;
@@ -99,6 +100,8 @@ const size_t                  datadefs::GBT_DEFAULT_N_SAMPLES_FOR_QUANTILES = 0;
 // Statistical test default configuration
 const size_t          datadefs::FILTER_DEFAULT_N_PERMS = 20;
 const datadefs::num_t datadefs::FILTER_DEFAULT_P_VALUE_THRESHOLD = 0.05;
+const size_t          datadefs::FILTER_DEFAULT_PERM_BATCH = 0;
+const size_t          datadefs::FILTER_DEFAULT_N_CONTRAST_SETS = 1;
 const bool            datadefs::FILTER_DEFAULT_IS_ADJUSTED_P_VALUE = false;
 const datadefs::num_t datadefs::FILTER_DEFAULT_IMPORTANCE_THRESHOLD = 10;
 const bool            datadefs::FILTER_NORMALIZE_IMPORTANCE_VALUES = false;
@@ -80,6 +80,7 @@ namespace datadefs {
   extern const num_t         RF_DEFAULT_SHRINKAGE;
   extern const vector<num_t> RF_DEFAULT_QUANTILES;
   extern const size_t        RF_DEFAULT_N_SAMPLES_FOR_QUANTILES;
+  extern const size_t        RF_DEFAULT_OOB_WINDOW;
 
   // Quantile Regression Random Forest default configuration
   extern const size_t        QRF_DEFAULT_N_TREES;
@@ -113,6 +114,8 @@ namespace datadefs {
   // Statistical test default configuration
   extern const size_t     FILTER_DEFAULT_N_PERMS;
   extern const num_t      FILTER_DEFAULT_P_VALUE_THRESHOLD;
+  extern const size_t     FILTER_DEFAULT_PERM_BATCH;
+  extern const size_t     FILTER_DEFAULT_N_CONTRAST_SETS;
   extern const bool       FILTER_DEFAULT_IS_ADJUSTED_P_VALUE;
   extern const num_t      FILTER_DEFAULT_IMPORTANCE_THRESHOLD;
   extern const bool       FILTER_NORMALIZE_IMPORTANCE_VALUES;
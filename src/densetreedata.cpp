@@ -7,14 +7,17 @@
 #include <utility>
 #include <algorithm>
 #include <ctime>
+#include <limits>
 
 #include "math.hpp"
 #include "utils.hpp"
+#include "splitengine.hpp"
 
 using namespace std;
 
 DenseTreeData::DenseTreeData(const vector<Feature>& features, const bool useContrasts, const vector<string>& sampleHeaders):
   useContrasts_(useContrasts),
+  nContrastSets_(0),
   features_(features),
   sampleHeaders_(sampleHeaders) {
   
@@ -62,7 +65,8 @@ DenseTreeData::DenseTreeData(const vector<Feature>& features, const bool useCont
    ARFF default delimiter (comma) is used 
 */
 DenseTreeData::DenseTreeData(string fileName, const char dataDelimiter, const char headerDelimiter, const bool useContrasts):
-  useContrasts_(useContrasts) {
+  useContrasts_(useContrasts),
+  nContrastSets_(0) {
   
   this->readAFM(fileName,dataDelimiter,headerDelimiter);
   
@@ -96,6 +100,33 @@ void DenseTreeData::createContrasts() {
     name2idx_[ features_[i].name() ] = i;
   }
 
+  nContrastSets_ = 1;
+
+}
+
+// Sets beyond the first are named with their number, e.g. N:x_CONTRAST2
+void DenseTreeData::setNContrastSets(const size_t nContrastSets) {
+
+  assert( nContrastSets_ > 0 && nContrastSets > 0 );
+
+  size_t nFeatures = this->nFeatures();
+
+  for ( size_t i = ( 1 + nContrastSets ) * nFeatures; i < features_.size(); ++i ) {
+    name2idx_.erase( features_[i].name() );
+  }
+
+  size_t nOldFeatures = min(features_.size(),( 1 + nContrastSets ) * nFeatures);
+
+  features_.resize( ( 1 + nContrastSets ) * nFeatures );
+
+  for ( size_t i = nOldFeatures; i < features_.size(); ++i ) {
+    features_[i] = features_[ i % nFeatures ];
+    features_[i].setName( features_[i].name() + "_CONTRAST" + utils::num2str(i / nFeatures) );
+    name2idx_[ features_[i].name() ] = i;
+  }
+
+  nContrastSets_ = nContrastSets;
+
 }
 
 bool DenseTreeData::isValidNumericalHeader(const string& str, const char headerDelimiter) {
@@ -279,7 +310,7 @@ void DenseTreeData::readAFM(const string& fileName, const char dataDelimiter, co
 }
 
 size_t DenseTreeData::nFeatures() const {
-  return( useContrasts_ ? features_.size() / 2 : features_.size() );
+  return( features_.size() / ( 1 + nContrastSets_ ) );
 }
 
 size_t DenseTreeData::nSamples() const {
@@ -319,12 +350,15 @@ vector<num_t> DenseTreeData::getFeatureWeights() const {
 
 }
 
+// Contrasts are drawn afresh from the real features, so a permutation does
+// not depend on the permutations before it. Every contrast set is permuted
+// independently
 void DenseTreeData::permuteContrasts(distributions::Random* random) {
 
   size_t nFeatures = this->nFeatures();
   size_t nSamples = this->nSamples();
 
-  for ( size_t i = nFeatures; i < 2*nFeatures; ++i ) {
+  for ( size_t i = nFeatures; i < features_.size(); ++i ) {
     
     if ( this->feature(i)->isTextual() ) { continue; }
 
@@ -335,7 +369,7 @@ void DenseTreeData::permuteContrasts(distributions::Random* random) {
 
     if ( this->feature(i)->isNumerical() ) {
 
-      vector<num_t> filteredData = this->feature(i)->getNumData(sampleIcs);
+      vector<num_t> filteredData = this->feature(i % nFeatures)->getNumData(sampleIcs);
       utils::permute(filteredData,random);
       for ( size_t j = 0; j < sampleIcs.size(); ++j ) {
 	features_[i].setNumSampleValue(sampleIcs[j],filteredData[j]);
@@ -343,7 +377,7 @@ void DenseTreeData::permuteContrasts(distributions::Random* random) {
 
     } else {
 
-      vector<cat_t> filteredData = this->feature(i)->getCatData(sampleIcs);
+      vector<cat_t> filteredData = this->feature(i % nFeatures)->getCatData(sampleIcs);
       utils::permute(filteredData,random);
       for ( size_t j = 0; j < sampleIcs.size(); ++j ) {
 	features_[i].setCatSampleValue(sampleIcs[j],filteredData[j]);
@@ -410,256 +444,498 @@ void DenseTreeData::bootstrapFromRealSamples(distributions::Random* random,
   oobIcs.resize(nOob);
   //cout << "nOob=" << nOob << endl;
 }
-  
-  void DenseTreeData::separateMissingSamples(const size_t featureIdx,
-					     vector<size_t>& sampleIcs,
-					     vector<size_t>& missingIcs) {
-  
-  size_t nReal = 0;
-  size_t nMissing = 0;
 
-  missingIcs.resize(sampleIcs.size());
+void DenseTreeData::bootstrapWeightsFromRealSamples(distributions::Random* random,
+						    const bool withReplacement,
+						    const num_t sampleSize,
+						    const size_t featureIdx,
+						    vector<uint8_t>& sampleWeights,
+						    vector<size_t>& ics,
+						    vector<size_t>& oobIcs) {
 
-  vector<size_t>::const_iterator it(sampleIcs.begin());
+  //Check that the sampling parameters are appropriate
+  assert(sampleSize > 0.0);
+  if(!withReplacement && sampleSize > 1.0) {
+    cerr << "Treedata: when sampling without replacement, sample size must be less or equal to 100% (sampleSize <= 1.0)" << endl;
+    exit(1);
+  }
+
+  vector<size_t> allIcs;
+  for ( size_t i = 0; i < this->nSamples(); ++i) {
+    if ( !this->feature(featureIdx)->isMissing(i) ) {
+      allIcs.push_back(i);
+    }
+  }
+
+  size_t nRealSamples = allIcs.size();
+  size_t nSamples = static_cast<size_t>( floor( sampleSize * nRealSamples ) );
 
-  for ( ; it != sampleIcs.end(); ++it ) {
-    if ( !this->feature(featureIdx)->isMissing(*it) ) {
-      sampleIcs[nReal++] = *it;
+  sampleWeights.assign(this->nSamples(),0);
+
+  if(withReplacement) {
+    //Multinomial counts. A count past the range of the weight type would bias the tree, so it is an error
+    for(size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx) {
+      uint8_t& w = sampleWeights[ allIcs[ random->integer() % nRealSamples ] ];
+      if ( w == numeric_limits<uint8_t>::max() ) {
+	cerr << "Treedata: a sample was drawn more than " << static_cast<size_t>(numeric_limits<uint8_t>::max())
+	     << " times into the weighted bootstrap sample, which the sample weights cannot hold. Grow the forest without weighted bootstrap" << endl;
+	exit(1);
+      }
+      ++w;
+    }
+  } else {
+    vector<size_t> foo = utils::range(nRealSamples);
+    utils::permute(foo,random);
+    for(size_t i = 0; i < nSamples; ++i) {
+      sampleWeights[ allIcs[foo[i]] ] = 1;
+    }
+  }
+
+  //The real samples are visited in increasing order, so no sorting or set difference is needed
+  ics.clear();
+  oobIcs.clear();
+  for ( size_t i = 0; i < nRealSamples; ++i ) {
+    if ( sampleWeights[ allIcs[i] ] > 0 ) {
+      ics.push_back(allIcs[i]);
     } else {
-      missingIcs[nMissing++] = *it;
+      oobIcs.push_back(allIcs[i]);
     }
   }
 
-  sampleIcs.resize(nReal);
-  missingIcs.resize(nMissing);
+}
+  
+void DenseTreeData::separateMissingSamples(const size_t featureIdx,
+					   vector<size_t>& sampleIcs,
+					   vector<size_t>& missingIcs) {
+
+  const Feature& feature = features_[featureIdx];
+
+  if ( feature.isNumerical() ) {
+    splitengine::separateMissingSamples(feature.numData,sampleIcs,missingIcs);
+  } else if ( feature.isCategorical() ) {
+    splitengine::separateMissingSamples(feature.catData,sampleIcs,missingIcs);
+  } else {
+    splitengine::separateMissingSamples(feature.txtData,sampleIcs,missingIcs);
+  }
 
 }
 
+// The public split functions resolve the target type once per candidate and
+// dispatch to the kernels specialized for it
 num_t DenseTreeData::numericalFeatureSplit(const size_t targetIdx,
 					   const size_t featureIdx,
 					   const size_t minSamples,
-					   vector<size_t>& sampleIcs_left,
-					   vector<size_t>& sampleIcs_right,
-					   num_t& splitValue) {
+					   const vector<size_t>& sampleIcs,
+					   const vector<uint8_t>& sampleWeights,
+					   num_t& splitValue,
+					   splitengine::TargetStat<num_t>& stat_left,
+					   splitengine::TargetStat<num_t>& stat_right,
+					   splitengine::SplitScratch<num_t>& scratch) {
 
-  num_t DI_best = 0.0;
+  assert( features_[targetIdx].isNumerical() );
 
-  sampleIcs_left.clear();
+  return( this->numericalFeatureSplit(features_[targetIdx].numData,featureIdx,minSamples,sampleIcs,sampleWeights,splitValue,stat_left,stat_right,scratch) );
+
+}
 
-  vector<num_t> fv = this->feature(featureIdx)->getNumData(sampleIcs_right);
+num_t DenseTreeData::numericalFeatureSplit(const size_t targetIdx,
+					   const size_t featureIdx,
+					   const size_t minSamples,
+					   const vector<size_t>& sampleIcs,
+					   const vector<uint8_t>& sampleWeights,
+					   num_t& splitValue,
+					   splitengine::TargetStat<cat_t>& stat_left,
+					   splitengine::TargetStat<cat_t>& stat_right,
+					   splitengine::SplitScratch<cat_t>& scratch) {
 
-  vector<size_t> sortIcs = utils::range(sampleIcs_right.size());
-  utils::sortDataAndMakeRef(true,fv,sortIcs);
-  utils::sortFromRef(sampleIcs_right,sortIcs);
+  assert( features_[targetIdx].isCategorical() );
 
-  size_t n_tot = fv.size();
-  size_t n_left = 0;
+  return( this->numericalFeatureSplit(features_[targetIdx].catData,featureIdx,minSamples,sampleIcs,sampleWeights,splitValue,stat_left,stat_right,scratch) );
 
-  if(n_tot < 2 * minSamples) {
-    DI_best = 0.0;
-    return( DI_best );
-  }
+}
 
-  size_t bestSplitIdx = datadefs::MAX_IDX;
+num_t DenseTreeData::categoricalFeatureSplit(const size_t targetIdx,
+					     const size_t featureIdx,
+					     const vector<cat_t>& catOrder,
+					     const size_t minSamples,
+					     const vector<size_t>& sampleIcs,
+					     const vector<uint8_t>& sampleWeights,
+					     unordered_set<cat_t>& splitValues_left,
+					     splitengine::TargetStat<num_t>& stat_left,
+					     splitengine::TargetStat<num_t>& stat_right,
+					     splitengine::SplitScratch<num_t>& scratch) {
+
+  assert( features_[targetIdx].isNumerical() );
 
-  //If the target is numerical, we use the incremental squared error formula
-  if ( this->feature(targetIdx)->isNumerical() ) {
+  return( this->categoricalFeatureSplit(features_[targetIdx].numData,featureIdx,catOrder,minSamples,sampleIcs,sampleWeights,splitValues_left,stat_left,stat_right,scratch) );
 
-    vector<num_t> tv = this->feature(targetIdx)->getNumData(sampleIcs_right);
-    //utils::sortFromRef(tv,sortIcs);
+}
 
-    DI_best = utils::numericalFeatureSplitsNumericalTarget(tv,fv,minSamples,bestSplitIdx);
+num_t DenseTreeData::categoricalFeatureSplit(const size_t targetIdx,
+					     const size_t featureIdx,
+					     const vector<cat_t>& catOrder,
+					     const size_t minSamples,
+					     const vector<size_t>& sampleIcs,
+					     const vector<uint8_t>& sampleWeights,
+					     unordered_set<cat_t>& splitValues_left,
+					     splitengine::TargetStat<cat_t>& stat_left,
+					     splitengine::TargetStat<cat_t>& stat_right,
+					     splitengine::SplitScratch<cat_t>& scratch) {
 
-  } else { // Otherwise we use the iterative gini index formula to update impurity scores while we traverse "right"
+  assert( features_[targetIdx].isCategorical() );
 
-    vector<cat_t> tv = this->feature(targetIdx)->getCatData(sampleIcs_right);
-    //utils::sortFromRef(tv,sortIcs);
+  return( this->categoricalFeatureSplit(features_[targetIdx].catData,featureIdx,catOrder,minSamples,sampleIcs,sampleWeights,splitValues_left,stat_left,stat_right,scratch) );
 
-    DI_best = utils::numericalFeatureSplitsCategoricalTarget(tv,fv,minSamples,bestSplitIdx);
+}
 
-  }
+num_t DenseTreeData::textualFeatureSplit(const size_t targetIdx,
+					 const size_t featureIdx,
+					 const uint32_t hashIdx,
+					 const size_t minSamples,
+					 const vector<size_t>& sampleIcs,
+					 const vector<uint8_t>& sampleWeights,
+					 splitengine::TargetStat<num_t>& stat_left,
+					 splitengine::TargetStat<num_t>& stat_right) {
 
+  assert( features_[targetIdx].isNumerical() );
 
-  if ( bestSplitIdx == datadefs::MAX_IDX ) {
-    DI_best = 0.0;
-    return( DI_best );
-  }
+  return( this->textualFeatureSplit(features_[targetIdx].numData,featureIdx,hashIdx,minSamples,sampleIcs,sampleWeights,stat_left,stat_right) );
 
-  splitValue = fv[bestSplitIdx];
-  n_left = bestSplitIdx + 1;
-  sampleIcs_left.resize(n_left);
+}
 
-  for(size_t i = 0; i < n_left; ++i) {
-    sampleIcs_left[i] = sampleIcs_right[i];
-  }
-  sampleIcs_right.erase(sampleIcs_right.begin(),sampleIcs_right.begin() + n_left);
-  size_t n_right = sampleIcs_right.size();
+num_t DenseTreeData::textualFeatureSplit(const size_t targetIdx,
+					 const size_t featureIdx,
+					 const uint32_t hashIdx,
+					 const size_t minSamples,
+					 const vector<size_t>& sampleIcs,
+					 const vector<uint8_t>& sampleWeights,
+					 splitengine::TargetStat<cat_t>& stat_left,
+					 splitengine::TargetStat<cat_t>& stat_right) {
 
-  assert(n_left + n_right == n_tot);
+  assert( features_[targetIdx].isCategorical() );
 
-  //cout << "N : " << n_left << " <-> " << n_right << " : fitness " << splitFitness << endl;
+  return( this->textualFeatureSplit(features_[targetIdx].catData,featureIdx,hashIdx,minSamples,sampleIcs,sampleWeights,stat_left,stat_right) );
 
-  return( DI_best );
-  
 }
 
-// !! Inadequate Abstraction: Refactor me.
-num_t DenseTreeData::categoricalFeatureSplit(const size_t targetIdx,
-					     const size_t featureIdx,
-					     const vector<cat_t>& catOrder,
-					     const size_t minSamples,
-					     vector<size_t>& sampleIcs_left,
-					     vector<size_t>& sampleIcs_right,
-					     unordered_set<cat_t>& splitValues_left) {
-  
-  num_t DI_best = 0.0;
+num_t DenseTreeData::randomNumericalFeatureSplit(const size_t targetIdx,
+						 const size_t featureIdx,
+						 const size_t minSamples,
+						 const vector<size_t>& sampleIcs,
+						 const vector<uint8_t>& sampleWeights,
+						 const num_t u,
+						 num_t& splitValue,
+						 splitengine::TargetStat<num_t>& stat_left,
+						 splitengine::TargetStat<num_t>& stat_right) {
 
-  sampleIcs_left.clear();
+  assert( features_[targetIdx].isNumerical() );
 
-  vector<cat_t> fv = this->feature(featureIdx)->getCatData(sampleIcs_right);
+  return( this->randomNumericalFeatureSplit(features_[targetIdx].numData,featureIdx,minSamples,sampleIcs,sampleWeights,u,splitValue,stat_left,stat_right) );
 
-  size_t n_tot = fv.size();
+}
 
-  if(n_tot < 2 * minSamples) {
-    DI_best = 0.0;
-    return( DI_best );
-  }
-  
-  unordered_map<cat_t,vector<size_t> > fmap_right(catOrder.size());
-  unordered_map<cat_t,vector<size_t> > fmap_left(catOrder.size());
+num_t DenseTreeData::randomNumericalFeatureSplit(const size_t targetIdx,
+						 const size_t featureIdx,
+						 const size_t minSamples,
+						 const vector<size_t>& sampleIcs,
+						 const vector<uint8_t>& sampleWeights,
+						 const num_t u,
+						 num_t& splitValue,
+						 splitengine::TargetStat<cat_t>& stat_left,
+						 splitengine::TargetStat<cat_t>& stat_right) {
 
-  if ( this->feature(targetIdx)->isNumerical() ) {
+  assert( features_[targetIdx].isCategorical() );
 
-    vector<num_t> tv = this->feature(targetIdx)->getNumData(sampleIcs_right);
+  return( this->randomNumericalFeatureSplit(features_[targetIdx].catData,featureIdx,minSamples,sampleIcs,sampleWeights,u,splitValue,stat_left,stat_right) );
 
-    DI_best = utils::categoricalFeatureSplitsNumericalTarget(tv,fv,minSamples,catOrder,fmap_left,fmap_right);
+}
 
-  } else {
+num_t DenseTreeData::categoricalFeatureSubsetSplit(const size_t targetIdx,
+						   const size_t featureIdx,
+						   const size_t minSamples,
+						   const vector<size_t>& sampleIcs,
+						   const vector<uint8_t>& sampleWeights,
+						   const unordered_set<cat_t>& splitValues_left,
+						   splitengine::TargetStat<num_t>& stat_left,
+						   splitengine::TargetStat<num_t>& stat_right) {
+
+  assert( features_[targetIdx].isNumerical() );
 
-    vector<cat_t> tv = this->feature(targetIdx)->getCatData(sampleIcs_right);
+  return( this->categoricalFeatureSubsetSplit(features_[targetIdx].numData,featureIdx,minSamples,sampleIcs,sampleWeights,splitValues_left,stat_left,stat_right) );
 
-    DI_best = utils::categoricalFeatureSplitsCategoricalTarget(tv,fv,minSamples,catOrder,fmap_left,fmap_right);
+}
+
+num_t DenseTreeData::categoricalFeatureSubsetSplit(const size_t targetIdx,
+						   const size_t featureIdx,
+						   const size_t minSamples,
+						   const vector<size_t>& sampleIcs,
+						   const vector<uint8_t>& sampleWeights,
+						   const unordered_set<cat_t>& splitValues_left,
+						   splitengine::TargetStat<cat_t>& stat_left,
+						   splitengine::TargetStat<cat_t>& stat_right) {
+
+  assert( features_[targetIdx].isCategorical() );
+
+  return( this->categoricalFeatureSubsetSplit(features_[targetIdx].catData,featureIdx,minSamples,sampleIcs,sampleWeights,splitValues_left,stat_left,stat_right) );
+
+}
 
+void DenseTreeData::numericalFeaturePartition(const size_t featureIdx,
+					      const num_t splitValue,
+					      const vector<size_t>& sampleIcs,
+					      vector<size_t>& sampleIcs_left,
+					      vector<size_t>& sampleIcs_right,
+					      vector<size_t>& sampleIcs_missing) {
+
+  const vector<num_t>& featureData = features_[featureIdx].numData;
+
+  sampleIcs_left.clear();
+  sampleIcs_right.clear();
+  sampleIcs_missing.clear();
+
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    num_t x = featureData[sampleIcs[i]];
+    if ( datadefs::isNAN(x) ) {
+      sampleIcs_missing.push_back(sampleIcs[i]);
+    } else if ( x <= splitValue ) {
+      sampleIcs_left.push_back(sampleIcs[i]);
+    } else {
+      sampleIcs_right.push_back(sampleIcs[i]);
+    }
   }
 
-  if ( fabs(DI_best) < datadefs::EPS ) {
-    return(DI_best);
+}
+
+void DenseTreeData::categoricalFeaturePartition(const size_t featureIdx,
+						const unordered_set<cat_t>& splitValues_left,
+						const vector<size_t>& sampleIcs,
+						vector<size_t>& sampleIcs_left,
+						vector<size_t>& sampleIcs_right,
+						vector<size_t>& sampleIcs_missing) {
+
+  const vector<cat_t>& featureData = features_[featureIdx].catData;
+
+  sampleIcs_left.clear();
+  sampleIcs_right.clear();
+  sampleIcs_missing.clear();
+
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    const cat_t& x = featureData[sampleIcs[i]];
+    if ( datadefs::isNAN(x) ) {
+      sampleIcs_missing.push_back(sampleIcs[i]);
+    } else if ( splitValues_left.find(x) != splitValues_left.end() ) {
+      sampleIcs_left.push_back(sampleIcs[i]);
+    } else {
+      sampleIcs_right.push_back(sampleIcs[i]);
+    }
   }
 
-  // Assign samples and categories on the left. First store the original sample indices
-  vector<size_t> sampleIcs = sampleIcs_right;
+}
 
-  // Then populate the left side (sample indices and split values)
-  sampleIcs_left.resize(n_tot);
-  splitValues_left.clear();
-  splitValues_left.rehash(2*fmap_right.size());
-  size_t iter = 0;
-  for ( unordered_map<cat_t,vector<size_t> >::const_iterator it(fmap_left.begin()); it != fmap_left.end(); ++it ) {
-    for ( size_t i = 0; i < it->second.size(); ++i ) {
-      sampleIcs_left[iter] = sampleIcs[it->second[i]];
-      ++iter;
+void DenseTreeData::textualFeaturePartition(const size_t featureIdx,
+					    const uint32_t hashIdx,
+					    const vector<size_t>& sampleIcs,
+					    vector<size_t>& sampleIcs_left,
+					    vector<size_t>& sampleIcs_right,
+					    vector<size_t>& sampleIcs_missing) {
+
+  const vector<unordered_set<uint32_t> >& featureData = features_[featureIdx].txtData;
+
+  sampleIcs_left.clear();
+  sampleIcs_right.clear();
+  sampleIcs_missing.clear();
+
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    const unordered_set<uint32_t>& hs = featureData[sampleIcs[i]];
+    if ( hs.size() == 0 ) {
+      sampleIcs_missing.push_back(sampleIcs[i]);
+    } else if ( hs.find(hashIdx) != hs.end() ) {
+      sampleIcs_left.push_back(sampleIcs[i]);
+    } else {
+      sampleIcs_right.push_back(sampleIcs[i]);
     }
-    splitValues_left.insert( it->first );
-  }
-  sampleIcs_left.resize(iter);
-  //assert( iter == n_left);
-  assert( splitValues_left.size() == fmap_left.size() );
-
-  // Last populate the right side (sample indices and split values)
-  sampleIcs_right.resize(n_tot);
-  //unordered_set<num_t> splitValues_right;
-  iter = 0;
-  for ( unordered_map<cat_t,vector<size_t> >::const_iterator it(fmap_right.begin()); it != fmap_right.end(); ++it ) {
-    for ( size_t i = 0; i < it->second.size(); ++i ) {
-      sampleIcs_right[iter] = sampleIcs[it->second[i]];
-      ++iter;
+  }
+
+}
+
+template<typename T>
+num_t DenseTreeData::numericalFeatureSplit(const vector<T>& targetData,
+					   const size_t featureIdx,
+					   const size_t minSamples,
+					   const vector<size_t>& sampleIcs,
+					   const vector<uint8_t>& sampleWeights,
+					   num_t& splitValue,
+					   splitengine::TargetStat<T>& stat_left,
+					   splitengine::TargetStat<T>& stat_right,
+					   splitengine::SplitScratch<T>& scratch) {
+
+  const vector<num_t>& featureData = features_[featureIdx].numData;
+
+  // Collect the real samples paired with their feature values
+  vector<pair<num_t,size_t> >& sortPairs = scratch.sortPairs;
+  sortPairs.clear();
+  size_t n_weighted = 0;
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    num_t x = featureData[ sampleIcs[i] ];
+    if ( !datadefs::isNAN(x) ) {
+      sortPairs.push_back( make_pair(x,sampleIcs[i]) );
+      n_weighted += sampleWeights[ sampleIcs[i] ];
     }
-    //splitValues_right.insert( it->first );
   }
-  sampleIcs_right.resize(iter);
-  //assert( iter == n_right );
-  //assert( splitValues_right.size() == fmap_right.size() );
 
-  return( DI_best );
+  size_t n_tot = sortPairs.size();
 
-}
+  if ( n_weighted < 2 * minSamples ) {
+    return( 0.0 );
+  }
 
-num_t DenseTreeData::textualFeatureSplit(const size_t targetIdx,
-				    const size_t featureIdx,
-				    const uint32_t hashIdx,
-				    const size_t minSamples,
-				    vector<size_t>& sampleIcs_left,
-				    vector<size_t>& sampleIcs_right) {
+  sort(sortPairs.begin(),sortPairs.end(),datadefs::increasingOrder<size_t>());
+
+  vector<num_t>& fv = scratch.fv;
+  vector<T>& tv = scratch.tv;
+  vector<uint8_t>& wv = scratch.wv;
+  fv.resize(n_tot);
+  tv.resize(n_tot);
+  wv.resize(n_tot);
+  for ( size_t i = 0; i < n_tot; ++i ) {
+    fv[i] = sortPairs[i].first;
+    tv[i] = targetData[ sortPairs[i].second ];
+    wv[i] = sampleWeights[ sortPairs[i].second ];
+  }
 
+  size_t bestSplitIdx = datadefs::MAX_IDX;
 
-  assert(features_[featureIdx].isTextual());
+  num_t DI_best = splitengine::numericalFeatureSplit(tv,fv,wv,minSamples,bestSplitIdx,scratch.tot,stat_left,stat_right);
 
-  size_t n_left = 0;
-  size_t n_right = 0;
-  size_t n_tot = sampleIcs_right.size();
+  if ( bestSplitIdx == datadefs::MAX_IDX ) {
+    return( 0.0 );
+  }
 
-  sampleIcs_left.resize(n_tot);
+  splitValue = fv[bestSplitIdx];
 
-  num_t DI_best = 0.0;
+  return( DI_best );
 
-  if ( this->feature(targetIdx)->isNumerical() ) {
-  
-    num_t mu_left = 0.0;
-    num_t mu_right = 0.0;
-    num_t mu_tot = 0.0;
-
-    for ( size_t i = 0; i < n_tot; ++i ) {
-      unordered_set<uint32_t> hs = this->feature(featureIdx)->getTxtData(sampleIcs_right[i]);
-      num_t x = this->feature(targetIdx)->getNumData(sampleIcs_right[i]);
-      if ( hs.find(hashIdx) != hs.end() ) {
-	sampleIcs_left[n_left++] = sampleIcs_right[i];
-	mu_left += ( x - mu_left ) / n_left;
-      } else {
-	sampleIcs_right[n_right++] = sampleIcs_right[i];
-	mu_right += ( x - mu_right ) / n_right;
-      }
-      mu_tot += x / n_tot;
+}
+
+template<typename T>
+num_t DenseTreeData::categoricalFeatureSplit(const vector<T>& targetData,
+					     const size_t featureIdx,
+					     const vector<cat_t>& catOrder,
+					     const size_t minSamples,
+					     const vector<size_t>& sampleIcs,
+					     const vector<uint8_t>& sampleWeights,
+					     unordered_set<cat_t>& splitValues_left,
+					     splitengine::TargetStat<T>& stat_left,
+					     splitengine::TargetStat<T>& stat_right,
+					     splitengine::SplitScratch<T>& scratch) {
+
+  const vector<cat_t>& featureData = features_[featureIdx].catData;
+
+  // Collect the real samples and their feature and target values
+  vector<cat_t>& fv = scratch.cv;
+  vector<T>& tv = scratch.tv;
+  vector<uint8_t>& wv = scratch.wv;
+  size_t n_weighted = 0;
+  fv.clear();
+  tv.clear();
+  wv.clear();
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    const cat_t& x = featureData[ sampleIcs[i] ];
+    if ( !datadefs::isNAN(x) ) {
+      fv.push_back(x);
+      tv.push_back(targetData[ sampleIcs[i] ]);
+      wv.push_back(sampleWeights[ sampleIcs[i] ]);
+      n_weighted += sampleWeights[ sampleIcs[i] ];
     }
-    
-    DI_best = math::deltaImpurity_regr(mu_tot,n_tot,mu_left,n_left,mu_right,n_right);
+  }
 
-  } else {
+  if ( n_weighted < 2 * minSamples ) {
+    return( 0.0 );
+  }
 
-    unordered_map<cat_t,size_t> freq_left,freq_right,freq_tot(n_tot);
+  splitengine::CategoryGroups& catGroups = scratch.catGroups;
 
-    size_t sf_left = 0;
-    size_t sf_right = 0;
-    size_t sf_tot = 0;
+  num_t DI_best = splitengine::categoricalFeatureSplit(tv,fv,wv,minSamples,catOrder,catGroups,scratch.tot,stat_left,stat_right);
 
-    for ( size_t i = 0; i < sampleIcs_right.size(); ++i ) {
-      unordered_set<uint32_t> hs = this->feature(featureIdx)->getTxtData(sampleIcs_right[i]);
-      cat_t x = this->feature(targetIdx)->getCatData(sampleIcs_right[i]);
-      if ( hs.find(hashIdx) != hs.end() ) {
-        sampleIcs_left[n_left++] = sampleIcs_right[i];
-	math::incrementSquaredFrequency(x,freq_left,sf_left);
-      } else {
-        sampleIcs_right[n_right++] = sampleIcs_right[i];
-	math::incrementSquaredFrequency(x,freq_right,sf_right);
-      }
-      math::incrementSquaredFrequency(x,freq_tot,sf_tot);
+  if ( fabs(DI_best) < datadefs::EPS || stat_left.n < minSamples ) {
+    return( 0.0 );
+  }
+
+  // Only the categories on the left are stored
+  splitValues_left.clear();
+  for ( size_t groupIdx = 0; groupIdx < catGroups.nGroups; ++groupIdx ) {
+    if ( catGroups.isLeft[groupIdx] ) {
+      splitValues_left.insert( catGroups.categories[groupIdx] );
     }
+  }
 
-    DI_best = math::deltaImpurity_class(sf_tot,n_tot,sf_left,n_left,sf_right,n_right);
+  return( DI_best );
 
-  }
+}
+
+template<typename T>
+num_t DenseTreeData::textualFeatureSplit(const vector<T>& targetData,
+					 const size_t featureIdx,
+					 const uint32_t hashIdx,
+					 const size_t minSamples,
+					 const vector<size_t>& sampleIcs,
+					 const vector<uint8_t>& sampleWeights,
+					 splitengine::TargetStat<T>& stat_left,
+					 splitengine::TargetStat<T>& stat_right) {
+
+  assert(features_[featureIdx].isTextual());
 
-  assert(n_tot == n_left + n_right);
+  num_t DI_best = splitengine::textualFeatureSplit(targetData,features_[featureIdx].txtData,hashIdx,sampleIcs,sampleWeights,stat_left,stat_right);
 
-  if ( n_left < minSamples || n_right < minSamples ) {
+  if ( stat_left.n < minSamples || stat_right.n < minSamples ) {
     return(0.0);
   }
 
-  sampleIcs_left.resize(n_left);
-  sampleIcs_right.resize(n_right);
-  
   return(DI_best);
-  
+
+}
+
+template<typename T>
+num_t DenseTreeData::randomNumericalFeatureSplit(const vector<T>& targetData,
+						 const size_t featureIdx,
+						 const size_t minSamples,
+						 const vector<size_t>& sampleIcs,
+						 const vector<uint8_t>& sampleWeights,
+						 const num_t u,
+						 num_t& splitValue,
+						 splitengine::TargetStat<T>& stat_left,
+						 splitengine::TargetStat<T>& stat_right) {
+
+  assert(features_[featureIdx].isNumerical());
+
+  num_t DI = splitengine::randomNumericalFeatureSplit(targetData,features_[featureIdx].numData,sampleIcs,sampleWeights,u,splitValue,stat_left,stat_right);
+
+  if ( stat_left.n < minSamples || stat_right.n < minSamples ) {
+    return(0.0);
+  }
+
+  return(DI);
+
 }
 
+template<typename T>
+num_t DenseTreeData::categoricalFeatureSubsetSplit(const vector<T>& targetData,
+						   const size_t featureIdx,
+						   const size_t minSamples,
+						   const vector<size_t>& sampleIcs,
+						   const vector<uint8_t>& sampleWeights,
+						   const unordered_set<cat_t>& splitValues_left,
+						   splitengine::TargetStat<T>& stat_left,
+						   splitengine::TargetStat<T>& stat_right) {
+
+  assert(features_[featureIdx].isCategorical());
 
+  num_t DI = splitengine::categoricalFeatureSubsetSplit(targetData,features_[featureIdx].catData,sampleIcs,sampleWeights,splitValues_left,stat_left,stat_right);
 
+  if ( stat_left.n < minSamples || stat_right.n < minSamples ) {
+    return(0.0);
+  }
+
+  return(DI);
+
+}
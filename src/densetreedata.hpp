@@ -16,6 +16,7 @@
 #include "options.hpp"
 #include "feature.hpp"
 #include "reader.hpp"
+#include "splitengine.hpp"
 #include "treedata.hpp"
 
 using namespace std;
@@ -32,6 +33,8 @@ public:
 
   ~DenseTreeData();
 
+  TreeData* clone() const { return( new DenseTreeData(*this) ); }
+
   // Reveals the Feature class interface to the user
   const Feature* feature(const size_t featureIdx) const {
     return( &features_[featureIdx] );
@@ -58,27 +61,136 @@ public:
 			      vector<size_t>& sampleIcs,
 			      vector<size_t>& missingIcs);
   
+  // Evaluates the best split of the samples with the numerical feature featureIdx.
+  // Samples with missing feature data are ignored. Only the fitness, the split
+  // value and the target statistics of the branches are returned; use
+  // numericalFeaturePartition() to apply the split. The statistics type must
+  // match the type of the target.
+  num_t numericalFeatureSplit(const size_t targetIdx,
+			      const size_t featureIdx,
+			      const size_t minSamples,
+			      const vector<size_t>& sampleIcs,
+			      const vector<uint8_t>& sampleWeights,
+			      num_t& splitValue,
+			      splitengine::TargetStat<num_t>& stat_left,
+			      splitengine::TargetStat<num_t>& stat_right,
+			      splitengine::SplitScratch<num_t>& scratch);
+
   num_t numericalFeatureSplit(const size_t targetIdx,
 			      const size_t featureIdx,
 			      const size_t minSamples,
-			      vector<size_t>& sampleIcs_left,
-			      vector<size_t>& sampleIcs_right,
-			      num_t& splitValue);
+			      const vector<size_t>& sampleIcs,
+			      const vector<uint8_t>& sampleWeights,
+			      num_t& splitValue,
+			      splitengine::TargetStat<cat_t>& stat_left,
+			      splitengine::TargetStat<cat_t>& stat_right,
+			      splitengine::SplitScratch<cat_t>& scratch);
+
+  num_t categoricalFeatureSplit(const size_t targetIdx,
+				const size_t featureIdx,
+				const vector<cat_t>& catOrder,
+				const size_t minSamples,
+				const vector<size_t>& sampleIcs,
+				const vector<uint8_t>& sampleWeights,
+				unordered_set<cat_t>& splitValues_left,
+				splitengine::TargetStat<num_t>& stat_left,
+				splitengine::TargetStat<num_t>& stat_right,
+				splitengine::SplitScratch<num_t>& scratch);
 
   num_t categoricalFeatureSplit(const size_t targetIdx,
 				const size_t featureIdx,
 				const vector<cat_t>& catOrder,
 				const size_t minSamples,
-				vector<size_t>& sampleIcs_left,
-				vector<size_t>& sampleIcs_right,
-				unordered_set<cat_t>& splitValues_left);
+				const vector<size_t>& sampleIcs,
+				const vector<uint8_t>& sampleWeights,
+				unordered_set<cat_t>& splitValues_left,
+				splitengine::TargetStat<cat_t>& stat_left,
+				splitengine::TargetStat<cat_t>& stat_right,
+				splitengine::SplitScratch<cat_t>& scratch);
 
   num_t textualFeatureSplit(const size_t targetIdx,
 			    const size_t featureIdx,
 			    const uint32_t hashIdx,
 			    const size_t minSamples,
-			    vector<size_t>& sampleIcs_left,
-			    vector<size_t>& sampleIcs_right);
+			    const vector<size_t>& sampleIcs,
+			    const vector<uint8_t>& sampleWeights,
+			    splitengine::TargetStat<num_t>& stat_left,
+			    splitengine::TargetStat<num_t>& stat_right);
+
+  num_t textualFeatureSplit(const size_t targetIdx,
+			    const size_t featureIdx,
+			    const uint32_t hashIdx,
+			    const size_t minSamples,
+			    const vector<size_t>& sampleIcs,
+			    const vector<uint8_t>& sampleWeights,
+			    splitengine::TargetStat<cat_t>& stat_left,
+			    splitengine::TargetStat<cat_t>& stat_right);
+
+  // Randomized splits for extremely randomized trees. The numerical split
+  // places the threshold at the relative position u in [0,1) between the
+  // smallest and largest feature value of the samples, and the categorical
+  // split sends the given categories to the left. Both are scored in one
+  // pass over the samples.
+  num_t randomNumericalFeatureSplit(const size_t targetIdx,
+				    const size_t featureIdx,
+				    const size_t minSamples,
+				    const vector<size_t>& sampleIcs,
+				    const vector<uint8_t>& sampleWeights,
+				    const num_t u,
+				    num_t& splitValue,
+				    splitengine::TargetStat<num_t>& stat_left,
+				    splitengine::TargetStat<num_t>& stat_right);
+
+  num_t randomNumericalFeatureSplit(const size_t targetIdx,
+				    const size_t featureIdx,
+				    const size_t minSamples,
+				    const vector<size_t>& sampleIcs,
+				    const vector<uint8_t>& sampleWeights,
+				    const num_t u,
+				    num_t& splitValue,
+				    splitengine::TargetStat<cat_t>& stat_left,
+				    splitengine::TargetStat<cat_t>& stat_right);
+
+  num_t categoricalFeatureSubsetSplit(const size_t targetIdx,
+				      const size_t featureIdx,
+				      const size_t minSamples,
+				      const vector<size_t>& sampleIcs,
+				      const vector<uint8_t>& sampleWeights,
+				      const unordered_set<cat_t>& splitValues_left,
+				      splitengine::TargetStat<num_t>& stat_left,
+				      splitengine::TargetStat<num_t>& stat_right);
+
+  num_t categoricalFeatureSubsetSplit(const size_t targetIdx,
+				      const size_t featureIdx,
+				      const size_t minSamples,
+				      const vector<size_t>& sampleIcs,
+				      const vector<uint8_t>& sampleWeights,
+				      const unordered_set<cat_t>& splitValues_left,
+				      splitengine::TargetStat<cat_t>& stat_left,
+				      splitengine::TargetStat<cat_t>& stat_right);
+
+  // Partitions the samples according to a split. Samples with missing
+  // feature data are stored in sampleIcs_missing.
+  void numericalFeaturePartition(const size_t featureIdx,
+				 const num_t splitValue,
+				 const vector<size_t>& sampleIcs,
+				 vector<size_t>& sampleIcs_left,
+				 vector<size_t>& sampleIcs_right,
+				 vector<size_t>& sampleIcs_missing);
+
+  void categoricalFeaturePartition(const size_t featureIdx,
+				   const unordered_set<cat_t>& splitValues_left,
+				   const vector<size_t>& sampleIcs,
+				   vector<size_t>& sampleIcs_left,
+				   vector<size_t>& sampleIcs_right,
+				   vector<size_t>& sampleIcs_missing);
+
+  void textualFeaturePartition(const size_t featureIdx,
+			       const uint32_t hashIdx,
+			       const vector<size_t>& sampleIcs,
+			       vector<size_t>& sampleIcs_left,
+			       vector<size_t>& sampleIcs_right,
+			       vector<size_t>& sampleIcs_missing);
     
   //string getRawFeatureData(const size_t featureIdx, const size_t sampleIdx);
   //string getRawFeatureData(const size_t featureIdx, const num_t data);
@@ -93,7 +205,22 @@ public:
                                 vector<size_t>& ics, 
                                 vector<size_t>& oobIcs);
 
+  // Generates a bootstrap sample from the real samples of featureIdx as per-sample
+  // multiplicities: sampleWeights[i] is the number of times sample i was drawn.
+  // ics will hold the unique samples in the bootstrap sample in increasing order,
+  // and oobIcs the real samples with zero weight. Drawing a sample more than 255
+  // times, which the weights cannot hold, is an error.
+  void bootstrapWeightsFromRealSamples(distributions::Random* random,
+				       const bool withReplacement,
+				       const num_t sampleSize,
+				       const size_t featureIdx,
+				       vector<uint8_t>& sampleWeights,
+				       vector<size_t>& ics,
+				       vector<size_t>& oobIcs);
+
   void createContrasts();
+  void setNContrastSets(const size_t nContrastSets);
+  size_t nContrastSets() const { return( nContrastSets_ ); }
   void permuteContrasts(distributions::Random* random);
 
   void replaceFeatureData(const size_t featureIdx, const vector<num_t>& featureData);
@@ -122,7 +249,63 @@ private:
 
   //template <typename T> void transpose(vector<vector<T> >& mat);
 
+  // Split kernels specialized for the target data type
+  template<typename T>
+  num_t numericalFeatureSplit(const vector<T>& targetData,
+			      const size_t featureIdx,
+			      const size_t minSamples,
+			      const vector<size_t>& sampleIcs,
+			      const vector<uint8_t>& sampleWeights,
+			      num_t& splitValue,
+			      splitengine::TargetStat<T>& stat_left,
+			      splitengine::TargetStat<T>& stat_right,
+			      splitengine::SplitScratch<T>& scratch);
+
+  template<typename T>
+  num_t categoricalFeatureSplit(const vector<T>& targetData,
+				const size_t featureIdx,
+				const vector<cat_t>& catOrder,
+				const size_t minSamples,
+				const vector<size_t>& sampleIcs,
+				const vector<uint8_t>& sampleWeights,
+				unordered_set<cat_t>& splitValues_left,
+				splitengine::TargetStat<T>& stat_left,
+				splitengine::TargetStat<T>& stat_right,
+				splitengine::SplitScratch<T>& scratch);
+
+  template<typename T>
+  num_t textualFeatureSplit(const vector<T>& targetData,
+			    const size_t featureIdx,
+			    const uint32_t hashIdx,
+			    const size_t minSamples,
+			    const vector<size_t>& sampleIcs,
+			    const vector<uint8_t>& sampleWeights,
+			    splitengine::TargetStat<T>& stat_left,
+			    splitengine::TargetStat<T>& stat_right);
+
+  template<typename T>
+  num_t randomNumericalFeatureSplit(const vector<T>& targetData,
+				    const size_t featureIdx,
+				    const size_t minSamples,
+				    const vector<size_t>& sampleIcs,
+				    const vector<uint8_t>& sampleWeights,
+				    const num_t u,
+				    num_t& splitValue,
+				    splitengine::TargetStat<T>& stat_left,
+				    splitengine::TargetStat<T>& stat_right);
+
+  template<typename T>
+  num_t categoricalFeatureSubsetSplit(const vector<T>& targetData,
+				      const size_t featureIdx,
+				      const size_t minSamples,
+				      const vector<size_t>& sampleIcs,
+				      const vector<uint8_t>& sampleWeights,
+				      const unordered_set<cat_t>& splitValues_left,
+				      splitengine::TargetStat<T>& stat_left,
+				      splitengine::TargetStat<T>& stat_right);
+
   bool useContrasts_;
+  size_t nContrastSets_;
   
   vector<Feature> features_;
   vector<string> sampleHeaders_;
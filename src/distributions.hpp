@@ -16,6 +16,15 @@ namespace distributions {
   
   inline unsigned int generateSeed() { return( clock() + time(0) ); }
 
+  // Seed of an independent stream derived from a base seed, e.g. the stream of one
+  // tree of a forest. The SplitMix64 finalizer decorrelates neighbouring indices
+  inline size_t streamSeed(const size_t seed, const size_t streamIdx) {
+    unsigned long long z = static_cast<unsigned long long>(seed) + 0x9e3779b97f4a7c15ULL * ( static_cast<unsigned long long>(streamIdx) + 1 );
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+    return( static_cast<size_t>( z ^ ( z >> 31 ) ) );
+  }
+
   class Random {
   public:
     
@@ -43,6 +43,9 @@ public:
 
   unordered_set<uint32_t> getTxtData(const size_t sampleIdx) const;
 
+  // Raw data storage, resolved at compile time by the data type
+  template<typename T> const vector<T>& data() const;
+
   bool isNumerical() const;
   bool isCategorical() const;
   bool isTextual() const;
@@ -75,5 +78,8 @@ private:
 
 };
 
+template<> inline const vector<num_t>& Feature::data<num_t>() const { return( numData ); }
+template<> inline const vector<cat_t>& Feature::data<cat_t>() const { return( catData ); }
+template<> inline const vector<unordered_set<uint32_t> >& Feature::data<unordered_set<uint32_t> >() const { return( txtData ); }
 
 #endif
@@ -59,26 +59,40 @@ num_t math::ttest(const vector<num_t>& x,
 		  const vector<num_t>& y,
 		  const bool WS) {
 
-  // Sample mean and variance of x
-  num_t mean_x = math::mean(x);
-  num_t var_x = math::var(x,mean_x);
-  size_t n_x = x.size();
-
   // If sample size is too small, we exit
-  if ( n_x < 2 ) {
+  if ( x.size() < 2 || y.size() < 2 ) {
     return( datadefs::NUM_NAN );
   }
 
-  // Sample mean and variance of y
+  // Sample means and variances of x and y
+  num_t mean_x = math::mean(x);
   num_t mean_y = math::mean(y);
-  num_t var_y = math::var(y,mean_y);
-  size_t n_y = y.size();
+
+  return( math::ttest(mean_x,math::var(x,mean_x),x.size(),mean_y,math::var(y,mean_y),y.size(),WS) );
+
+}
+
+num_t math::ttest(const Moments& x,
+		  const Moments& y,
+		  const bool WS) {
 
   // If sample size is too small, we exit
-  if ( n_y < 2 ) {
+  if ( x.n < 2 || y.n < 2 ) {
     return( datadefs::NUM_NAN );
   }
 
+  return( math::ttest(x.mean,x.var(),x.n,y.mean,y.var(),y.n,WS) );
+
+}
+
+num_t math::ttest(const num_t mean_x,
+		  const num_t var_x,
+		  const size_t n_x,
+		  const num_t mean_y,
+		  const num_t var_y,
+		  const size_t n_y,
+		  const bool WS) {
+
   // Degrees of freedom
   num_t v;
 
@@ -211,6 +225,28 @@ num_t math::erf(const num_t x) {
 
 }
 
+num_t math::normalQuantile(const num_t p) {
+
+  if ( p <= 0.0 || p >= 1.0 ) {
+    return( datadefs::NUM_NAN );
+  }
+
+  num_t x = 2.0*p - 1.0;
+
+  num_t sgn;
+  if(x < 0.0) {
+    sgn = -1.0;
+  } else {
+    sgn = 1.0;
+  }
+
+  num_t lnx = log(1.0 - x*x);
+  num_t h = 2.0 / ( datadefs::NUM_PI * datadefs::A ) + lnx / 2.0;
+
+  return( sgn*sqrt(2.0)*sqrt( sqrt( h*h - lnx / datadefs::A ) - h ) );
+
+}
+
 num_t math::pearsonCorrelation(const vector<num_t>& x,
 			       const vector<num_t>& y) {
 
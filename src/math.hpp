@@ -74,6 +74,12 @@ namespace math {
   */
   num_t erf(num_t x);
 
+  /**
+     Quantile function of the standard normal distribution, computed by
+     inverting the approximation of erf() in closed form
+  */
+  num_t normalQuantile(const num_t p);
+
   void adjustPValues(vector<num_t>& pValues, const size_t nTests);
 
   /**
@@ -84,6 +90,58 @@ namespace math {
               const vector<num_t>& y,
 	      const bool WS = false);
 
+  /**
+     Running mean and sum of squared deviations of a sample, updated one
+     value at a time with Welford's algorithm, so that the sample itself
+     need not be stored
+  */
+  struct Moments {
+
+    size_t n;
+    double mean;
+    double M2;
+
+    Moments(): n(0), mean(0.0), M2(0.0) {}
+
+    void add(const num_t x) {
+      ++n;
+      double delta = x - mean;
+      mean += delta / n;
+      M2 += delta * ( x - mean );
+    }
+
+    // Adds the sample of the other moments, as if its values were added one by one
+    void merge(const Moments& other) {
+      if ( other.n == 0 ) {
+	return;
+      }
+      size_t nTotal = n + other.n;
+      double delta = other.mean - mean;
+      mean += delta * other.n / nTotal;
+      M2 += other.M2 + delta * delta * n * other.n / nTotal;
+      n = nTotal;
+    }
+
+    num_t var() const {
+      return( n > 1 ? M2 / ( n - 1 ) : datadefs::NUM_NAN );
+    }
+
+  };
+
+  // Two-sample t-test from the moments of the samples
+  num_t ttest(const Moments& x,
+	      const Moments& y,
+	      const bool WS = false);
+
+  // Two-sample t-test from the means, variances and sizes of the samples
+  num_t ttest(const num_t mean_x,
+	      const num_t var_x,
+	      const size_t n_x,
+	      const num_t mean_y,
+	      const num_t var_y,
+	      const size_t n_y,
+	      const bool WS = false);
+
   /**
      Regularized incomplete Beta function
      NOTE: see http://en.wikipedia.org/wiki/Beta_function
@@ -73,6 +73,11 @@ public:
   vector<num_t> quantiles; const string quantiles_s; const string quantiles_l;
   size_t nSamplesForQuantiles; const string nSamplesForQuantiles_s; const string nSamplesForQuantiles_l;
   bool distributions; const string distributions_s; const string distributions_l; 
+  bool extraTrees; const string extraTrees_s; const string extraTrees_l;
+  bool weightedBootstrap; const string weightedBootstrap_s; const string weightedBootstrap_l;
+  num_t oobTolerance; const string oobTolerance_s; const string oobTolerance_l;
+  size_t oobWindow; const string oobWindow_s; const string oobWindow_l;
+  size_t treeOffset; const string treeOffset_s; const string treeOffset_l;
 
   num_t inBoxFraction;
   bool sampleWithReplacement;
@@ -90,7 +95,12 @@ public:
     noNABranching(false),noNABranching_s("N"), noNABranching_l("noNABranching"),
     quantiles_s("q"), quantiles_l("quantiles"),
     nSamplesForQuantiles_s("r"), nSamplesForQuantiles_l("qSamples"),
-    distributions(false), distributions_s("d"), distributions_l("distributions") {
+    distributions(false), distributions_s("d"), distributions_l("distributions"),
+    extraTrees(false), extraTrees_s("x"), extraTrees_l("extraTrees"),
+    weightedBootstrap(false), weightedBootstrap_s("b"), weightedBootstrap_l("weightedBootstrap"),
+    oobTolerance(0.0), oobTolerance_s("O"), oobTolerance_l("oobTolerance"),
+    oobWindow(datadefs::RF_DEFAULT_OOB_WINDOW), oobWindow_s("J"), oobWindow_l("oobWindow"),
+    treeOffset(0), treeOffset_s("g"), treeOffset_l("treeOffset") {
     
     forestType = forest_t::QRF;
 
@@ -138,6 +148,11 @@ public:
     parser.getArgument<num_t>(  contrastFraction_s, contrastFraction_l, contrastFraction );
     parser.getFlag(             noNABranching_s,    noNABranching_l,    noNABranching );
     parser.getFlag(             distributions_s,    distributions_l,    distributions);
+    parser.getFlag(             extraTrees_s,       extraTrees_l,       extraTrees );
+    parser.getFlag(             weightedBootstrap_s, weightedBootstrap_l, weightedBootstrap );
+    parser.getArgument<num_t>(  oobTolerance_s,     oobTolerance_l,     oobTolerance );
+    parser.getArgument<size_t>( oobWindow_s,        oobWindow_l,        oobWindow );
+    parser.getArgument<size_t>( treeOffset_s,       treeOffset_l,       treeOffset );
 
     string quantilesAsStr;
     parser.getArgument<string>( quantiles_s,        quantiles_l,        quantilesAsStr );
@@ -232,6 +247,16 @@ public:
       exit(1);
     }
     
+    if ( oobTolerance < 0.0 ) {
+      cerr << "ERROR: oobTolerance must be non-negative!" << endl;
+      exit(1);
+    }
+
+    if ( oobTolerance > 0.0 && oobWindow == 0 ) {
+      cerr << "ERROR: oobWindow must be set for out-of-bag early stopping!" << endl;
+      exit(1);
+    }
+
     if ( inBoxFraction <= 0.0 || inBoxFraction > 1.0 ) {
       cerr << "ERROR: inBoxFraction must be between (0,1]" << endl;
       exit(1);
@@ -265,6 +290,11 @@ public:
     this->printHelpLine(quantiles_s,quantiles_l,"[QRF] comma-separated list of quantiles to build a Quantile Random Forest from");
     this->printHelpLine(nSamplesForQuantiles_s,nSamplesForQuantiles_l,"[QRF] specify the number of samples per tree for calculating the quantiles");
     this->printHelpLine(distributions_s,distributions_l,"[QRF] If set, distributions will be output in the prediction file");
+    this->printHelpLine(extraTrees_s,extraTrees_l,"If set, extremely randomized trees are grown: splits use random thresholds and category subsets");
+    this->printHelpLine(weightedBootstrap_s,weightedBootstrap_l,"If set, the bootstrap sample is stored as per-sample multiplicities instead of duplicated samples");
+    this->printHelpLine(oobTolerance_s,oobTolerance_l,"[RF+QRF] Stop adding trees once the out-of-bag error changes by less than this relative amount over a window (0 = grow all trees)");
+    this->printHelpLine(oobWindow_s,oobWindow_l,"[RF+QRF] Number of trees grown between the out-of-bag error checks");
+    this->printHelpLine(treeOffset_s,treeOffset_l,"[RF+QRF] Index of the first tree grown, so that runs with the same seed grow disjoint ranges of the same forest");
   }
 
   void print() {
@@ -295,6 +325,15 @@ public:
       exit(1);
     }
     this->printOption(noNABranching_s,noNABranching_l,noNABranching);
+    this->printOption(extraTrees_s,extraTrees_l,extraTrees);
+    this->printOption(weightedBootstrap_s,weightedBootstrap_l,weightedBootstrap);
+    if ( oobTolerance > 0.0 ) {
+      this->printOption(oobTolerance_s,oobTolerance_l,oobTolerance);
+      this->printOption(oobWindow_s,oobWindow_l,oobWindow);
+    }
+    if ( treeOffset > 0 ) {
+      this->printOption(treeOffset_s,treeOffset_l,treeOffset);
+    }
     cout << endl;
   }
    
@@ -306,6 +345,11 @@ public:
   // Statistical test related parameters
   size_t nPerms; const string nPerms_s; const string nPerms_l;
   num_t pValueThreshold; const string pValueThreshold_s; const string pValueThreshold_l;
+  bool permImportance; const string permImportance_s; const string permImportance_l;
+  bool minDepth; const string minDepth_s; const string minDepth_l;
+  size_t permBatch; const string permBatch_s; const string permBatch_l;
+  size_t nContrastSets; const string nContrastSets_s; const string nContrastSets_l;
+  size_t permOffset; const string permOffset_s; const string permOffset_l;
   //bool isAdjustedPValue; const string isAdjustedPValue_s; const string isAdjustedPValue_l;
   //bool normalizeImportanceValues; const string normalizeImportanceValues_s; const string normalizeImportanceValues_l;
   //num_t importanceThreshold; const string importanceThreshold_s; const string importanceThreshold_l;
@@ -313,7 +357,12 @@ public:
 
   FilterOptions():
     nPerms(datadefs::FILTER_DEFAULT_N_PERMS),nPerms_s("p"),nPerms_l("nPerms"),
-    pValueThreshold(datadefs::FILTER_DEFAULT_P_VALUE_THRESHOLD),pValueThreshold_s("t"),pValueThreshold_l("pValueTh") {}
+    pValueThreshold(datadefs::FILTER_DEFAULT_P_VALUE_THRESHOLD),pValueThreshold_s("t"),pValueThreshold_l("pValueTh"),
+    permImportance(false),permImportance_s("u"),permImportance_l("permImportance"),
+    minDepth(false),minDepth_s("y"),minDepth_l("minDepth"),
+    permBatch(datadefs::FILTER_DEFAULT_PERM_BATCH),permBatch_s("K"),permBatch_l("permBatch"),
+    nContrastSets(datadefs::FILTER_DEFAULT_N_CONTRAST_SETS),nContrastSets_s("C"),nContrastSets_l("contrastSets"),
+    permOffset(0),permOffset_s("Z"),permOffset_l("permOffset") {}
     //isAdjustedPValue(datadefs::FILTER_DEFAULT_IS_ADJUSTED_P_VALUE),isAdjustedPValue_s("d"),isAdjustedPValue_l("adjustP"),
     //normalizeImportanceValues(datadefs::FILTER_NORMALIZE_IMPORTANCE_VALUES),normalizeImportanceValues_s("r"),normalizeImportanceValues_l("normImportance"),
     //importanceThreshold(datadefs::FILTER_DEFAULT_IMPORTANCE_THRESHOLD),importanceThreshold_s("o"),importanceThreshold_l("importanceTh") {}
@@ -325,6 +374,11 @@ public:
     ArgParse parser(argc,argv);
     parser.getArgument<size_t>(nPerms_s,nPerms_l,nPerms);
     parser.getArgument<num_t>(pValueThreshold_s,pValueThreshold_l,pValueThreshold);
+    parser.getFlag(permImportance_s,permImportance_l,permImportance);
+    parser.getFlag(minDepth_s,minDepth_l,minDepth);
+    parser.getArgument<size_t>(permBatch_s,permBatch_l,permBatch);
+    parser.getArgument<size_t>(nContrastSets_s,nContrastSets_l,nContrastSets);
+    parser.getArgument<size_t>(permOffset_s,permOffset_l,permOffset);
     //parser.getArgument<bool>(isAdjustedPValue_s,isAdjustedPValue_l,isAdjustedPValue);
     //parser.getArgument<num_t>(importanceThreshold_s,importanceThreshold_l,importanceThreshold);
     //parser.getArgument<bool>(normalizeImportanceValues_s,normalizeImportanceValues_l,normalizeImportanceValues);
@@ -334,12 +388,25 @@ public:
   void validate() {
     assert( nPerms >= 5 );
     assert( 0 <= pValueThreshold && pValueThreshold <= 1.0 );
+    if ( permImportance && minDepth ) {
+      cerr << "ERROR: permutation importance and minimal depth cannot be used together!" << endl;
+      exit(1);
+    }
+    if ( nContrastSets < 1 ) {
+      cerr << "ERROR: at least one set of contrasts is needed!" << endl;
+      exit(1);
+    }
   }
 
   void help() {
     cout << "Filter Options:" << endl;
     this->printHelpLine(nPerms_s,nPerms_l,"Number of permutations in statistical test");
     this->printHelpLine(pValueThreshold_s,pValueThreshold_l,"P-value threshold in statistical test");
+    this->printHelpLine(permImportance_s,permImportance_l,"If set, features are scored by out-of-bag permutation importance instead of mean decrease in impurity");
+    this->printHelpLine(minDepth_s,minDepth_l,"If set, features are scored by mean minimal depth in the trees; smaller is more important");
+    this->printHelpLine(permBatch_s,permBatch_l,"If > 0, features are tested after every batch of this many permutations, and features already decided are left out of the next batches. The p-value threshold is split evenly over the tests");
+    this->printHelpLine(nContrastSets_s,nContrastSets_l,"Number of independently permuted contrast sets in each forest; each set adds to the null sample at the cost of memory");
+    this->printHelpLine(permOffset_s,permOffset_l,"Offset added to the random seed of a partial filter run; partial runs to be merged need distinct offsets, e.g. the index of their first permutation");
     //this->printHelpLine(isAdjustedPValue_s,isAdjustedPValue_l,"Flag to turn ON Benjamini-Hochberg multiple testing correction");
     //this->printHelpLine(importanceThreshold_s,importanceThreshold_l,"Importance threshold");
     //this->printHelpLine(normalizeImportanceValues_s,normalizeImportanceValues_l,"Flag to turn ON normalization of importance scores");
@@ -350,6 +417,11 @@ public:
     cout << "Filter options:" << endl;
     this->printOption(nPerms_s,nPerms_l,nPerms);
     this->printOption(pValueThreshold_s,pValueThreshold_l,pValueThreshold);
+    this->printOption(permImportance_s,permImportance_l,permImportance);
+    this->printOption(minDepth_s,minDepth_l,minDepth);
+    this->printOption(permBatch_s,permBatch_l,permBatch);
+    this->printOption(nContrastSets_s,nContrastSets_l,nContrastSets);
+    this->printOption(permOffset_s,permOffset_l,permOffset);
     cout << endl;
     //cout << "isAdjustedPValue = " << isAdjustedPValue << endl;
     //cout << "normalizeImportanceValues = " << normalizeImportanceValues << endl;
@@ -374,6 +446,13 @@ public:
   string featureWeightsFile; const string featureWeightsFile_s; const string featureWeightsFile_l;
   string whiteListFile; const string whiteListFile_s; const string whiteListFile_l;
   string blackListFile; const string blackListFile_s; const string blackListFile_l;
+  string filterPartialFile; const string filterPartialFile_s; const string filterPartialFile_l;
+  string mergeFilterPartials; const string mergeFilterPartials_s; const string mergeFilterPartials_l;
+  string mergeForests; const string mergeForests_s; const string mergeForests_l;
+  string checkpointFile; const string checkpointFile_s; const string checkpointFile_l;
+  bool resume; const string resume_s; const string resume_l;
+  bool evictTrees; const string evictTrees_s; const string evictTrees_l;
+  bool warmStart; const string warmStart_s; const string warmStart_l;
 
   bool trainStream; const string trainStream_s; const string trainStream_l;
   
@@ -390,6 +469,13 @@ public:
     featureWeightsFile_s("w"), featureWeightsFile_l("featureWeights"),
     whiteListFile_s("W"), whiteListFile_l("whiteList"),
     blackListFile_s("B"), blackListFile_l("blackList"),
+    filterPartialFile_s("Q"), filterPartialFile_l("filterPartial"),
+    mergeFilterPartials_s("M"), mergeFilterPartials_l("mergePartials"),
+    mergeForests_s("U"), mergeForests_l("mergeForests"),
+    checkpointFile_s("E"), checkpointFile_l("checkpoint"),
+    resume(false), resume_s("j"), resume_l("resume"),
+    evictTrees(false), evictTrees_s("z"), evictTrees_l("evictTrees"),
+    warmStart(false), warmStart_s("Y"), warmStart_l("warmStart"),
     trainStream(false), trainStream_s("S"), trainStream_l("trainStream") {}
 
   ~IO() {}
@@ -408,6 +494,13 @@ public:
     parser.getArgument<string>(featureWeightsFile_s,featureWeightsFile_l,featureWeightsFile);
     parser.getArgument<string>(whiteListFile_s,whiteListFile_l,whiteListFile);
     parser.getArgument<string>(blackListFile_s,blackListFile_l,blackListFile);
+    parser.getArgument<string>(filterPartialFile_s,filterPartialFile_l,filterPartialFile);
+    parser.getArgument<string>(mergeFilterPartials_s,mergeFilterPartials_l,mergeFilterPartials);
+    parser.getArgument<string>(mergeForests_s,mergeForests_l,mergeForests);
+    parser.getArgument<string>(checkpointFile_s,checkpointFile_l,checkpointFile);
+    parser.getFlag(resume_s,resume_l,resume);
+    parser.getFlag(evictTrees_s,evictTrees_l,evictTrees);
+    parser.getFlag(warmStart_s,warmStart_l,warmStart);
 
     parser.getFlag(trainStream_s,trainStream_l,trainStream);
   }
@@ -423,7 +516,14 @@ public:
     this->printHelpLine(testDataFile_s,testDataFile_l,"Load data file (.afm or .arff) for testing a model");
     this->printHelpLine(loadForestFile_s,loadForestFile_l,"Load model from file (.sf)");
     this->printHelpLine(saveForestFile_s,saveForestFile_l,"Save model to file (.sf)");
+    this->printHelpLine(mergeForests_s,mergeForests_l,"Merge comma-separated model files (.sf) of the same target, and save the merged model to file");
+    this->printHelpLine(checkpointFile_s,checkpointFile_l,"Append each tree to this file as soon as it is grown, so that interrupted training can be resumed");
+    this->printHelpLine(resume_s,resume_l,"If set, the trees in the checkpoint file are kept, and only the missing trees are grown");
+    this->printHelpLine(evictTrees_s,evictTrees_l,"If set, each tree is freed once written to the checkpoint or model file, which bounds the memory to the trees being grown");
+    this->printHelpLine(warmStart_s,warmStart_l,"If set, the trees grown on the train data are added to the loaded model instead of replacing it");
     this->printHelpLine(associationsFile_s,associationsFile_l,"Save associations to file");
+    this->printHelpLine(filterPartialFile_s,filterPartialFile_l,"Save the statistics of the filter permutations to file, to be merged with other partial runs");
+    this->printHelpLine(mergeFilterPartials_s,mergeFilterPartials_l,"Merge comma-separated partial filter results, and save the associations to file");
     this->printHelpLine(predictionsFile_s,predictionsFile_l,"Save predictions to file");
     this->printHelpLine(pairInteractionsFile_s,pairInteractionsFile_l,"Save pair interactions to file");
     this->printHelpLine(logFile_s,logFile_l,"Save log to file");
@@ -442,6 +542,13 @@ public:
     cout << "featureWeightsFile = " << featureWeightsFile << endl;
     cout << "whiteListFile = " << whiteListFile << endl;
     cout << "blackListFile = " << blackListFile << endl;
+    cout << "filterPartialFile = " << filterPartialFile << endl;
+    cout << "mergeFilterPartials = " << mergeFilterPartials << endl;
+    cout << "mergeForests = " << mergeForests << endl;
+    cout << "checkpointFile = " << checkpointFile << endl;
+    cout << "resume = " << resume << endl;
+    cout << "evictTrees = " << evictTrees << endl;
+    cout << "warmStart = " << warmStart << endl;
   }
   
   void validate() {
@@ -457,6 +564,32 @@ public:
       exit(1);
     }
 
+    if ( resume && checkpointFile == "" ) {
+      cerr << "ERROR: Specify the checkpoint file to resume from" << endl;
+      exit(1);
+    }
+
+    if ( evictTrees && checkpointFile == "" && saveForestFile == "" ) {
+      cerr << "ERROR: Specify the checkpoint or model file to write the evicted trees to" << endl;
+      exit(1);
+    }
+
+    if ( warmStart && ( loadForestFile == "" || trainDataFile == "" ) ) {
+      cerr << "ERROR: Specify the model to load and the train data to grow the added trees on" << endl;
+      exit(1);
+    }
+
+    // The whole model is in memory until it is saved
+    if ( warmStart && evictTrees ) {
+      cerr << "ERROR: Trees cannot be evicted when adding trees to a loaded model" << endl;
+      exit(1);
+    }
+
+    if ( mergeForests != "" && saveForestFile == "" ) {
+      cerr << "ERROR: Specify the file to save the merged model to" << endl;
+      exit(1);
+    }
+
   }
 
 };
@@ -520,7 +653,7 @@ public:
 
   void help() {
     cout << "General Options:" << endl;
-    this->printHelpLine(targetStr_s,targetStr_l,"Name or index for the variable to make modeling for");
+    this->printHelpLine(targetStr_s,targetStr_l,"Name or index for the variable to make modeling for. Filtering takes also a comma-separated list of names, indices and index ranges, e.g. 0-99");
     this->printHelpLine(dataDelimiter_s,dataDelimiter_l,"[AFM only] Field delimiter");
     this->printHelpLine(headerDelimiter_s,headerDelimiter_l,"[AFM only] Feature type and name delimiter");
     this->printHelpLine(pruneFeatures_s,pruneFeatures_l,"Prune Features");
@@ -589,11 +722,25 @@ public:
     cout << "Feature selection examples:" << endl
 	 << "bin/rf-ace -" << io.filterDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << forestOptions.nTrees_s << " 100 -" << forestOptions.mTry_s << " 30 -" << io.associationsFile_s << " associations.tsv" << endl
 	 << "bin/rf-ace -" << io.filterDataFile_s << " data.afm -" << generalOptions.targetStr_s << " 5      -" << forestOptions.nTrees_s << " 100 -" << forestOptions.mTry_s << " 30 -" << filterOptions.nPerms_s << " 50 -" << filterOptions.pValueThreshold_s << " 0.001 -" << io.associationsFile_s << " associations.tsv" << endl << endl;
+
+    cout << "Feature selection in two partial runs, and the merge of their results:" << endl
+	 << "bin/rf-ace -" << io.filterDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << filterOptions.nPerms_s << " 25 -" << generalOptions.seed_s << " 1 -" << filterOptions.permOffset_s << " 0  -" << io.filterPartialFile_s << " part0.tsv" << endl
+	 << "bin/rf-ace -" << io.filterDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << filterOptions.nPerms_s << " 25 -" << generalOptions.seed_s << " 1 -" << filterOptions.permOffset_s << " 25 -" << io.filterPartialFile_s << " part1.tsv" << endl
+	 << "bin/rf-ace -" << io.mergeFilterPartials_s << " part0.tsv,part1.tsv -" << io.associationsFile_s << " associations.tsv" << endl << endl;
     
     cout << "Model training & prediction examples:" << endl
 	 << "bin/rf-ace -" << io.trainDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << io.testDataFile_s << " testdata.afm -" << forestOptions.nTrees_s << " 100 -" << forestOptions.mTry_s << " 30 -" << io.predictionsFile_s << " predictions.tsv" << endl
 	 << "bin/rf-ace -" << io.trainDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << io.saveForestFile_s << " model.sf" << endl
-	 << "bin/rf-ace -" << io.loadForestFile_s << " model.sf -" << io.testDataFile_s << " testdata.afm -" << io.predictionsFile_s << " predictions.tsv" << endl << endl;
+	 << "bin/rf-ace -" << io.trainDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << io.checkpointFile_s << " checkpoint.sf -" << io.resume_s << " -" << io.saveForestFile_s << " model.sf" << endl
+	 << "bin/rf-ace -" << io.trainDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << io.evictTrees_s << " -" << io.saveForestFile_s << " model.sf -" << io.testDataFile_s << " testdata.afm -" << io.predictionsFile_s << " predictions.tsv" << endl
+	 << "bin/rf-ace -" << io.loadForestFile_s << " model.sf -" << io.trainDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << forestOptions.nTrees_s << " 100 -" << io.warmStart_s << " -" << io.saveForestFile_s << " model.sf" << endl
+	 << "bin/rf-ace -" << io.loadForestFile_s << " model.sf -" << io.testDataFile_s << " testdata.afm -" << io.predictionsFile_s << " predictions.tsv" << endl
+	 << "bin/rf-ace -" << io.mergeForests_s << " model1.sf,model2.sf -" << io.saveForestFile_s << " model.sf" << endl << endl;
+
+    cout << "Model training in two parts covering trees 0-99 and 100-199, and the merge of the parts:" << endl
+	 << "bin/rf-ace -" << io.trainDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << forestOptions.nTrees_s << " 100 -" << generalOptions.seed_s << " 1 -" << forestOptions.treeOffset_s << " 0   -" << io.saveForestFile_s << " part0.sf" << endl
+	 << "bin/rf-ace -" << io.trainDataFile_s << " data.afm -" << generalOptions.targetStr_s << " target -" << forestOptions.nTrees_s << " 100 -" << generalOptions.seed_s << " 1 -" << forestOptions.treeOffset_s << " 100 -" << io.saveForestFile_s << " part1.sf" << endl
+	 << "bin/rf-ace -" << io.mergeForests_s << " part0.sf,part1.sf -" << io.saveForestFile_s << " model.sf" << endl << endl;
     
   }
   
@@ -24,6 +24,9 @@ public:
     ss >> val;
     return(reader);
   }
+
+  inline friend Reader& operator>>(Reader& reader, datadefs::num_t& val);
+  inline friend Reader& operator>>(Reader& reader, string& str);
   
   bool nextLine();
 
@@ -57,7 +60,7 @@ private:
 
 };
 
-template<> inline Reader& operator>>(Reader& reader, datadefs::num_t& val) {
+inline Reader& operator>>(Reader& reader, datadefs::num_t& val) {
   reader.checkLineFeed();
   std::string field;
   std::getline(reader.lineFeed_,field,reader.delimiter_);
@@ -87,7 +90,7 @@ template<> inline Reader& operator>>(Reader& reader, datadefs::num_t& val) {
   }
 */
 
-template<> inline Reader& operator>>(Reader& reader, string& str) {
+inline Reader& operator>>(Reader& reader, string& str) {
   reader.checkLineFeed();
   std::getline(reader.lineFeed_,str,reader.delimiter_);
   str = utils::chomp(str);
@@ -27,11 +27,15 @@ void printHeader(ostream& out) {
 
 size_t getTargetIdx(TreeData* treeData, const string& targetAsStr);
 
+vector<size_t> getTargetIcs(TreeData* treeData, const string& targetsAsStr);
+
 vector<num_t> readFeatureWeights(const TreeData* treeData, const size_t targetIdx, const Options& options);
 
 void printDataStatistics(TreeData* treeData, const size_t targetIdx);
 
-void writeFilterOutputToFile(RFACE::FilterOutput& filterOutput, const string& fileName);
+void writeFilterOutputHeader(ofstream& toAssociationFile);
+
+void writeFilterOutput(RFACE::FilterOutput& filterOutput, ofstream& toAssociationFile);
 
 void printQRFPredictionsToFile(RFACE::QRFPredictionOutput& qPredOut, const bool printDistributions, const string& fileName);
 
@@ -65,6 +69,42 @@ int main(const int argc, char* const argv[]) {
 
   timer.tic("Total time elapsed");
 
+  // Forests are merged tree by tree. With test data the merged forest makes the predictions
+  if ( options.io.mergeForests != "" ) {
+
+    vector<string> forestFiles = utils::split(options.io.mergeForests,',');
+
+    cout << "-Merging " << forestFiles.size() << " models into file '" << options.io.saveForestFile << "'" << endl;
+    size_t nTrees = rface.mergeForests(forestFiles,options.io.saveForestFile);
+    cout << "-Merged model has " << nTrees << " trees" << endl;
+
+    if ( options.io.loadForestFile == "" && options.io.testDataFile != "" ) {
+      options.io.loadForestFile = options.io.saveForestFile;
+    }
+
+    options.io.saveForestFile = "";
+
+  }
+
+  // Partial filter results are merged without the data they were collected from
+  if ( options.io.mergeFilterPartials != "" ) {
+
+    vector<string> partialFiles = utils::split(options.io.mergeFilterPartials,',');
+
+    cout << "-Merging " << partialFiles.size() << " partial filter results" << endl;
+    vector<RFACE::FilterOutput> filterOutputs = rface.mergeFilterPartials(partialFiles,&options.filterOptions);
+
+    if ( options.io.associationsFile != "" ) {
+      cout << "-Writing associations to file '" << options.io.associationsFile << "'" << endl;
+      ofstream toAssociationFile(options.io.associationsFile.c_str());
+      writeFilterOutputHeader(toAssociationFile);
+      for ( size_t i = 0; i < filterOutputs.size(); ++i ) {
+	writeFilterOutput(filterOutputs[i],toAssociationFile);
+      }
+    }
+
+  }
+
   if ( options.io.filterDataFile != "" ) {
 
     options.forestOptions.print();
@@ -75,30 +115,67 @@ int main(const int argc, char* const argv[]) {
     cout << "-Reading file '" << options.io.filterDataFile << "' for filtering" << endl;
     DenseTreeData filterData(options.io.filterDataFile,options.generalOptions.dataDelimiter,options.generalOptions.headerDelimiter,useContrasts);
 
-    size_t targetIdx = getTargetIdx(&filterData,options.generalOptions.targetStr);
+    // The data is read once, and the targets are filtered one after another
+    vector<size_t> targetIcs = getTargetIcs(&filterData,options.generalOptions.targetStr);
 
-    assert( targetIdx != filterData.end() );
-
-    printDataStatistics(&filterData,targetIdx);
-
-    vector<num_t> featureWeights = readFeatureWeights(&filterData,targetIdx,options);
-    
     if ( options.generalOptions.seed < 0 ) {
       options.generalOptions.seed = distributions::generateSeed();
     }
 
-    filterOutput = rface.filter(&filterData,targetIdx,featureWeights,&options.forestOptions,&options.filterOptions,options.io.saveForestFile);
+    ofstream toAssociationFile;
+    if ( options.io.associationsFile != "" ) {
+      cout << "-Writing associations to file '" << options.io.associationsFile << "'" << endl;
+      toAssociationFile.open(options.io.associationsFile.c_str());
+      writeFilterOutputHeader(toAssociationFile);
+    }
 
-    options.io.saveForestFile = "";
+    // The forests of all targets are appended to one file
+    if ( options.io.saveForestFile != "" ) {
+      ofstream toForestFile(options.io.saveForestFile.c_str());
+    }
 
-  } 
+    // And so are the partial results
+    if ( options.io.filterPartialFile != "" ) {
+      cout << "-Writing partial filter results to file '" << options.io.filterPartialFile << "'" << endl;
+      ofstream toPartialFile(options.io.filterPartialFile.c_str());
+    }
+
+    for ( size_t i = 0; i < targetIcs.size(); ++i ) {
+
+      size_t targetIdx = targetIcs[i];
+
+      if ( targetIcs.size() > 1 ) {
+	cout << endl << "-Filtering target " << i + 1 << " / " << targetIcs.size() << endl;
+      }
+
+      printDataStatistics(&filterData,targetIdx);
+
+      if ( filterData.feature(targetIdx)->isTextual() || filterData.feature(targetIdx)->nRealSamples() < 2 * options.forestOptions.nodeSize ) {
+	cout << "WARNING: skipping target '" << filterData.feature(targetIdx)->name() << "', which is textual or has too few samples" << endl;
+	continue;
+      }
+
+      vector<num_t> featureWeights = readFeatureWeights(&filterData,targetIdx,options);
+
+      // Every target starts from the same seed, so its associations do not
+      // depend on the other targets in the batch. Partial runs shift the seed
+      // by their offset, so that their permutations differ
+      rface.resetRandomNumberGenerators(options.generalOptions.nThreads,options.generalOptions.seed + options.filterOptions.permOffset);
+
+      filterOutput = rface.filter(&filterData,targetIdx,featureWeights,&options.forestOptions,&options.filterOptions,options.io.saveForestFile,options.io.filterPartialFile,options.io.evictTrees);
+
+      if ( options.io.associationsFile != "" ) {
+	writeFilterOutput(filterOutput,toAssociationFile);
+      }
+
+    }
+
+    options.io.saveForestFile = "";
 
-  if ( options.io.associationsFile != "" ) {
-    cout << "-Writing associations to file '" << options.io.associationsFile << "'" << endl;
-    writeFilterOutputToFile(filterOutput,options.io.associationsFile);
   } 
 
   if ( options.io.loadForestFile != "" && 
+       !options.io.warmStart &&
        options.io.testDataFile != "" && 
        options.forestOptions.forestType == forest_t::QRF && 
        options.io.predictionsFile != "" ) {
@@ -115,6 +192,9 @@ int main(const int argc, char* const argv[]) {
     rface.load(options.io.loadForestFile);
   }
 
+  // Trees added to the loaded model follow the trees loaded
+  size_t nLoadedTrees = options.io.warmStart ? rface.nTrees() : 0;
+
   if ( options.io.trainDataFile != "" ) {
 
     options.forestOptions.print();
@@ -131,8 +211,24 @@ int main(const int argc, char* const argv[]) {
     
     vector<num_t> featureWeights = readFeatureWeights(&trainData,targetIdx,options);
     
-    cout << "-Training the model" << endl;
-    rface.train(&trainData,targetIdx,featureWeights,&options.forestOptions);
+    // Evicted trees are written as they are grown, to the model file unless a checkpoint is given
+    if ( options.io.evictTrees && options.io.checkpointFile == "" ) {
+      options.io.checkpointFile = options.io.saveForestFile;
+    }
+
+    if ( options.io.warmStart ) {
+      cout << "-Adding " << options.forestOptions.nTrees << " trees to the " << nLoadedTrees << " trees of the model" << endl;
+      rface.addTrees(&trainData,targetIdx,featureWeights,&options.forestOptions,options.io.checkpointFile,options.io.resume);
+    } else {
+      cout << "-Training the model" << endl;
+      rface.train(&trainData,targetIdx,featureWeights,&options.forestOptions,options.io.checkpointFile,options.io.resume,options.io.evictTrees);
+    }
+
+    cout << "-Out-of-bag error of the model: " << rface.getOobError() << endl;
+
+    if ( options.forestOptions.oobTolerance > 0.0 ) {
+      cout << "-Grew " << rface.nTrees() - nLoadedTrees << " out of " << options.forestOptions.nTrees << " trees before the out-of-bag error converged" << endl;
+    }
     
   }
   
@@ -140,7 +236,11 @@ int main(const int argc, char* const argv[]) {
     cout << "-Reading test file '" << options.io.testDataFile << "'" << endl;
     DenseTreeData testData(options.io.testDataFile,options.generalOptions.dataDelimiter,options.generalOptions.headerDelimiter);
     cout << "-Making predictions" << endl;
-    qPredOut = rface.predictQRF(&testData,options.forestOptions);
+    if ( rface.hasEvictedTrees() ) {
+      qPredOut = rface.loadForestAndPredictQRF(options.io.checkpointFile,&testData,options.forestOptions);
+    } else {
+      qPredOut = rface.predictQRF(&testData,options.forestOptions);
+    }
   }
 
   if ( options.io.predictionsFile != "" ) {
@@ -148,7 +248,15 @@ int main(const int argc, char* const argv[]) {
     printQRFPredictionsToFile(qPredOut,options.forestOptions.distributions,options.io.predictionsFile);
   }
     
-  if ( options.io.saveForestFile != "" ) {
+  if ( options.io.saveForestFile != "" && rface.hasEvictedTrees() ) {
+    if ( options.io.saveForestFile != options.io.checkpointFile ) {
+      cout << "-Copying the trees of checkpoint '" << options.io.checkpointFile << "' to file '" << options.io.saveForestFile << "'" << endl;
+      rface.mergeForests(vector<string>(1,options.io.checkpointFile),options.io.saveForestFile);
+    }
+  } else if ( options.io.saveForestFile != "" && options.io.warmStart && options.io.saveForestFile == options.io.loadForestFile ) {
+    cout << "-Appending the added trees to file '" << options.io.saveForestFile << "'" << endl;
+    rface.save( options.io.saveForestFile, nLoadedTrees );
+  } else if ( options.io.saveForestFile != "" ) {
     cout << "-Writing predictor to file '" << options.io.saveForestFile << "'" << endl;
     rface.save( options.io.saveForestFile );    
   }
@@ -267,13 +375,57 @@ size_t getTargetIdx(TreeData* treeData, const string& targetAsStr) {
 
 }
 
-void writeFilterOutputToFile(RFACE::FilterOutput& filterOutput, const string& fileName) {
+// Targets are given as a feature name or index, or as a comma-separated list
+// of names, indices and index ranges, e.g. "0-99,N:output"
+vector<size_t> getTargetIcs(TreeData* treeData, const string& targetsAsStr) {
 
-  size_t nFeatures = filterOutput.pValues.size();
+  if ( treeData->getFeatureIdx(targetsAsStr) != treeData->end() ) {
+    return( vector<size_t>(1,treeData->getFeatureIdx(targetsAsStr)) );
+  }
+
+  vector<size_t> targetIcs;
+
+  vector<string> items = utils::split(targetsAsStr,',');
+
+  for ( size_t i = 0; i < items.size(); ++i ) {
 
-  ofstream toAssociationFile(fileName.c_str());
+    size_t dashPos = items[i].find('-',1);
 
+    int first,last;
+    if ( treeData->getFeatureIdx(items[i]) == treeData->end() && dashPos != string::npos &&
+	 datadefs::isInteger(items[i].substr(0,dashPos),first) &&
+	 datadefs::isInteger(items[i].substr(dashPos+1),last) ) {
+
+      if ( first > last ) {
+	cerr << "Target range " << items[i] << " is empty!" << endl;
+	exit(1);
+      }
+
+      // Both ends of the range are validated like single indices
+      getTargetIdx(treeData,items[i].substr(0,dashPos));
+      getTargetIdx(treeData,items[i].substr(dashPos+1));
+
+      for ( int targetIdx = first; targetIdx <= last; ++targetIdx ) {
+	targetIcs.push_back( static_cast<size_t>(targetIdx) );
+      }
+
+    } else {
+      targetIcs.push_back( getTargetIdx(treeData,items[i]) );
+    }
+
+  }
+
+  return( targetIcs );
+
+}
+
+void writeFilterOutputHeader(ofstream& toAssociationFile) {
   toAssociationFile << "TARGET\tPREDICTOR\tP_VALUE\tIMPORTANCE\tCORRELATION\tN_SAMPLES" << endl;
+}
+
+void writeFilterOutput(RFACE::FilterOutput& filterOutput, ofstream& toAssociationFile) {
+
+  size_t nFeatures = filterOutput.pValues.size();
 
   for ( size_t i = 0; i < nFeatures; ++i ) {
 
@@ -286,8 +438,6 @@ void writeFilterOutputToFile(RFACE::FilterOutput& filterOutput, const string& fi
     
   }
   
-  toAssociationFile.close();
-  
 }
 
 
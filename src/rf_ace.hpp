@@ -16,6 +16,12 @@
 #include <string>
 #include <vector>
 
+#ifndef NOTHREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
 #include "stochasticforest.hpp"
 #include "treedata.hpp"
 #include "options.hpp"
@@ -156,7 +162,10 @@ public:
   void train(TreeData* trainData, 
 	     const size_t targetIdx, 
 	     const vector<num_t>& featureWeights, 
-	     ForestOptions* forestOptions) {
+	     ForestOptions* forestOptions,
+	     const string& checkpointFile = "",
+	     const bool resume = false,
+	     const bool evictTrees = false) {
     
     forestOptions->useContrasts = false;
 
@@ -172,7 +181,7 @@ public:
     trainedModel_ = new StochasticForest();
 
     if ( forestOptions->forestType == forest_t::RF || forestOptions->forestType == forest_t::QRF ) {
-      trainedModel_->learnRF(trainData,targetIdx,forestOptions,featureWeights,randoms_);
+      trainedModel_->learnRF(trainData,targetIdx,forestOptions,featureWeights,randoms_,checkpointFile,resume,evictTrees);
     } else if ( forestOptions->forestType == forest_t::GBT ) {
       trainedModel_->learnGBT(trainData,targetIdx,forestOptions,featureWeights,randoms_);
     } else {
@@ -181,12 +190,35 @@ public:
     }
   }
 
+  // Warm start: grows forestOptions->nTrees more trees into the loaded or trained model
+  void addTrees(TreeData* trainData,
+		const size_t targetIdx,
+		const vector<num_t>& featureWeights,
+		ForestOptions* forestOptions,
+		const string& checkpointFile = "",
+		const bool resume = false) {
+
+    forestOptions->useContrasts = false;
+
+    forestOptions->validate();
+
+    if ( !trainedModel_ ) {
+      cerr << "RFACE::addTrees() -- no model to add the trees to" << endl;
+      exit(1);
+    }
+
+    trainedModel_->addTreesRF(trainData,targetIdx,forestOptions,featureWeights,randoms_,checkpointFile,resume);
+
+  }
+
   FilterOutput filter(TreeData* filterData, 
 		      const size_t targetIdx, 
 		      const vector<num_t>& featureWeights, 
 		      ForestOptions* forestOptions,
 		      FilterOptions* filterOptions,
-		      const string& forestFile = "" ) {
+		      const string& forestFile = "",
+		      const string& partialFile = "",
+		      const bool evictTrees = false ) {
 
     forestOptions->useContrasts = true;
 
@@ -195,6 +227,8 @@ public:
 
     assert( forestOptions->useContrasts );
 
+    filterData->setNContrastSets(filterOptions->nContrastSets);
+
     if ( filterData->nSamples() < 2 * forestOptions->nodeSize ) {
       cerr << "Not enough samples (" << filterData->nSamples() << ") to perform a single split" << endl;
       exit(1);
@@ -205,145 +239,565 @@ public:
     vector<num_t> contrastImportanceSample;
     set<size_t> featuresInAllForests;
 
+    // Trees are evicted only into the forest file, and permutation importance
+    // is measured on the trees of the forest once it is grown
+    bool isEvicting = evictTrees && forestFile != "";
+    if ( isEvicting && filterOptions->permImportance ) {
+      cout << "WARNING: permutation importance keeps the trees of each forest in memory" << endl;
+      isEvicting = false;
+    }
+
     cout << endl << "Uncovering associations... " << flush;
-    executeRandomForest(filterData,targetIdx,featureWeights,forestOptions,filterOptions,filterOutput,forestFile);
+    executeRandomForest(filterData,targetIdx,featureWeights,forestOptions,filterOptions,filterOutput,forestFile,partialFile,isEvicting);
     cout << "DONE" << endl;
 
     return( filterOutput );
 
   }
 
+  // Statistics the filter collects over the permutations. The memory needed is
+  // linear in the number of features, regardless of the number of permutations
+  struct FilterStatistics {
+
+    // Importance of each feature over the permutations it took part in
+    vector<math::Moments> importanceMoments;
+
+    // Mean importance of each set of contrasts in each permutation, the sets
+    // of a permutation stored next to each other
+    size_t nContrastSets;
+    vector<num_t> contrastImportanceSample;
+
+    // Number of permutations each feature takes part in
+    vector<size_t> featurePermCounts;
+
+    FilterStatistics(const size_t nFeatures, const size_t nPerms, const size_t nContrastSets = 1):
+      importanceMoments(nFeatures),
+      nContrastSets(nContrastSets),
+      contrastImportanceSample(nPerms * nContrastSets,datadefs::NUM_NAN),
+      featurePermCounts(nFeatures,nPerms) {}
+
+    // Adds the importance values of a permutation; permutations are added in order
+    void add(const size_t permIdx, const vector<num_t>& importanceValues, const vector<num_t>& contrastImportanceValues) {
+
+      size_t nFeatures = importanceValues.size();
+
+      assert( contrastImportanceValues.size() == nContrastSets * nFeatures );
+
+      for ( size_t setIdx = 0; setIdx < nContrastSets; ++setIdx ) {
+	vector<num_t> setImportanceValues(contrastImportanceValues.begin() + setIdx * nFeatures,
+					  contrastImportanceValues.begin() + ( setIdx + 1 ) * nFeatures);
+	contrastImportanceSample[permIdx * nContrastSets + setIdx] = math::mean( utils::removeNANs( setImportanceValues ) );
+      }
+
+      for ( size_t featureIdx = 0; featureIdx < importanceValues.size(); ++featureIdx ) {
+	if ( permIdx < featurePermCounts[featureIdx] && !datadefs::isNAN(importanceValues[featureIdx]) ) {
+	  importanceMoments[featureIdx].add(importanceValues[featureIdx]);
+	}
+      }
+
+    }
+
+    size_t nPerms() const { return( contrastImportanceSample.size() / nContrastSets ); }
+
+    // Appends the statistics of the first nPerms permutations to a partial result file,
+    // which holds a header line, the contrast sample, and a line per feature. The header
+    // also holds the number of tests the threshold was split over in the run
+    void write(ofstream& toFile,
+	       const string& targetName,
+	       const vector<string>& featureNames,
+	       const string& statistic,
+	       const size_t nPerms,
+	       const size_t nLooks) const {
+
+      streamsize precision = toFile.precision(17);
+
+      toFile << "FILTER=,TARGET=\"" << targetName << "\",STATISTIC=" << statistic << ",NPERMS=" << nPerms
+	     << ",NLOOKS=" << nLooks << ",NCONTRASTSETS=" << nContrastSets << ",NFEATURES=" << featureNames.size() << endl;
+
+      toFile << "CONTRASTS";
+      for ( size_t i = 0; i < nPerms * nContrastSets; ++i ) {
+	if ( datadefs::isNAN(contrastImportanceSample[i]) ) {
+	  toFile << "\t" << datadefs::STR_NAN;
+	} else {
+	  toFile << "\t" << contrastImportanceSample[i];
+	}
+      }
+      toFile << endl;
+
+      for ( size_t featureIdx = 0; featureIdx < featureNames.size(); ++featureIdx ) {
+	const math::Moments& moments = importanceMoments[featureIdx];
+	toFile << featureNames[featureIdx] << "\t" << min(nPerms,featurePermCounts[featureIdx]) << "\t"
+	       << moments.n << "\t" << moments.mean << "\t" << moments.M2 << endl;
+      }
+
+      toFile.precision(precision);
+
+    }
+
+    // Reads the next statistics written with write(). Returns false at the end of the file
+    bool read(ifstream& fromFile,
+	      string& targetName,
+	      vector<string>& featureNames,
+	      string& statistic,
+	      size_t& nLooks) {
+
+      string newLine;
+
+      if ( !getline(fromFile,newLine) || utils::chomp(newLine) == "" ) {
+	return( false );
+      }
+
+      newLine = utils::chomp(newLine);
+
+      if ( newLine.compare(0,7,"FILTER=") != 0 ) {
+	cerr << "RFACE::FilterStatistics::read() -- expected a filter header, found '" << newLine << "'" << endl;
+	exit(1);
+      }
+
+      map<string,string> header = utils::parse(newLine,',','=','"');
+
+      targetName = header["TARGET"];
+      statistic = header["STATISTIC"];
+      size_t nPerms = utils::str2<size_t>(header["NPERMS"]);
+      nLooks = header.find("NLOOKS") != header.end() ? utils::str2<size_t>(header["NLOOKS"]) : 1;
+      nContrastSets = utils::str2<size_t>(header["NCONTRASTSETS"]);
+      size_t nFeatures = utils::str2<size_t>(header["NFEATURES"]);
+
+      getline(fromFile,newLine);
+      vector<string> contrastFields = utils::split(utils::chomp(newLine),'\t');
+
+      if ( contrastFields.size() != 1 + nPerms * nContrastSets || contrastFields[0] != "CONTRASTS" ) {
+	cerr << "RFACE::FilterStatistics::read() -- contrast sample of target '" << targetName << "' does not match the header" << endl;
+	exit(1);
+      }
+
+      contrastImportanceSample.resize(nPerms * nContrastSets);
+      for ( size_t i = 0; i < contrastImportanceSample.size(); ++i ) {
+	contrastImportanceSample[i] = utils::str2<num_t>(contrastFields[1 + i]);
+      }
+
+      featureNames.resize(nFeatures);
+      importanceMoments.assign(nFeatures,math::Moments());
+      featurePermCounts.resize(nFeatures);
+
+      for ( size_t featureIdx = 0; featureIdx < nFeatures; ++featureIdx ) {
+
+	getline(fromFile,newLine);
+	vector<string> fields = utils::split(utils::chomp(newLine),'\t');
+
+	if ( fields.size() != 5 ) {
+	  cerr << "RFACE::FilterStatistics::read() -- malformed feature line '" << newLine << "' for target '" << targetName << "'" << endl;
+	  exit(1);
+	}
+
+	featureNames[featureIdx] = fields[0];
+	featurePermCounts[featureIdx] = utils::str2<size_t>(fields[1]);
+	importanceMoments[featureIdx].n = utils::str2<size_t>(fields[2]);
+	importanceMoments[featureIdx].mean = utils::str2<double>(fields[3]);
+	importanceMoments[featureIdx].M2 = utils::str2<double>(fields[4]);
+      }
+
+      return( true );
+
+    }
+
+    // Moments of the contrast sample over the first nPerms permutations, for each nPerms
+    vector<math::Moments> contrastMoments(const size_t nPerms) const {
+
+      vector<math::Moments> moments(1);
+
+      for ( size_t permIdx = 0; permIdx < nPerms; ++permIdx ) {
+	moments.push_back(moments.back());
+	for ( size_t i = permIdx * nContrastSets; i < ( permIdx + 1 ) * nContrastSets; ++i ) {
+	  if ( !datadefs::isNAN(contrastImportanceSample[i]) ) {
+	    moments.back().add(contrastImportanceSample[i]);
+	  }
+	}
+      }
+
+      return( moments );
+
+    }
+
+  };
+
   void executeRandomForest(TreeData* filterData,
 			   const size_t targetIdx,
 			   const vector<num_t>& featureWeights,
 			   ForestOptions* forestOptions,
 			   FilterOptions* filterOptions,
 			   FilterOutput& filterOutput,
-			   const string& forestFile) {
+			   const string& forestFile,
+			   const string& partialFile,
+			   const bool evictTrees) {
     
-    vector<vector<num_t> >         importanceMat( filterOptions->nPerms, vector<num_t>(filterData->nFeatures()) );
-    vector<vector<num_t> > contrastImportanceMat( filterOptions->nPerms, vector<num_t>(filterData->nFeatures()) );
-
     size_t nFeatures = filterData->nFeatures();
 
+    // The importance values of each permutation are folded into running moments as
+    // they arrive, instead of storing them for all permutations
+    FilterStatistics filterStatistics(nFeatures,filterOptions->nPerms,filterData->nContrastSets());
+
     filterOutput.targetName = filterData->feature(targetIdx)->name();
-    filterOutput.pValues.resize(nFeatures,1.0);
-    filterOutput.importances.resize(nFeatures);
-    filterOutput.sampleCounts.resize(nFeatures);
-    filterOutput.correlations.resize(nFeatures);
-    filterOutput.featureNames.resize(nFeatures);
 
     Progress progress;
-    vector<num_t> contrastImportanceSample(filterOptions->nPerms);
 
-    ftable_t frequency;
+    // With adaptive permutations the features are tested after every batch, and the
+    // features already decided get no weight in the forests of the later batches.
+    // Leaving features out changes the importance of the contrasts, so each feature
+    // is tested against the permutations it took part in
+    vector<num_t> batchFeatureWeights = featureWeights;
+    size_t permBatch = filterOptions->permBatch > 0 ? filterOptions->permBatch : filterOptions->nPerms;
+    size_t nLooks = ( filterOptions->nPerms + permBatch - 1 ) / permBatch;
+    size_t nPerms = 0;
+
+    while ( nPerms < filterOptions->nPerms ) {
+
+      size_t permEnd = min(nPerms + permBatch,filterOptions->nPerms);
+
+      this->growPermutations(filterData,targetIdx,batchFeatureWeights,forestOptions,filterOptions,
+			     filterStatistics,nPerms,permEnd,forestFile,evictTrees,progress);
+
+      nPerms = permEnd;
+
+      if ( nPerms == filterOptions->nPerms ||
+	   this->settleFeatures(filterStatistics,nPerms,nLooks,filterOptions,batchFeatureWeights) == 0 ) {
+	break;
+      }
 
-    ofstream toFile;
-    if ( forestFile != "" ) {
-      toFile.open(forestFile.c_str());
-      toFile.close();
     }
 
-    for(size_t permIdx = 0; permIdx < filterOptions->nPerms; ++permIdx) {
+    vector<string> featureNames(nFeatures);
+    for ( size_t featureIdx = 0; featureIdx < nFeatures; ++featureIdx ) {
+      featureNames[featureIdx] = filterData->feature(featureIdx)->name();
+    }
 
-      filterData->permuteContrasts(&randoms_[0]);
+    // A partial run leaves the final test to the merge of all partial results
+    if ( partialFile != "" ) {
+      ofstream toFile(partialFile.c_str(),ios::app);
+      filterStatistics.write(toFile,filterOutput.targetName,featureNames,this->filterStatistic(filterOptions),nPerms,nLooks);
+    }
 
-      progress.update(1.0*permIdx/filterOptions->nPerms);
+    vector<math::Moments> contrastMoments = filterStatistics.contrastMoments(nPerms);
 
-      StochasticForest SF;
+    vector<math::Moments> featureContrastMoments(nFeatures);
+    for ( size_t featureIdx = 0; featureIdx < nFeatures; ++featureIdx ) {
+      featureContrastMoments[featureIdx] = contrastMoments[ min(nPerms,filterStatistics.featurePermCounts[featureIdx]) ];
+    }
 
-      SF.learnRF(filterData,targetIdx,forestOptions,featureWeights,randoms_);
+    // With adaptive permutations the final test is one of the nLooks tests, and
+    // gets the same share of the threshold as the others
+    FilterOptions testOptions = *filterOptions;
+    testOptions.pValueThreshold /= nLooks;
+
+    this->scoreFeatures(featureNames,filterStatistics.importanceMoments,featureContrastMoments,
+			contrastMoments[nPerms].n,&testOptions,filterOutput);
+
+  }
+
+  // Tests the features of every target in the partial result files, with the statistics
+  // of a target merged over all its partial results. The targets are returned in the
+  // order in which they first appear
+  vector<FilterOutput> mergeFilterPartials(const vector<string>& fileNames,
+					   const FilterOptions* filterOptions) {
+
+    vector<string> targetNames;
+    unordered_map<string,size_t> target2idx;
+    vector<vector<string> > targetFeatureNames;
+    vector<string> targetStatistics;
+    vector<vector<math::Moments> > targetImportanceMoments;
+    vector<vector<math::Moments> > targetContrastMoments;
+    vector<size_t> targetContrastSampleSizes;
+    vector<size_t> targetNTests;
+
+    for ( size_t fileIdx = 0; fileIdx < fileNames.size(); ++fileIdx ) {
+
+      ifstream fromFile(fileNames[fileIdx].c_str());
+
+      if ( !fromFile.good() ) {
+	cerr << "RFACE::mergeFilterPartials() -- could not open partial result file '" << fileNames[fileIdx] << "'" << endl;
+	exit(1);
+      }
+
+      FilterStatistics partial(0,0);
+      string targetName,statistic;
+      vector<string> featureNames;
+      size_t nLooks;
+
+      while ( partial.read(fromFile,targetName,featureNames,statistic,nLooks) ) {
+
+	if ( target2idx.find(targetName) == target2idx.end() ) {
+	  target2idx[targetName] = targetNames.size();
+	  targetNames.push_back(targetName);
+	  targetFeatureNames.push_back(featureNames);
+	  targetStatistics.push_back(statistic);
+	  targetImportanceMoments.push_back(vector<math::Moments>(featureNames.size()));
+	  targetContrastMoments.push_back(vector<math::Moments>(featureNames.size()));
+	  targetContrastSampleSizes.push_back(0);
+	  targetNTests.push_back(1);
+	}
+
+	size_t targetIdx = target2idx[targetName];
+
+	if ( featureNames != targetFeatureNames[targetIdx] || statistic != targetStatistics[targetIdx] ) {
+	  cerr << "RFACE::mergeFilterPartials() -- partial results of target '" << targetName
+	       << "' in file '" << fileNames[fileIdx] << "' have different features or importance statistic" << endl;
+	  exit(1);
+	}
+
+	size_t nPerms = partial.nPerms();
+	vector<math::Moments> contrastMoments = partial.contrastMoments(nPerms);
+
+	for ( size_t featureIdx = 0; featureIdx < featureNames.size(); ++featureIdx ) {
+	  targetImportanceMoments[targetIdx][featureIdx].merge(partial.importanceMoments[featureIdx]);
+	  targetContrastMoments[targetIdx][featureIdx].merge(contrastMoments[ min(nPerms,partial.featurePermCounts[featureIdx]) ]);
+	}
+
+	targetContrastSampleSizes[targetIdx] += contrastMoments[nPerms].n;
+
+	// Features may have been settled at each early look of each partial run, so the
+	// threshold is split over those looks and the final test of the merge
+	targetNTests[targetIdx] += nLooks - 1;
 
-      if ( forestFile != "" ) {
-	//ofstream toFile;
-	toFile.open(forestFile.c_str(),ios::app);
-	SF.writeForest(toFile);
-	toFile.close();
       }
 
-      SF.getMDI(filterData,importanceMat[permIdx],contrastImportanceMat[permIdx]);
+    }
+
+    vector<FilterOutput> filterOutputs(targetNames.size());
+
+    for ( size_t targetIdx = 0; targetIdx < targetNames.size(); ++targetIdx ) {
+
+      // The direction of the test follows the statistic the partial results were collected with
+      FilterOptions mergeOptions = *filterOptions;
+      mergeOptions.permImportance = targetStatistics[targetIdx] == "PERMIMPORTANCE";
+      mergeOptions.minDepth = targetStatistics[targetIdx] == "MINDEPTH";
+      mergeOptions.pValueThreshold /= targetNTests[targetIdx];
+
+      filterOutputs[targetIdx].targetName = targetNames[targetIdx];
 
-      // Store the new percentile value in the vector contrastImportanceSample
-      contrastImportanceSample[permIdx] = math::mean( utils::removeNANs( contrastImportanceMat[permIdx] ) );
+      this->scoreFeatures(targetFeatureNames[targetIdx],targetImportanceMoments[targetIdx],targetContrastMoments[targetIdx],
+			  targetContrastSampleSizes[targetIdx],&mergeOptions,filterOutputs[targetIdx]);
 
     }
 
-    contrastImportanceSample = utils::removeNANs( contrastImportanceSample );
+    return( filterOutputs );
 
-    //assert( !datadefs::containsNAN(contrastImportanceSample) );
+  }
+
+  // Tests each feature against the contrast moments of its own, and collects the
+  // features passing the threshold into the filter output, sorted by p-value
+  void scoreFeatures(const vector<string>& featureNames,
+		     const vector<math::Moments>& importanceMoments,
+		     const vector<math::Moments>& contrastMoments,
+		     const size_t nContrastSamples,
+		     const FilterOptions* filterOptions,
+		     FilterOutput& filterOutput) {
+
+    size_t nFeatures = featureNames.size();
 
     // Notify if the sample size of the null distribution is very low
-    if ( filterOptions->nPerms > 1 && contrastImportanceSample.size() < 5 ) {
-      cerr << " WARNING: Too few samples drawn ( " << contrastImportanceSample.size()
+    if ( filterOptions->nPerms > 1 && nContrastSamples < 5 ) {
+      cerr << " WARNING: Too few samples drawn ( " << nContrastSamples
 	   << " < 5 ) from the null distribution. Consider adding more permutations. Quitting..."
 	   << endl;
       exit(1);
     }
     
-    // Loop through each feature and calculate p-value for each
-    for ( size_t featureIdx = 0; featureIdx < filterData->nFeatures(); ++featureIdx ) {
+    // Loop through each feature and calculate p-value for each. Only the features
+    // passing the threshold are kept, so that only they need to be sorted
+    for ( size_t featureIdx = 0; featureIdx < nFeatures; ++featureIdx ) {
 
-      vector<num_t> featureImportanceSample(filterOptions->nPerms);
-      
-      // Extract the sample for the real feature
-      for ( size_t permIdx = 0; permIdx < filterOptions->nPerms; ++permIdx ) {
-	featureImportanceSample[permIdx] = importanceMat[permIdx][featureIdx];
-      }
-      
-      featureImportanceSample = utils::removeNANs(featureImportanceSample);
-      
-      assert( !datadefs::containsNAN(featureImportanceSample) );
-      
-      // If sample size is too small, assign p-value to 1.0
-      if ( featureImportanceSample.size() < 5 ) {
-	
-	filterOutput.pValues[featureIdx] = 1.0;
-	
-      } else {
-	
-	// Perform WS-approximated t-test against the contrast sample
-	bool WS = true;
-	filterOutput.pValues[featureIdx] = math::ttest(featureImportanceSample,contrastImportanceSample,WS);
-	
-	// If for some reason the t-test returns NAN, turn that into 1.0
-	// NOTE: 1.0 is better number than NAN when sorting
-	if ( datadefs::isNAN( filterOutput.pValues[featureIdx] ) ) {
-	  filterOutput.pValues[featureIdx] = 1.0;
-	}
+      num_t pValue = this->featurePValue(importanceMoments[featureIdx],contrastMoments[featureIdx],filterOptions);
+
+      if ( pValue > filterOptions->pValueThreshold ) {
+	continue;
       }
-      
-      // Calculate mean importace score from the sample
-      filterOutput.importances[featureIdx] = math::mean(featureImportanceSample);
-      filterOutput.correlations[featureIdx] = datadefs::NUM_NAN; //filterData->pearsonCorrelation(targetIdx,featureIdx);
-      filterOutput.sampleCounts[featureIdx] = datadefs::NUM_NAN; //filterData->nRealSamples(targetIdx,featureIdx);
-      filterOutput.featureNames[featureIdx] = filterData->feature(featureIdx)->name();
+
+      filterOutput.pValues.push_back(pValue);
+
+      // Mean importace score from the sample
+      filterOutput.importances.push_back( importanceMoments[featureIdx].n > 0 ? importanceMoments[featureIdx].mean : datadefs::NUM_NAN );
+      filterOutput.correlations.push_back( datadefs::NUM_NAN ); //filterData->pearsonCorrelation(targetIdx,featureIdx);
+      filterOutput.sampleCounts.push_back( datadefs::NUM_NAN ); //filterData->nRealSamples(targetIdx,featureIdx);
+      filterOutput.featureNames.push_back( featureNames[featureIdx] );
     }
     
     sortFilterOutput(&filterOutput);
     
-    size_t nSelectedFeatures = 0;
+    filterOutput.nAllFeatures = nFeatures - 1;
+    filterOutput.nSignificantFeatures = filterOutput.pValues.size();
+
+  }
+
+  // Name of the importance statistic the filter collects
+  string filterStatistic(const FilterOptions* filterOptions) const {
+    if ( filterOptions->permImportance ) {
+      return( "PERMIMPORTANCE" );
+    } else if ( filterOptions->minDepth ) {
+      return( "MINDEPTH" );
+    }
+    return( "MDI" );
+  }
+
+  // Grows, writes and scores the forests of permutations permBegin ... permEnd - 1
+  void growPermutations(TreeData* filterData,
+			const size_t targetIdx,
+			const vector<num_t>& featureWeights,
+			ForestOptions* forestOptions,
+			FilterOptions* filterOptions,
+			FilterStatistics& filterStatistics,
+			const size_t permBegin,
+			const size_t permEnd,
+			const string& forestFile,
+			const bool evictTrees,
+			Progress& progress) {
+
+    size_t nThreads = randoms_.size();
+
+    // With more than one thread the forests of consecutive permutations are grown
+    // in a pipeline, so that the threads do not idle while a forest is scored and
+    // written. Early stopping decides the size of a forest only after growing it,
+    // which rules out scheduling its trees ahead, and the permutations are then
+    // processed one at a time
+    if ( nThreads > 1 && forestOptions->oobTolerance == 0.0 ) {
+
+#ifndef NOTHREADS
+      this->pipelinePermutations(filterData,targetIdx,featureWeights,forestOptions,filterOptions,
+				 filterStatistics,permBegin,permEnd,forestFile,evictTrees,progress);
+#endif
+
+      return;
+
+    } 
+
+    // The forests are appended to the file, so that one file can collect the forests of many targets
+    ofstream toFile;
+
+    // The forest is regrown for every permutation, so the trees reuse their storage.
+    // Evicted trees are appended to the file one at a time as they are grown
+    StochasticForest SF;
+
+    if ( evictTrees ) {
+      toFile.open(forestFile.c_str(),ios::app);
+      SF.setTreeStream(&toFile,true);
+    }
+
+    vector<num_t> importanceValues,contrastImportanceValues;
+
+    for(size_t permIdx = permBegin; permIdx < permEnd; ++permIdx) {
+
+      filterData->permuteContrasts(&randoms_[0]);
+
+      progress.update(1.0*permIdx/filterOptions->nPerms);
+
+      SF.learnRF(filterData,targetIdx,forestOptions,featureWeights,randoms_);
+
+      if ( forestFile != "" && !evictTrees ) {
+	toFile.open(forestFile.c_str(),ios::app);
+	SF.writeForest(toFile);
+	toFile.close();
+      }
+
+      if ( filterOptions->permImportance ) {
+	SF.getImportanceValues(filterData,importanceValues,contrastImportanceValues,randoms_);
+      } else if ( filterOptions->minDepth ) {
+	SF.getMeanMinimalDepthValues(filterData,importanceValues,contrastImportanceValues);
+      } else {
+	SF.getMDI(filterData,importanceValues,contrastImportanceValues);
+      }
+
+      filterStatistics.add(permIdx,importanceValues,contrastImportanceValues);
+
+    }
+
+  }
+
+  // P-value of the feature against the contrasts, from the moments of the importance samples
+  num_t featurePValue(const math::Moments& importanceMoments,
+		      const math::Moments& contrastMoments,
+		      const FilterOptions* filterOptions) {
+
+    // If sample size is too small, assign p-value to 1.0
+    if ( importanceMoments.n < 5 ) {
+      return( 1.0 );
+    }
 
-    for ( size_t i = 0; i < nFeatures; ++i ) {
+    // Perform WS-approximated t-test against the contrast sample. Shallow
+    // splitters are the important ones, so minimal depth is tested the other way
+    bool WS = true;
+    num_t pValue;
+    if ( filterOptions->minDepth ) {
+      pValue = math::ttest(contrastMoments,importanceMoments,WS);
+    } else {
+      pValue = math::ttest(importanceMoments,contrastMoments,WS);
+    }
+
+    // If for some reason the t-test returns NAN, turn that into 1.0
+    // NOTE: 1.0 is better number than NAN when sorting
+    if ( datadefs::isNAN( pValue ) ) {
+      pValue = 1.0;
+    }
+
+    return( pValue );
 
-      if ( filterOutput.pValues[i] > filterOptions->pValueThreshold ) {
+  }
+
+  // Tests the undecided features, i.e. the ones with weight, after nPerms out of
+  // filterOptions->nPerms permutations, and zeroes the weights of the features
+  // whose decision is settled. The p-value threshold is spent evenly over the
+  // nLooks tests, the final one included, so a feature is settled significant
+  // once its p-value falls below threshold / nLooks. A feature is settled null once its conditional
+  // power, the chance of reaching the threshold at the end if its current trend
+  // continues, falls below the threshold as well, or once it can no longer
+  // collect the 5 samples needed for a test. The number of permutations a settled
+  // feature took part in is stored in the filter statistics. Returns the number of
+  // undecided features
+  size_t settleFeatures(FilterStatistics& filterStatistics,
+			const size_t nPerms,
+			const size_t nLooks,
+			const FilterOptions* filterOptions,
+			vector<num_t>& featureWeights) {
+
+    math::Moments contrastMoments = filterStatistics.contrastMoments(nPerms)[nPerms];
+
+    size_t nRemainingPerms = filterOptions->nPerms - nPerms;
+    num_t alpha = filterOptions->pValueThreshold;
+
+    // With the trend continuing over the remaining permutations, the final z-score
+    // is the current one scaled by 1 / sqrt(t), where t is the fraction done
+    num_t t = 1.0 * nPerms / filterOptions->nPerms;
+    num_t zNull = math::normalQuantile(1.0 - alpha) * sqrt(t) * ( 1.0 - sqrt(1.0 - t) );
+
+    size_t nUndecided = 0;
+
+    for ( size_t featureIdx = 0; featureIdx < featureWeights.size(); ++featureIdx ) {
+
+      if ( featureWeights[featureIdx] <= 0.0 ) {
 	continue;
       }
 
-      filterOutput.pValues[nSelectedFeatures] = filterOutput.pValues[i];
-      filterOutput.importances[nSelectedFeatures] = filterOutput.importances[i];
-      filterOutput.correlations[nSelectedFeatures] = filterOutput.correlations[i];
-      filterOutput.sampleCounts[nSelectedFeatures] = filterOutput.sampleCounts[i];
-      filterOutput.featureNames[nSelectedFeatures] = filterOutput.featureNames[i];
-      ++nSelectedFeatures;
+      const math::Moments& importanceMoments = filterStatistics.importanceMoments[featureIdx];
+      num_t pValue = this->featurePValue(importanceMoments,contrastMoments,filterOptions);
+
+      bool isSettled;
+
+      if ( importanceMoments.n + nRemainingPerms < 5 ) {
+	isSettled = true;
+      } else if ( importanceMoments.n < 5 || contrastMoments.n < 5 ) {
+	isSettled = false;
+      } else {
+	isSettled = pValue <= alpha / nLooks || pValue >= 1.0 || math::normalQuantile(1.0 - pValue) < zNull;
+      }
+
+      if ( isSettled ) {
+	featureWeights[featureIdx] = 0.0;
+	filterStatistics.featurePermCounts[featureIdx] = nPerms;
+      } else {
+	++nUndecided;
+      }
+
     }
 
-    filterOutput.nAllFeatures = nFeatures - 1;
-    filterOutput.nSignificantFeatures = nSelectedFeatures;
-    filterOutput.pValues.resize(nSelectedFeatures);
-    filterOutput.importances.resize(nSelectedFeatures);
-    filterOutput.correlations.resize(nSelectedFeatures);
-    filterOutput.sampleCounts.resize(nSelectedFeatures);
-    filterOutput.featureNames.resize(nSelectedFeatures);
+    return( nUndecided );
 
   }
 
@@ -365,6 +819,12 @@ public:
 
     assert(trainedModel_);
 
+    // Evicted trees are read back one at a time from the file they were written to
+    if ( trainedModel_->hasEvictedTrees() ) {
+      cerr << "RFACE::test() -- the trees were freed once written to file; predict from the forest file instead" << endl;
+      exit(1);
+    }
+
     TestOutput testOutput;
 
     size_t targetIdx = testData->getFeatureIdx(trainedModel_->getTargetName());
@@ -408,6 +868,11 @@ public:
     
     assert(trainedModel_);
     
+    if ( trainedModel_->hasEvictedTrees() ) {
+      cerr << "RFACE::predictQRF() -- the trees were freed once written to file; predict from the forest file instead" << endl;
+      exit(1);
+    }
+
     QRFPredictionOutput qPredOut;
     
     qPredOut.targetName = trainedModel_->getTargetName();
@@ -445,6 +910,24 @@ public:
     
   }
   
+  // Out-of-bag error of the trained model, computed during training
+  num_t getOobError() {
+    assert( trainedModel_ );
+    return( trainedModel_->getOobError() );
+  }
+
+  // Number of trees in the model, which may be fewer than requested if training stopped early
+  size_t nTrees() {
+    assert( trainedModel_ );
+    return( trainedModel_->nTrees() );
+  }
+
+  // Whether the trees of the model live only in the file they were written to during training
+  bool hasEvictedTrees() {
+    assert( trainedModel_ );
+    return( trainedModel_->hasEvictedTrees() );
+  }
+
   void load(const string& fileName) {
     
     if ( trainedModel_ ) {
@@ -456,6 +939,11 @@ public:
     trainedModel_->loadForest(fileName);
   }
 
+  // Merges forests trained independently on the same data into one forest file
+  size_t mergeForests(const vector<string>& forestFiles, const string& mergedForestFile) {
+    return( StochasticForest::mergeForestFiles(forestFiles,mergedForestFile) );
+  }
+
   QRFPredictionOutput loadForestAndPredictQRF(const string& forestFile, TreeData* testData, const ForestOptions& forestOptions) {
     
     QRFPredictionOutput qPredOut;
@@ -485,29 +973,29 @@ public:
 	
 	for ( size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx ) {
 	  
-	  vector<num_t> treeData = rootNode.getChildLeafNumTrainData(testData,sampleIdx);
-	  size_t nSamplesInTreeData = treeData.size();
+	  size_t nodeIdx = rootNode.percolate(testData,sampleIdx);
+	  size_t nSamplesInTreeData = rootNode.nTrainSamples(nodeIdx);
 	  
 	  // Extend the distribution container by the number of new samples
 	  qPredOut.numDistributions[sampleIdx].resize(treeIdx*forestOptions.nSamplesForQuantiles,datadefs::NUM_NAN);
 	  
 	  // Get the new samples
 	  for ( size_t i = 0; i < forestOptions.nSamplesForQuantiles; ++i ) {
-	    qPredOut.numDistributions[sampleIdx][ (treeIdx-1) * forestOptions.nSamplesForQuantiles + i ] = treeData[ randoms_[0].integer() % nSamplesInTreeData ];
+	    qPredOut.numDistributions[sampleIdx][ (treeIdx-1) * forestOptions.nSamplesForQuantiles + i ] = rootNode.getNumTrainData(nodeIdx, randoms_[0].integer() % nSamplesInTreeData );
 	  }
 	}
       } else {
 	for ( size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx ) {
 
-          vector<cat_t> treeData = rootNode.getChildLeafCatTrainData(testData,sampleIdx);
-          size_t nSamplesInTreeData = treeData.size();
+          size_t nodeIdx = rootNode.percolate(testData,sampleIdx);
+          size_t nSamplesInTreeData = rootNode.nTrainSamples(nodeIdx);
 
           // Extend the distribution container by the number of new samples
           qPredOut.catDistributions[sampleIdx].resize(treeIdx*forestOptions.nSamplesForQuantiles,datadefs::STR_NAN);
 
           // Get the new samples
           for ( size_t i = 0; i < forestOptions.nSamplesForQuantiles; ++i ) {
-            qPredOut.catDistributions[sampleIdx][ (treeIdx-1) * forestOptions.nSamplesForQuantiles + i ] = treeData[ randoms_[0].integer() % nSamplesInTreeData ];
+            qPredOut.catDistributions[sampleIdx][ (treeIdx-1) * forestOptions.nSamplesForQuantiles + i ] = rootNode.getCatTrainData(nodeIdx, randoms_[0].integer() % nSamplesInTreeData );
           }
         }
 
@@ -544,13 +1032,15 @@ public:
 
   }
 
-  void save(const string& fileName) {
+  // With firstTreeIdx > 0 only the trees from it on are written, appended to a
+  // file that already holds the trees before them
+  void save(const string& fileName, const size_t firstTreeIdx = 0) {
 
     assert(trainedModel_);
     
-    ofstream toFile(fileName);
+    ofstream toFile(fileName.c_str(), firstTreeIdx > 0 ? ios::app : ios::out);
 
-    trainedModel_->writeForest( toFile );
+    trainedModel_->writeForest( toFile, firstTreeIdx );
 
   }
 
@@ -579,6 +1069,256 @@ public:
 
 private:
 
+#ifndef NOTHREADS
+
+  // State shared by the threads of the filter pipeline. Permutation permIdx is grown in
+  // slot ( permIdx - permBegin ) % nSlots, and a slot is taken by a new permutation only after the
+  // previous permutation in it has been written
+  struct FilterPipeline {
+
+    TreeData* filterData;
+    size_t targetIdx;
+    const vector<num_t>* featureWeights;
+    const ForestOptions* forestOptions;
+    const FilterOptions* filterOptions;
+    string forestFile;
+
+    // With eviction each slot appends the trees of its forest in order to a file of
+    // its own as they are grown, and the file is moved to the forest file when the
+    // forest is written. The forest file is then the same for any number of threads
+    bool evictTrees;
+    vector<string> slotTreeFiles;
+    vector<ofstream> slotTreeStreams;
+
+    FilterStatistics* filterStatistics;
+    Progress* progress;
+
+    // Range of permutations to grow
+    size_t permBegin;
+    size_t permEnd;
+
+    // Each slot holds its own permutation of the contrasts and the forest grown on it
+    vector<TreeData*> slotData;
+    vector<StochasticForest> slotForests;
+    vector<size_t> slotPermIcs;
+    vector<size_t> slotPermutationSeeds;
+    vector<vector<num_t> > slotImportanceValues;
+    vector<vector<num_t> > slotContrastImportanceValues;
+    vector<bool> isSlotReady;
+    vector<size_t> nSlotWorkersDone;
+
+    // Permutations set up and written so far, and whether one is being set up
+    size_t nStartedPerms;
+    size_t nFinishedPerms;
+    bool isPreparing;
+
+    mutex lock;
+    condition_variable isChanged;
+
+  };
+
+  void pipelinePermutations(TreeData* filterData,
+			    const size_t targetIdx,
+			    const vector<num_t>& featureWeights,
+			    const ForestOptions* forestOptions,
+			    const FilterOptions* filterOptions,
+			    FilterStatistics& filterStatistics,
+			    const size_t permBegin,
+			    const size_t permEnd,
+			    const string& forestFile,
+			    const bool evictTrees,
+			    Progress& progress) {
+
+    size_t nThreads = randoms_.size();
+
+    FilterPipeline pipeline;
+
+    pipeline.filterData = filterData;
+    pipeline.targetIdx = targetIdx;
+    pipeline.featureWeights = &featureWeights;
+    pipeline.forestOptions = forestOptions;
+    pipeline.filterOptions = filterOptions;
+    pipeline.forestFile = forestFile;
+    pipeline.evictTrees = evictTrees;
+    pipeline.filterStatistics = &filterStatistics;
+    pipeline.progress = &progress;
+    pipeline.permBegin = permBegin;
+    pipeline.permEnd = permEnd;
+
+    // Two slots let the next permutation start while the previous one is finishing.
+    // The first slot works on the filter data itself, the others on copies of it
+    size_t nSlots = min(static_cast<size_t>(2),permEnd - permBegin);
+
+    pipeline.slotData.resize(nSlots,filterData);
+    for ( size_t slotIdx = 1; slotIdx < nSlots; ++slotIdx ) {
+      pipeline.slotData[slotIdx] = filterData->clone();
+    }
+
+    // Forests are not copyable, so the slots are constructed in place
+    vector<StochasticForest>(nSlots).swap(pipeline.slotForests);
+
+    if ( evictTrees ) {
+      vector<ofstream>(nSlots).swap(pipeline.slotTreeStreams);
+      for ( size_t slotIdx = 0; slotIdx < nSlots; ++slotIdx ) {
+	pipeline.slotTreeFiles.push_back(forestFile + ".slot" + utils::num2str(slotIdx));
+	pipeline.slotTreeStreams[slotIdx].open(pipeline.slotTreeFiles[slotIdx].c_str());
+	pipeline.slotForests[slotIdx].setTreeStream(&pipeline.slotTreeStreams[slotIdx],true,true);
+      }
+    }
+    pipeline.slotPermIcs.resize(nSlots,permEnd);
+    pipeline.slotPermutationSeeds.resize(nSlots,0);
+    pipeline.slotImportanceValues.resize(nSlots);
+    pipeline.slotContrastImportanceValues.resize(nSlots);
+    pipeline.isSlotReady.resize(nSlots,false);
+    pipeline.nSlotWorkersDone.resize(nSlots,0);
+
+    pipeline.nStartedPerms = permBegin;
+    pipeline.nFinishedPerms = permBegin;
+    pipeline.isPreparing = false;
+
+    vector<thread> threads;
+
+    for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+      threads.push_back(thread(&RFACE::pipelineWorker, this, &pipeline, threadIdx));
+    }
+
+    for ( size_t threadIdx = 0; threadIdx < threads.size(); ++threadIdx ) {
+      threads[threadIdx].join();
+    }
+
+    for ( size_t slotIdx = 1; slotIdx < nSlots; ++slotIdx ) {
+      delete pipeline.slotData[slotIdx];
+    }
+
+    for ( size_t slotIdx = 0; slotIdx < pipeline.slotTreeFiles.size(); ++slotIdx ) {
+      pipeline.slotTreeStreams[slotIdx].close();
+      remove(pipeline.slotTreeFiles[slotIdx].c_str());
+    }
+
+  }
+
+  // Goes through the permutations in order, growing every nThreads'th tree of each
+  // from the worker's index on. The first worker to reach a permutation sets it up,
+  // and the last worker to finish its trees scores and writes the forest. A fixed
+  // division of the trees keeps the merged statistics independent of the timing of
+  // the threads, the random numbers are drawn in the same order as in the sequential
+  // filter, and the forests are written and added to the statistics in order
+  void pipelineWorker(FilterPipeline* pipeline, const size_t workerIdx) {
+
+    size_t nPerms = pipeline->filterOptions->nPerms;
+    size_t nTrees = pipeline->forestOptions->nTrees;
+    size_t nSlots = pipeline->slotData.size();
+    size_t nWorkers = randoms_.size();
+
+    unique_lock<mutex> lock(pipeline->lock);
+
+    for ( size_t permIdx = pipeline->permBegin; permIdx < pipeline->permEnd; ++permIdx ) {
+
+      size_t slotIdx = ( permIdx - pipeline->permBegin ) % nSlots;
+
+      TreeData* slotData = pipeline->slotData[slotIdx];
+      StochasticForest& SF = pipeline->slotForests[slotIdx];
+
+      // Wait until the permutation is set up, or it is the worker's turn to set it up
+      while ( !( pipeline->slotPermIcs[slotIdx] == permIdx && pipeline->isSlotReady[slotIdx] ) ) {
+
+	if ( pipeline->nStartedPerms == permIdx && !pipeline->isPreparing && permIdx < pipeline->nFinishedPerms + nSlots ) {
+
+	  ++pipeline->nStartedPerms;
+	  pipeline->isPreparing = true;
+	  pipeline->slotPermIcs[slotIdx] = permIdx;
+	  pipeline->isSlotReady[slotIdx] = false;
+	  pipeline->nSlotWorkersDone[slotIdx] = 0;
+
+	  lock.unlock();
+
+	  slotData->permuteContrasts(&randoms_[0]);
+
+	  size_t forestSeed = randoms_[0].integer();
+
+	  pipeline->slotPermutationSeeds[slotIdx] = pipeline->filterOptions->permImportance ? randoms_[0].integer() : 0;
+
+	  SF.beginRF(slotData,pipeline->targetIdx,pipeline->forestOptions,*pipeline->featureWeights,forestSeed,nWorkers);
+
+	  lock.lock();
+
+	  pipeline->isPreparing = false;
+	  pipeline->isSlotReady[slotIdx] = true;
+	  pipeline->isChanged.notify_all();
+
+	} else {
+	  pipeline->isChanged.wait(lock);
+	}
+
+      }
+
+      lock.unlock();
+
+      for ( size_t treeIdx = workerIdx; treeIdx < nTrees; treeIdx += nWorkers ) {
+	SF.growTree(treeIdx,workerIdx);
+      }
+
+      lock.lock();
+
+      if ( ++pipeline->nSlotWorkersDone[slotIdx] < nWorkers ) {
+	continue;
+      }
+
+      lock.unlock();
+
+      SF.endRF(nTrees);
+
+      vector<num_t>& importanceValues = pipeline->slotImportanceValues[slotIdx];
+      vector<num_t>& contrastImportanceValues = pipeline->slotContrastImportanceValues[slotIdx];
+
+      if ( pipeline->filterOptions->permImportance ) {
+	SF.getImportanceValues(slotData,importanceValues,contrastImportanceValues,pipeline->slotPermutationSeeds[slotIdx],1);
+      } else if ( pipeline->filterOptions->minDepth ) {
+	SF.getMeanMinimalDepthValues(slotData,importanceValues,contrastImportanceValues);
+      } else {
+	SF.getMDI(slotData,importanceValues,contrastImportanceValues);
+      }
+
+      lock.lock();
+
+      while ( pipeline->nFinishedPerms < permIdx ) {
+	pipeline->isChanged.wait(lock);
+      }
+
+      lock.unlock();
+
+      pipeline->filterStatistics->add(permIdx,importanceValues,contrastImportanceValues);
+
+      if ( pipeline->evictTrees ) {
+
+	// The slot is taken by the next permutation only after this one is written,
+	// so its file is emptied for the next forest
+	ofstream& slotTreeStream = pipeline->slotTreeStreams[slotIdx];
+	slotTreeStream.close();
+
+	ifstream fromFile(pipeline->slotTreeFiles[slotIdx].c_str());
+	ofstream toFile(pipeline->forestFile.c_str(),ios::app);
+	toFile << fromFile.rdbuf();
+
+	slotTreeStream.open(pipeline->slotTreeFiles[slotIdx].c_str());
+
+      } else if ( pipeline->forestFile != "" ) {
+	ofstream toFile(pipeline->forestFile.c_str(),ios::app);
+	SF.writeForest(toFile);
+      }
+
+      lock.lock();
+
+      ++pipeline->nFinishedPerms;
+      pipeline->progress->update(1.0*pipeline->nFinishedPerms/nPerms);
+      pipeline->isChanged.notify_all();
+
+    }
+
+  }
+
+#endif
+
   vector<distributions::Random> randoms_;
 
   StochasticForest* trainedModel_;
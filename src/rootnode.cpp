@@ -1,30 +1,51 @@
 #include <string>
 #include <cmath>
 #include <stack>
+#include <cassert>
 #include <unordered_set>
 #include "math.hpp"
 #include "rootnode.hpp"
 #include "datadefs.hpp"
+#include "utils.hpp"
 
 using datadefs::forest_t;
 
-RootNode::RootNode() {}
+const uint32_t RootNode::NO_CHILD;
+const uint32_t RootNode::NO_SPLITTER;
+
+RootNode::RootNode():
+  forestType_(forest_t::RF),
+  isTargetNumerical_(true),
+  hasOrigin_(false),
+  treeIdx_(0),
+  forestSeed_(0),
+  nLeaves_(0),
+  nOobSamples_(0) {
+
+  this->reset();
+
+}
 
 RootNode::RootNode(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random):
   forestType_(forestOptions->forestType),
   targetName_(trainData->feature(targetIdx)->name()),
   isTargetNumerical_(trainData->feature(targetIdx)->isNumerical()),
-  children_(0),
+  hasOrigin_(false),
+  treeIdx_(0),
+  forestSeed_(0),
   nLeaves_(0),
-  bootstrapIcs_(0),
-  oobIcs_(0),
-  minDistToRoot_(0) {
+  nOobSamples_(0) {
 
   this->growTree(trainData,targetIdx,pmf,forestOptions,random);
 
 }
 
-RootNode::RootNode(ifstream& treeStream) {
+RootNode::RootNode(istream& treeStream):
+  hasOrigin_(false),
+  treeIdx_(0),
+  forestSeed_(0),
+  nLeaves_(0),
+  nOobSamples_(0) {
 
   this->loadTree(treeStream);
 
@@ -34,9 +55,9 @@ RootNode::~RootNode() { /* EMPTY DESTRUCTOR */ }
 
 size_t RootNode::getTreeSizeEstimate(const size_t nSamples, const size_t nMaxLeaves, const size_t nodeSize) const {
 
-  // Upper bound for the number of nodes as dictated by nMaxLeaves, 
+  // Upper bound for the number of nodes as dictated by nMaxLeaves,
   // assuming ternary splits (left,right,missing)
-  size_t S1 = static_cast<size_t>(ceil(1.0 + 3.0 * ( nMaxLeaves - 1 ) / 2.0)); 
+  size_t S1 = static_cast<size_t>(ceil(1.0 + 3.0 * ( nMaxLeaves - 1 ) / 2.0));
 
   // Upper bound for the number of nodes as dictated by sample size,
   // assuming ternary splits (left,right,missing)
@@ -47,21 +68,193 @@ size_t RootNode::getTreeSizeEstimate(const size_t nSamples, const size_t nMaxLea
 
 }
 
-void RootNode::reset(const size_t nNodes) {
+void RootNode::reset() {
+
+  hasOrigin_ = false;
+
+  splitterIdx_.clear();
+  splitterType_.clear();
+  splitValue_.clear();
+  fitness_.clear();
+  leftChild_.clear();
+  missingChild_.clear();
+  numTrainPrediction_.clear();
+  catTrainPrediction_.clear();
+  trainDataBegin_.clear();
+  trainDataEnd_.clear();
+
+  splitterNames_.clear();
+  categories_.clear();
+  leftValues_.clear();
+  leftValuesBegin_.assign(1,0);
+  trainSampleIcs_.clear();
+  numTargetData_.reset();
+  catTargetData_.reset();
+
+  nLeaves_ = 0;
+
+  isOobSample_.clear();
+  nOobSamples_ = 0;
+
+}
+
+size_t RootNode::addNode() {
+
+  size_t nodeIdx = splitterIdx_.size();
+
+  SplitValue splitValue;
+  splitValue.leftLeqValue = 0.0;
+
+  splitterIdx_.push_back(NO_SPLITTER);
+  splitterType_.push_back(Feature::Type::UNKNOWN);
+  splitValue_.push_back(splitValue);
+  fitness_.push_back(0.0);
+  leftChild_.push_back(NO_CHILD);
+  missingChild_.push_back(NO_CHILD);
+  trainDataBegin_.push_back(0);
+  trainDataEnd_.push_back(0);
+
+  // Only the predictions matching the target are stored
+  if ( isTargetNumerical_ || forestType_ == forest_t::GBT ) {
+    numTrainPrediction_.push_back(datadefs::NUM_NAN);
+  } else {
+    catTrainPrediction_.push_back(0);
+  }
+
+  return( nodeIdx );
+
+}
+
+void RootNode::setSplitter(const size_t nodeIdx,
+			   const num_t splitFitness,
+			   const uint32_t splitterIdx,
+			   const num_t splitLeftLeqValue) {
+
+  if ( this->hasChildren(nodeIdx) ) {
+    cerr << "RootNode::setSplitter() -- cannot set a splitter to a node twice!" << endl;
+    exit(1);
+  }
+
+  splitterIdx_[nodeIdx] = splitterIdx;
+  splitterType_[nodeIdx] = Feature::Type::NUM;
+  splitValue_[nodeIdx].leftLeqValue = splitLeftLeqValue;
+  fitness_[nodeIdx] = splitFitness;
+
+  leftChild_[nodeIdx] = this->addNode();
+  this->addNode();
+
+}
+
+void RootNode::setSplitter(const size_t nodeIdx,
+			   const num_t splitFitness,
+			   const uint32_t splitterIdx,
+			   const unordered_set<cat_t>& leftSplitValues,
+			   unordered_map<cat_t,uint32_t>& categoryIcs) {
+
+  if ( this->hasChildren(nodeIdx) ) {
+    cerr << "RootNode::setSplitter() -- cannot set a splitter to a node twice!" << endl;
+    exit(1);
+  }
+
+  // Category sets of all nodes are pooled into one array of category indices
+  for ( unordered_set<cat_t>::const_iterator it(leftSplitValues.begin()); it != leftSplitValues.end(); ++it ) {
+    leftValues_.push_back(this->getCategoryIdx(*it,categoryIcs));
+  }
+
+  splitterIdx_[nodeIdx] = splitterIdx;
+  splitterType_[nodeIdx] = Feature::Type::CAT;
+  splitValue_[nodeIdx].leftValuesIdx = leftValuesBegin_.size() - 1;
+  fitness_[nodeIdx] = splitFitness;
+
+  leftValuesBegin_.push_back(leftValues_.size());
+
+  leftChild_[nodeIdx] = this->addNode();
+  this->addNode();
+
+}
+
+void RootNode::setSplitter(const size_t nodeIdx,
+			   const num_t splitFitness,
+			   const uint32_t splitterIdx,
+			   const uint32_t hashIdx) {
+
+  if ( this->hasChildren(nodeIdx) ) {
+    cerr << "RootNode::setSplitter() -- cannot set a splitter to a node twice!" << endl;
+    exit(1);
+  }
 
-  assert(nNodes > 1);
+  splitterIdx_[nodeIdx] = splitterIdx;
+  splitterType_[nodeIdx] = Feature::Type::TXT;
+  splitValue_[nodeIdx].hashValue = hashIdx;
+  fitness_[nodeIdx] = splitFitness;
 
-  children_.clear();
-  children_.resize(nNodes-1);
+  leftChild_[nodeIdx] = this->addNode();
+  this->addNode();
 
 }
 
-void RootNode::loadTree(ifstream& treeStream) {
+void RootNode::setMissingChild(const size_t nodeIdx) {
+  missingChild_[nodeIdx] = this->addNode();
+}
+
+bool RootNode::isLeftValue(const size_t nodeIdx, const cat_t& value) const {
+
+  size_t setIdx = splitValue_[nodeIdx].leftValuesIdx;
+
+  for ( size_t i = leftValuesBegin_[setIdx]; i < leftValuesBegin_[setIdx+1]; ++i ) {
+    if ( categories_[ leftValues_[i] ] == value ) {
+      return( true );
+    }
+  }
 
-  unordered_map<string,Node*> treeMap;
+  return( false );
+
+}
+
+uint32_t RootNode::getSplitterIdx(const string& splitterName, unordered_map<string,uint32_t>& splitterIcs) {
+
+  unordered_map<string,uint32_t>::const_iterator it( splitterIcs.find(splitterName) );
+
+  if ( it != splitterIcs.end() ) {
+    return( it->second );
+  }
+
+  uint32_t splitterIdx = splitterNames_.size();
+  splitterNames_.push_back(splitterName);
+  splitterIcs[splitterName] = splitterIdx;
+
+  return( splitterIdx );
+
+}
+
+uint32_t RootNode::getCategoryIdx(const cat_t& category, unordered_map<cat_t,uint32_t>& categoryIcs) {
+
+  unordered_map<cat_t,uint32_t>::const_iterator it( categoryIcs.find(category) );
+
+  if ( it != categoryIcs.end() ) {
+    return( it->second );
+  }
+
+  uint32_t categoryIdx = categories_.size();
+  categories_.push_back(category);
+  categoryIcs[category] = categoryIdx;
+
+  return( categoryIdx );
+
+}
+
+void RootNode::loadTree(istream& treeStream) {
+
+  // Maps the traversal string of a node to the node index
+  unordered_map<string,size_t> treeMap;
+
+  unordered_map<string,uint32_t> splitterIcs;
+  unordered_map<cat_t,uint32_t> categoryIcs;
+
+  vector<num_t> numTargetData;
+  vector<cat_t> catTargetData;
 
   size_t nNodes = 0;
-  size_t nNodesAllocated = 0;
 
   string newLine;
 
@@ -79,98 +272,158 @@ void RootNode::loadTree(ifstream& treeStream) {
   targetName_ = treeSetup["TARGET"];
   isTargetNumerical_ = utils::str2<bool>(treeSetup["ISTARGETNUMERICAL"]);
 
-  this->reset(nNodes);
-  treeMap["*"] = this;
+  this->reset();
 
-  for ( size_t nodeIdx = 0; nodeIdx < nNodes; ++nodeIdx ) {
+  if ( treeSetup["TREE"] != "" && treeSetup.find("SEED") != treeSetup.end() ) {
+    this->setOrigin(utils::str2<size_t>(treeSetup["TREE"]),utils::str2<size_t>(treeSetup["SEED"]));
+  }
+  treeMap["*"] = this->addNode();
+
+  for ( size_t i = 0; i < nNodes; ++i ) {
 
     assert( getline(treeStream,newLine) );
-    
+
     // remove trailing end-of-line characters
     newLine = utils::chomp(newLine);
 
     map<string,string> nodeMap = utils::parse(newLine, ',', '=', '"');
-    
-    Node* nodep = treeMap[nodeMap["NODE"]];
-    
+
+    unordered_map<string,size_t>::const_iterator it( treeMap.find(nodeMap["NODE"]) );
+
+    if ( it == treeMap.end() ) {
+      cerr << "RootNode::loadTree() -- node '" << nodeMap["NODE"] << "' has no parent!" << endl;
+      exit(1);
+    }
+
+    size_t nodeIdx = it->second;
+
     string rawTrainPrediction = nodeMap["PRED"];
     vector<string> rawTrainData = utils::split(nodeMap["DATA"],',');
 
-    // Set the prediction and data for the node
+    // Set the prediction and data for the node. Nodes are stored depth-first,
+    // so the data of the leaves of any subtree end up next to each other.
+    // A loaded tree has no train data to share, so the values are read into
+    // a target column of its own
+    trainDataBegin_[nodeIdx] = trainSampleIcs_.size();
     if ( isTargetNumerical_ || (!isTargetNumerical_ && forestType_ == forest_t::GBT) ) {
-      nodep->setNumTrainPrediction( utils::str2<num_t>(rawTrainPrediction) );
-      vector<num_t> numTrainData(rawTrainData.size());
-      transform(rawTrainData.begin(),rawTrainData.end(),numTrainData.begin(),utils::str2<num_t>);
-      nodep->setNumTrainData(numTrainData);
-    } else { 
-      nodep->setCatTrainPrediction( rawTrainPrediction );
-      vector<cat_t> catTrainData(rawTrainData);
-      //transform(rawTrainData.begin(),rawTrainData.end(),catTrainData.begin(),utils::str2<cat_t>);
-      nodep->setCatTrainData(catTrainData);
+      numTrainPrediction_[nodeIdx] = utils::str2<num_t>(rawTrainPrediction);
+      for ( size_t j = 0; j < rawTrainData.size(); ++j ) {
+	trainSampleIcs_.push_back(numTargetData.size());
+	numTargetData.push_back( utils::str2<num_t>(rawTrainData[j]) );
+      }
+    } else {
+      catTrainPrediction_[nodeIdx] = this->getCategoryIdx(rawTrainPrediction,categoryIcs);
+      for ( size_t j = 0; j < rawTrainData.size(); ++j ) {
+	trainSampleIcs_.push_back(catTargetData.size());
+	catTargetData.push_back(rawTrainData[j]);
+      }
     }
-    
-    // If the node has a splitter... 
+    trainDataEnd_[nodeIdx] = trainSampleIcs_.size();
+
+    // If the node has a splitter...
     if ( nodeMap.find("SPLITTER") != nodeMap.end() ) {
-      
-      size_t leftChildIdx = nNodesAllocated++;
-      size_t rightChildIdx = nNodesAllocated++;
-      
-      if ( nNodesAllocated + 1 > nNodes ) {
-	cerr << "RootNode::loadForest() -- the tree contains more nodes than declared!" << endl;
-	exit(1);
-      }
-      
-      Node& lChild = this->childRef(leftChildIdx);
-      Node& rChild = this->childRef(rightChildIdx);
 
       num_t splitFitness = utils::str2<num_t>(nodeMap["DI"]);
-      
+
+      uint32_t splitterIdx = this->getSplitterIdx(nodeMap["SPLITTER"],splitterIcs);
+
       if ( nodeMap["SPLITTERTYPE"] == "NUMERICAL" ) {
 
-        nodep->setSplitter(splitFitness,nodeMap["SPLITTER"], utils::str2<num_t>(nodeMap["LVALUES"]), lChild, rChild);
+        this->setSplitter(nodeIdx,splitFitness,splitterIdx,utils::str2<num_t>(nodeMap["LVALUES"]));
 
       } else if ( nodeMap["SPLITTERTYPE"] == "CATEGORICAL" ){
 
         unordered_set<string> splitLeftValues = utils::keys(nodeMap["LVALUES"], ':');
 
-        nodep->setSplitter(splitFitness,nodeMap["SPLITTER"], splitLeftValues, lChild, rChild);
+        this->setSplitter(nodeIdx,splitFitness,splitterIdx,splitLeftValues,categoryIcs);
 
       } else if ( nodeMap["SPLITTERTYPE"] == "TEXTUAL" ) {
-        nodep->setSplitter(splitFitness,nodeMap["SPLITTER"], utils::str2<uint32_t>(nodeMap["LVALUES"]), lChild, rChild);
+        this->setSplitter(nodeIdx,splitFitness,splitterIdx,utils::str2<uint32_t>(nodeMap["LVALUES"]));
       } else {
         cerr << "ERROR: incompatible splitter type '" << nodeMap["SPLITTERTYPE"] << endl;
         exit(1);
       }
 
-      assert( &lChild == nodep->leftChild() );
-      assert( &rChild == nodep->rightChild() );
-
-      treeMap[nodeMap["NODE"] + "L"] = nodep->leftChild();
-      treeMap[nodeMap["NODE"] + "R"] = nodep->rightChild();
+      treeMap[nodeMap["NODE"] + "L"] = this->leftChild(nodeIdx);
+      treeMap[nodeMap["NODE"] + "R"] = this->rightChild(nodeIdx);
 
       // In case there is a branch for case when the splitter has missing value
       if ( nodeMap.find("M") != nodeMap.end() ) {
-        size_t missingChildIdx = nNodesAllocated++;
-        Node& mChild = this->childRef(missingChildIdx);
-        nodep->setMissingChild(mChild);
-        assert( &mChild == nodep->missingChild() );
-        treeMap[nodeMap["NODE"] + "M"] = nodep->missingChild();
+        this->setMissingChild(nodeIdx);
+        treeMap[nodeMap["NODE"] + "M"] = this->missingChild(nodeIdx);
       }
 
+    } else {
+      ++nLeaves_;
     }
 
+    if ( this->nNodes() > nNodes ) {
+      cerr << "RootNode::loadTree() -- the tree contains more nodes than declared!" << endl;
+      exit(1);
+    }
+
+  }
+
+  assert( this->nNodes() == nNodes );
+
+  if ( trainSampleIcs_.size() > 0 ) {
+    if ( isTargetNumerical_ || forestType_ == forest_t::GBT ) {
+      numTargetData_ = make_shared<const vector<num_t> >(numTargetData);
+    } else {
+      catTargetData_ = make_shared<const vector<cat_t> >(catTargetData);
+    }
   }
 
-  assert( nNodesAllocated + 1 == nNodes );
+  // Extend the data ranges of the nodes to cover their subtrees
+  this->recursiveSetTrainDataEnd(0);
 
   treeStream.peek();
 
 }
 
+size_t RootNode::recursiveSetTrainDataEnd(const size_t nodeIdx) {
+
+  if ( this->hasChildren(nodeIdx) ) {
+    trainDataEnd_[nodeIdx] = this->recursiveSetTrainDataEnd(this->leftChild(nodeIdx));
+    trainDataEnd_[nodeIdx] = this->recursiveSetTrainDataEnd(this->rightChild(nodeIdx));
+    if ( this->hasMissingChild(nodeIdx) ) {
+      trainDataEnd_[nodeIdx] = this->recursiveSetTrainDataEnd(this->missingChild(nodeIdx));
+    }
+  }
+
+  return( trainDataEnd_[nodeIdx] );
+
+}
+
 void RootNode::writeTree(ofstream& toFile) {
 
-  toFile << "TREE=," << flush;
-  
+  if ( hasOrigin_ ) {
+    toFile << "TREE=" << treeIdx_ << "," << flush;
+  } else {
+    toFile << "TREE=," << flush;
+  }
+
+  this->writeTreeSetup(toFile);
+
+  if ( hasOrigin_ ) {
+    toFile << ",SEED=" << forestSeed_;
+  }
+
+  toFile << endl;
+
+  string traversal("*");
+  this->recursiveWriteTree(0,traversal,toFile);
+
+}
+
+void RootNode::setOrigin(const size_t treeIdx, const size_t forestSeed) {
+  hasOrigin_ = true;
+  treeIdx_ = treeIdx;
+  forestSeed_ = forestSeed;
+}
+
+void RootNode::writeTreeSetup(ofstream& toFile) {
+
   if (forestType_ == forest_t::GBT) {
     toFile << "FOREST=GBT";
   } else if (forestType_ == forest_t::RF) {
@@ -182,81 +435,678 @@ void RootNode::writeTree(ofstream& toFile) {
     exit(1);
   }
 
-  toFile << ",NNODES=" << this->nNodes() << ",NLEAVES=" << this->nLeaves() << ",TARGET=\"" << targetName_ << "\",ISTARGETNUMERICAL=" << isTargetNumerical_ << ",CLASS=\"\"" << endl;
-
-  string traversal("*");
-  this->recursiveWriteTree(traversal,toFile);
+  toFile << ",NNODES=" << this->nNodes() << ",NLEAVES=" << this->nLeaves() << ",TARGET=\"" << targetName_ << "\",ISTARGETNUMERICAL=" << isTargetNumerical_ << ",CLASS=\"\"";
 
 }
 
+/**
+ * Recursively prints a tree to a stream (file)
+ */
+void RootNode::recursiveWriteTree(const size_t nodeIdx, string& traversal, ofstream& toFile) {
+
+  bool isNumPrediction = isTargetNumerical_ || forestType_ == forest_t::GBT;
+
+  toFile << "NODE=" << traversal << ",PRED=";
+  if ( isNumPrediction ) {
+    toFile << numTrainPrediction_[nodeIdx];
+  } else {
+    toFile << categories_[catTrainPrediction_[nodeIdx]];
+  }
+
+  if ( this->hasChildren(nodeIdx) ) {
+
+    toFile << ",DI=" << fitness_[nodeIdx] <<",SPLITTER=" << "\"" << splitterNames_[splitterIdx_[nodeIdx]] << "\"";
+
+    if ( splitterType_[nodeIdx] == Feature::Type::NUM ) {
+      toFile << ",SPLITTERTYPE=NUMERICAL"
+	     << ",LVALUES=" << splitValue_[nodeIdx].leftLeqValue;
+    } else if ( splitterType_[nodeIdx] == Feature::Type::CAT ) {
+      size_t setIdx = splitValue_[nodeIdx].leftValuesIdx;
+      toFile << ",SPLITTERTYPE=CATEGORICAL"
+	     << ",LVALUES=" << "\"";
+      for ( size_t i = leftValuesBegin_[setIdx]; i < leftValuesBegin_[setIdx+1]; ++i ) {
+	if ( i > leftValuesBegin_[setIdx] ) { toFile << ':'; }
+	toFile << categories_[ leftValues_[i] ];
+      }
+      toFile << "\"";
+    } else {
+      toFile << ",SPLITTERTYPE=TEXTUAL"
+	     << ",LVALUES=" << splitValue_[nodeIdx].hashValue;
+    }
+
+    if ( this->hasMissingChild(nodeIdx) ) { toFile << ",M=M"; }
+
+    // Only leaves hold train data
+    toFile << ",DATA=\"\"" << endl;
+
+    string traversalLeft = traversal;
+    traversalLeft.append("L");
+    string traversalRight = traversal;
+    traversalRight.append("R");
+
+    this->recursiveWriteTree(this->leftChild(nodeIdx),traversalLeft,toFile);
+    this->recursiveWriteTree(this->rightChild(nodeIdx),traversalRight,toFile);
+
+    // Optional third branch
+    if ( this->hasMissingChild(nodeIdx) ) {
+      string traversalMissing = traversal;
+      traversalMissing.append("M");
+      this->recursiveWriteTree(this->missingChild(nodeIdx),traversalMissing,toFile);
+    }
+
+  } else {
+    toFile << ",DATA=\"";
+    for ( size_t i = 0; i < this->nTrainSamples(nodeIdx); ++i ) {
+      if ( i > 0 ) { toFile << ','; }
+      if ( isNumPrediction ) {
+	toFile << this->getNumTrainData(nodeIdx,i);
+      } else {
+	toFile << this->getCatTrainData(nodeIdx,i);
+      }
+    }
+    toFile << "\"" << endl;
+  }
+}
 
 void RootNode::growTree(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random) {
 
+  SplitCache splitCache;
+
+  this->growTree(trainData,targetIdx,pmf,forestOptions,random,splitCache);
+
+}
+
+void RootNode::drawBootstrap(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, distributions::Random* random, SplitCache& splitCache) {
+
+  // The bootstrap sample is only needed while growing, so it lives in the cache
+  vector<size_t>& bootstrapIcs = splitCache.bootstrapIcs;
+  vector<size_t>& oobIcs = splitCache.oobIcs;
+  vector<uint8_t>& sampleWeights = splitCache.sampleWeights;
+
+  //Generate bootstrap indices and oob-indices. With weighted bootstrap the indices are
+  //unique and carry their multiplicity, otherwise every duplicate has unit weight
+  if ( forestOptions->weightedBootstrap ) {
+    trainData->bootstrapWeightsFromRealSamples(random, forestOptions->sampleWithReplacement, forestOptions->inBoxFraction, targetIdx, sampleWeights, bootstrapIcs, oobIcs);
+  } else {
+    trainData->bootstrapFromRealSamples(random, forestOptions->sampleWithReplacement, forestOptions->inBoxFraction, targetIdx, bootstrapIcs, oobIcs);
+    sampleWeights.assign(trainData->nSamples(),1);
+  }
+
+  // The tree only remembers which samples were left out of the bag
+  isOobSample_.assign(trainData->nSamples(),false);
+  for ( size_t i = 0; i < oobIcs.size(); ++i ) {
+    isOobSample_[ oobIcs[i] ] = true;
+  }
+  nOobSamples_ = oobIcs.size();
+
+}
+
+void RootNode::growTree(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random, SplitCache& splitCache) {
+
   forestType_ = forestOptions->forestType;
   targetName_ = trainData->feature(targetIdx)->name();
   isTargetNumerical_ = trainData->feature(targetIdx)->isNumerical();
 
+  this->reset();
+
+  // The node arrays are allocated once for the largest tree allowed. Clearing them
+  // keeps the capacity, so a tree that is grown again reuses its storage
   size_t nMaxNodes = this->getTreeSizeEstimate(trainData->feature(targetIdx)->nRealSamples(),forestOptions->nMaxLeaves,forestOptions->nodeSize);
 
-  this->reset(nMaxNodes);
+  splitterIdx_.reserve(nMaxNodes);
+  splitterType_.reserve(nMaxNodes);
+  splitValue_.reserve(nMaxNodes);
+  fitness_.reserve(nMaxNodes);
+  leftChild_.reserve(nMaxNodes);
+  missingChild_.reserve(nMaxNodes);
+  trainDataBegin_.reserve(nMaxNodes);
+  trainDataEnd_.reserve(nMaxNodes);
+  if ( isTargetNumerical_ || forestType_ == forest_t::GBT ) {
+    numTrainPrediction_.reserve(nMaxNodes);
+  } else {
+    catTrainPrediction_.reserve(nMaxNodes);
+  }
 
-  //Generate the vector for bootstrap indices
-  vector<size_t> bootstrapIcs;
-  
-  //Generate bootstrap indices and oob-indices
-  trainData->bootstrapFromRealSamples(random, forestOptions->sampleWithReplacement, forestOptions->inBoxFraction, targetIdx, bootstrapIcs_, oobIcs_);
+  this->drawBootstrap(trainData,targetIdx,forestOptions,random,splitCache);
 
-  //featuresInTree_.clear();
+  vector<size_t>& bootstrapIcs = splitCache.bootstrapIcs;
+  vector<uint8_t>& sampleWeights = splitCache.sampleWeights;
 
   PredictionFunctionType predictionFunctionType;
 
   if ( trainData->feature(targetIdx)->isNumerical() ) {
-    predictionFunctionType = Node::MEAN;
+    predictionFunctionType = MEAN;
   } else if ( !trainData->feature(targetIdx)->isNumerical() && forestOptions->forestType == forest_t::GBT ) {
-    predictionFunctionType = Node::GAMMA;
+    predictionFunctionType = GAMMA;
   } else {
-    predictionFunctionType = Node::MODE;
+    predictionFunctionType = MODE;
   }
 
   nLeaves_ = 1;
 
-  size_t nChildren = 0;
+  // QRF leaves refer to the samples by index, so the tree holds on to the target
+  // column. Trees grown with the same cache on the same target share one copy of it
+  if ( forestType_ == forest_t::QRF ) {
+    bool isSameTarget = splitCache.targetDataSource == trainData && splitCache.targetDataIdx == targetIdx;
+    if ( isTargetNumerical_ ) {
+      if ( !splitCache.numTargetData || !isSameTarget ) {
+	splitCache.numTargetData = make_shared<const vector<num_t> >(trainData->feature(targetIdx)->numData);
+	splitCache.catTargetData.reset();
+      }
+      numTargetData_ = splitCache.numTargetData;
+    } else {
+      if ( !splitCache.catTargetData || !isSameTarget ) {
+	splitCache.catTargetData = make_shared<const vector<cat_t> >(trainData->feature(targetIdx)->catData);
+	splitCache.numTargetData.reset();
+      }
+      catTargetData_ = splitCache.catTargetData;
+    }
+    splitCache.targetDataSource = trainData;
+    splitCache.targetDataIdx = targetIdx;
+  }
+
+  // The look-up tables index into the tables of this tree only
+  splitCache.nMaxNodes = nMaxNodes;
+  splitCache.splitterIcs.clear();
+  splitCache.categoryIcs.clear();
+  splitCache.nodeDepths.assign(1,0);
+  splitCache.minDepthBySplitter.clear();
+  splitCache.splitterFeatureIcs.clear();
+
+  size_t rootIdx = this->addNode();
 
   //Start the recursive node splitting from the root node. This will generate the tree.
-  this->recursiveNodeSplit(trainData,
+  //The grow engine is specialized for the target type, so we dispatch only once here
+  if ( isTargetNumerical_ ) {
+    this->recursiveNodeSplit(rootIdx,
+			     trainData,
+			     targetIdx,
+			     forestOptions,
+			     random,
+			     predictionFunctionType,
+			     pmf,
+			     bootstrapIcs,
+			     sampleWeights,
+			     splitengine::TargetStat<num_t>(trainData->feature(targetIdx)->numData,bootstrapIcs,sampleWeights),
+			     splitCache);
+  } else {
+    this->recursiveNodeSplit(rootIdx,
+			     trainData,
+			     targetIdx,
+			     forestOptions,
+			     random,
+			     predictionFunctionType,
+			     pmf,
+			     bootstrapIcs,
+			     sampleWeights,
+			     splitengine::TargetStat<cat_t>(trainData->feature(targetIdx)->catData,bootstrapIcs,sampleWeights),
+			     splitCache);
+  }
+
+  if ( !splitCache.minDepthSums.empty() ) {
+    for ( size_t splitterIdx = 0; splitterIdx < splitCache.splitterFeatureIcs.size(); ++splitterIdx ) {
+      splitCache.minDepthSums[ splitCache.splitterFeatureIcs[splitterIdx] ] += splitCache.minDepthBySplitter[splitterIdx];
+    }
+  }
+
+}
+
+void RootNode::setTrainPrediction(const size_t nodeIdx, const splitengine::TargetStat<num_t>& stat, SplitCache&) {
+  numTrainPrediction_[nodeIdx] = splitengine::prediction(stat);
+}
+
+void RootNode::setTrainPrediction(const size_t nodeIdx, const splitengine::TargetStat<cat_t>& stat, SplitCache& splitCache) {
+  catTrainPrediction_[nodeIdx] = this->getCategoryIdx(splitengine::prediction(stat),splitCache.categoryIcs);
+}
+
+void RootNode::addTrainData(const vector<size_t>& sampleIcs,
+			    const vector<uint8_t>& sampleWeights) {
+
+  for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+    for ( size_t k = 0; k < sampleWeights[sampleIcs[i]]; ++k ) {
+      trainSampleIcs_.push_back(sampleIcs[i]);
+    }
+  }
+
+}
+
+template<typename T>
+void RootNode::recursiveNodeSplit(const size_t nodeIdx,
+				  TreeData* treeData,
+				  const size_t targetIdx,
+				  const ForestOptions* forestOptions,
+				  distributions::Random* random,
+				  const PredictionFunctionType& predictionFunctionType,
+				  const distributions::PMF* pmf,
+				  const vector<size_t>& sampleIcs,
+				  const vector<uint8_t>& sampleWeights,
+				  const splitengine::TargetStat<T>& stat,
+				  SplitCache& splitCache) {
+
+  assert( stat.n >= sampleIcs.size() );
+
+  // Train data of the leaves is appended depth-first, so the subtree of
+  // the node will own the range starting from here
+  trainDataBegin_[nodeIdx] = trainSampleIcs_.size();
+  trainDataEnd_[nodeIdx] = trainDataBegin_[nodeIdx];
+
+  // Mean and mode come for free from the statistics collected by the parent
+  if ( predictionFunctionType == MEAN || predictionFunctionType == MODE ) {
+    this->setTrainPrediction(nodeIdx,stat,splitCache);
+  } else if ( predictionFunctionType == GAMMA ) {
+    vector<num_t> numTrainData = utils::repeat(treeData->feature(targetIdx)->numData,sampleIcs,sampleWeights);
+    numTrainPrediction_[nodeIdx] = math::gamma(numTrainData, treeData->feature(targetIdx)->categories().size() );
+    assert(!datadefs::isNAN(numTrainPrediction_[nodeIdx]));
+  } else {
+    cerr << "RootNode::recursiveNodeSplit() -- unknown prediction function!" << endl;
+    exit(1);
+  }
+
+  assert( nLeaves_ <= forestOptions->nMaxLeaves );
+
+  // The number of samples is the weighted count
+  bool foundSplit = false;
+
+  splitengine::TargetStat<T> stat_left;
+  splitengine::TargetStat<T> stat_right;
+
+  if ( stat.n >= 2 * forestOptions->nodeSize && nLeaves_ < forestOptions->nMaxLeaves && this->nNodes() + 1 < splitCache.nMaxNodes ) {
+
+    splitCache.featureSampleIcs.clear();
+
+    if ( forestOptions->isRandomSplit ) {
+
+      splitCache.featureSampleIcs.resize(forestOptions->mTry);
+
+      for ( size_t i = 0; i < forestOptions->mTry; ++i ) {
+	splitCache.featureSampleIcs[i] = pmf->sample(random);
+      }
+
+      if ( forestOptions->useContrasts ) {
+
+	// With several contrast sets, each set is sampled as often as a single set would be
+	// relative to the real features, so that the importance of the contrasts stays comparable
+	size_t nContrastSets = treeData->nContrastSets();
+	num_t contrastFraction = forestOptions->contrastFraction;
+	if ( nContrastSets > 1 ) {
+	  contrastFraction = nContrastSets * contrastFraction / ( 1 - contrastFraction + nContrastSets * contrastFraction );
+	}
+
+	for ( size_t i = 0; i < forestOptions->mTry; ++i ) {
+
+	  // If the sampled feature is a contrast...
+	  if ( ! treeData->feature(splitCache.featureSampleIcs[i])->isTextual() && random->uniform() < contrastFraction ) { // p% sampling rate
+
+	    // Contrast features in TreeData are indexed with an offset of the number of features: nFeatures.
+	    // With several contrast sets, one of them is picked at random
+	    size_t contrastSetIdx = nContrastSets > 1 ? 1 + random->integer() % nContrastSets : 1;
+	    splitCache.featureSampleIcs[i] += contrastSetIdx * treeData->nFeatures();
+	  }
+	}
+      }
+    } else {
+
+      for ( size_t featureIdx = 0; featureIdx < treeData->nFeatures(); ++featureIdx ) {
+	if ( featureIdx != targetIdx ) {
+	  splitCache.featureSampleIcs.push_back(featureIdx);
+	}
+      }
+    }
+
+    splitCache.sampleIcs_left.clear();
+    splitCache.sampleIcs_right.clear();
+    splitCache.sampleIcs_missing.clear();
+
+    foundSplit = this->regularSplitterSeek(nodeIdx,
+					   treeData,
+					   targetIdx,
+					   forestOptions,
+					   random,
+					   sampleIcs,
+					   sampleWeights,
+					   splitCache,
+					   stat_left,
+					   stat_right);
+  }
+
+  if ( !foundSplit ) {
+    if ( forestOptions->forestType == forest_t::QRF ) {
+      this->addTrainData(sampleIcs,sampleWeights);
+    }
+    trainDataEnd_[nodeIdx] = trainSampleIcs_.size();
+    return;
+  }
+
+  nLeaves_ += 1;
+
+  // The branches take over the partitioned buffers, and the cache refills from the pool
+  vector<size_t> sampleIcs_left;
+  vector<size_t> sampleIcs_right;
+  vector<size_t> sampleIcs_missing;
+
+  splitCache.takeSampleIcs(splitCache.sampleIcs_left,sampleIcs_left);
+  splitCache.takeSampleIcs(splitCache.sampleIcs_right,sampleIcs_right);
+  splitCache.takeSampleIcs(splitCache.sampleIcs_missing,sampleIcs_missing);
+
+  // Left child recursive split
+  this->recursiveNodeSplit(this->leftChild(nodeIdx),
+			   treeData,
+			   targetIdx,
+			   forestOptions,
+			   random,
+			   predictionFunctionType,
+			   pmf,
+			   sampleIcs_left,
+			   sampleWeights,
+			   stat_left,
+			   splitCache);
+
+  // Right child recursive split
+  this->recursiveNodeSplit(this->rightChild(nodeIdx),
+			   treeData,
 			   targetIdx,
 			   forestOptions,
 			   random,
 			   predictionFunctionType,
 			   pmf,
-			   bootstrapIcs_,
-			   &nLeaves_,
-			   nChildren,
-			   children_,
-			   splitCache_);
-  
-  children_.resize(nChildren);
-  
+			   sampleIcs_right,
+			   sampleWeights,
+			   stat_right,
+			   splitCache);
+
+  // OPTIONAL: Missing child recursive split
+  if ( this->hasMissingChild(nodeIdx) ) {
+
+    assert( sampleIcs_missing.size() > 0 );
+
+    // The split scan skips samples with missing data, so their statistics are collected here
+    splitengine::TargetStat<T> stat_missing(treeData->feature(targetIdx)->data<T>(),sampleIcs_missing,sampleWeights);
+
+    nLeaves_ += 1;
+
+    this->recursiveNodeSplit(this->missingChild(nodeIdx),
+			     treeData,
+			     targetIdx,
+			     forestOptions,
+			     random,
+			     predictionFunctionType,
+			     pmf,
+			     sampleIcs_missing,
+			     sampleWeights,
+			     stat_missing,
+			     splitCache);
+  }
+
+  splitCache.releaseSampleIcs(sampleIcs_left);
+  splitCache.releaseSampleIcs(sampleIcs_right);
+  splitCache.releaseSampleIcs(sampleIcs_missing);
+
+  trainDataEnd_[nodeIdx] = trainSampleIcs_.size();
+
+}
+
+template<typename T>
+bool RootNode::regularSplitterSeek(const size_t nodeIdx,
+				   TreeData* treeData,
+				   const size_t targetIdx,
+				   const ForestOptions* forestOptions,
+				   distributions::Random* random,
+				   const vector<size_t>& sampleIcs,
+				   const vector<uint8_t>& sampleWeights,
+				   SplitCache& splitCache,
+				   splitengine::TargetStat<T>& stat_left,
+				   splitengine::TargetStat<T>& stat_right) {
+
+  // This many features will be tested for splitting the data
+  size_t nFeaturesForSplit = splitCache.featureSampleIcs.size();
+
+  // Initialize split fitness to lowest possible value
+  splitCache.splitFitness = 0.0;
+
+  splitengine::SplitScratch<T>& scratch = splitCache.splitScratch(stat_left);
+
+  // Target statistics of the branches of the current candidate
+  splitengine::TargetStat<T>& newStat_left = scratch.left;
+  splitengine::TargetStat<T>& newStat_right = scratch.right;
+
+  // Loop through candidate splitters. Candidates only report their fitness and
+  // split value; the samples are partitioned once for the winner
+  for ( size_t i = 0; i < nFeaturesForSplit; ++i ) {
+
+    // Get split feature index
+    splitCache.newSplitFeatureIdx = splitCache.featureSampleIcs[i];
+
+    // We don't want that the program tests to split data with itself
+    assert( splitCache.newSplitFeatureIdx != targetIdx );
+
+    // Reset the splitCache
+    splitCache.newSplitValue = datadefs::NUM_NAN;
+    splitCache.newSplitValues_left.clear();
+    splitCache.newHashIdx = 0;
+    splitCache.newSplitFitness = 0.0;
+
+    const Feature* newSplitFeature = treeData->feature(splitCache.newSplitFeatureIdx);
+
+    if ( newSplitFeature->isNumerical() && forestOptions->extraTrees ) {
+
+      // Extremely randomized trees draw the threshold instead of sorting the samples for the best one
+      splitCache.newSplitFitness = treeData->randomNumericalFeatureSplit(targetIdx,
+									 splitCache.newSplitFeatureIdx,
+									 forestOptions->nodeSize,
+									 sampleIcs,
+									 sampleWeights,
+									 random->uniform(),
+									 splitCache.newSplitValue,
+									 newStat_left,
+									 newStat_right);
+
+    } else if ( newSplitFeature->isNumerical() ) {
+
+      splitCache.newSplitFitness = treeData->numericalFeatureSplit(targetIdx,
+								   splitCache.newSplitFeatureIdx,
+								   forestOptions->nodeSize,
+								   sampleIcs,
+								   sampleWeights,
+								   splitCache.newSplitValue,
+								   newStat_left,
+								   newStat_right,
+								   scratch);
+
+    } else if ( newSplitFeature->isCategorical() ) {
+
+      // The categories are sorted before being shuffled, so that their order does not
+      // depend on the hash tables
+      splitengine::CategoryGroups& catGroups = scratch.catGroups;
+      catGroups.clear();
+
+      const vector<cat_t>& catData = newSplitFeature->catData;
+
+      for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+	if ( !datadefs::isNAN(catData[sampleIcs[i]]) ) {
+	  catGroups.add(catData[sampleIcs[i]]);
+	}
+      }
+
+      vector<cat_t>& catOrder = splitCache.catOrder;
+      catOrder.assign(catGroups.categories.begin(),catGroups.categories.begin()+catGroups.nGroups);
+      sort(catOrder.begin(),catOrder.end());
+
+      utils::permute(catOrder,random);
+
+      if ( forestOptions->extraTrees ) {
+
+	// A random nonempty proper subset of the categories goes to the left
+	if ( catOrder.size() > 1 ) {
+	  size_t nLeft = 1 + random->integer() % ( catOrder.size() - 1 );
+	  splitCache.newSplitValues_left.insert(catOrder.begin(),catOrder.begin()+nLeft);
+	  splitCache.newSplitFitness = treeData->categoricalFeatureSubsetSplit(targetIdx,
+									       splitCache.newSplitFeatureIdx,
+									       forestOptions->nodeSize,
+									       sampleIcs,
+									       sampleWeights,
+									       splitCache.newSplitValues_left,
+									       newStat_left,
+									       newStat_right);
+	}
+
+      } else {
+
+	splitCache.newSplitFitness = treeData->categoricalFeatureSplit(targetIdx,
+								       splitCache.newSplitFeatureIdx,
+								       catOrder,
+								       forestOptions->nodeSize,
+								       sampleIcs,
+								       sampleWeights,
+								       splitCache.newSplitValues_left,
+								       newStat_left,
+								       newStat_right,
+								       scratch);
+      }
+
+    } else if ( newSplitFeature->isTextual() ) {
+
+      // The samples with missing data are skipped in place, without copying the rest
+      size_t nRealSamples = 0;
+      for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+	nRealSamples += newSplitFeature->isMissing(sampleIcs[i]) ? 0 : 1;
+      }
+
+      if ( nRealSamples > 0 ) {
+
+	// Choose random sample among the ones with data
+	size_t realIdx = random->integer() % nRealSamples;
+	size_t sampleIdx = 0;
+	for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+	  if ( !newSplitFeature->isMissing(sampleIcs[i]) && realIdx-- == 0 ) {
+	    sampleIdx = sampleIcs[i];
+	    break;
+	  }
+	}
+
+	// Choose random hash from the randomly selected sample
+	splitCache.newHashIdx = newSplitFeature->getHash(sampleIdx,random->integer());
+
+	splitCache.newSplitFitness = treeData->textualFeatureSplit(targetIdx,
+								   splitCache.newSplitFeatureIdx,
+								   splitCache.newHashIdx,
+								   forestOptions->nodeSize,
+								   sampleIcs,
+								   sampleWeights,
+								   newStat_left,
+								   newStat_right);
+      }
+
+    }
+
+    if( splitCache.newSplitFitness > splitCache.splitFitness ) {
+
+      splitCache.splitFitness      = splitCache.newSplitFitness;
+      splitCache.splitFeatureIdx   = splitCache.newSplitFeatureIdx;
+      splitCache.splitValue        = splitCache.newSplitValue;
+      splitCache.hashIdx           = splitCache.newHashIdx;
+
+      // The buffers of the candidate are cleared before they are used again
+      splitCache.splitValues_left.swap(splitCache.newSplitValues_left);
+      stat_left.swap(newStat_left);
+      stat_right.swap(newStat_right);
+    }
+
+  }
+
+  // If none of the splitter candidates worked as a splitter
+  if ( fabs(splitCache.splitFitness) < datadefs::EPS ) {
+    return(false);
+  }
+
+  const Feature* splitFeature = treeData->feature(splitCache.splitFeatureIdx);
+
+  size_t nSplitters = splitterNames_.size();
+
+  uint32_t splitterIdx = this->getSplitterIdx(splitFeature->name(),splitCache.splitterIcs);
+
+  if ( !splitCache.DISums.empty() ) {
+    splitCache.DISums[splitCache.splitFeatureIdx] += splitCache.splitFitness;
+    if ( splitterNames_.size() > nSplitters ) {
+      ++splitCache.featureTreeCounts[splitCache.splitFeatureIdx];
+    }
+  }
+
+  // Nodes are split depth-first, so the first split with a feature need not be its shallowest
+  uint32_t depth = splitCache.nodeDepths[nodeIdx];
+
+  if ( splitterNames_.size() > nSplitters ) {
+    splitCache.minDepthBySplitter.push_back(depth);
+    splitCache.splitterFeatureIcs.push_back(splitCache.splitFeatureIdx);
+  } else if ( depth < splitCache.minDepthBySplitter[splitterIdx] ) {
+    splitCache.minDepthBySplitter[splitterIdx] = depth;
+  }
+
+  if ( splitFeature->isNumerical() ) {
+
+    treeData->numericalFeaturePartition(splitCache.splitFeatureIdx,
+					splitCache.splitValue,
+					sampleIcs,
+					splitCache.sampleIcs_left,
+					splitCache.sampleIcs_right,
+					splitCache.sampleIcs_missing);
+
+    this->setSplitter(nodeIdx,splitCache.splitFitness,splitterIdx,splitCache.splitValue);
+
+  } else if ( splitFeature->isCategorical() ) {
+
+    treeData->categoricalFeaturePartition(splitCache.splitFeatureIdx,
+					  splitCache.splitValues_left,
+					  sampleIcs,
+					  splitCache.sampleIcs_left,
+					  splitCache.sampleIcs_right,
+					  splitCache.sampleIcs_missing);
+
+    this->setSplitter(nodeIdx,splitCache.splitFitness,splitterIdx,splitCache.splitValues_left,splitCache.categoryIcs);
+
+  } else if ( splitFeature->isTextual() ) {
+
+    treeData->textualFeaturePartition(splitCache.splitFeatureIdx,
+				      splitCache.hashIdx,
+				      sampleIcs,
+				      splitCache.sampleIcs_left,
+				      splitCache.sampleIcs_right,
+				      splitCache.sampleIcs_missing);
+
+    this->setSplitter(nodeIdx,splitCache.splitFitness,splitterIdx,splitCache.hashIdx);
+
+  }
+
+  assert( splitCache.sampleIcs_left.size() <= stat_left.n );
+  assert( splitCache.sampleIcs_right.size() <= stat_right.n );
+  assert( stat_left.n >= forestOptions->nodeSize );
+  assert( stat_right.n >= forestOptions->nodeSize );
+
+  if ( ! forestOptions->noNABranching && splitCache.sampleIcs_missing.size() > 0 && this->nNodes() < splitCache.nMaxNodes ) {
+    this->setMissingChild(nodeIdx);
+  }
+
+  // The nodes added above are the children of the node
+  splitCache.nodeDepths.resize(this->nNodes(),depth + 1);
+
+  return(true);
+
 }
 
 unordered_map<string,num_t> RootNode::getDI() {
 
-  unordered_map<string,num_t> DI;
+  // Accumulate per splitter first, then resolve the names once
+  vector<num_t> DIBySplitter(splitterNames_.size(),0.0);
 
-  for ( size_t nodeIdx = 0; nodeIdx < children_.size(); ++nodeIdx ) {
-    unordered_map<string,num_t>::iterator it(DI.find(children_[nodeIdx].getSplitter().name));
-    if ( it == DI.end() ) {
-      DI[ children_[nodeIdx].getSplitter().name ] = children_[nodeIdx].getSplitter().fitness;
-    } else {
-      DI[ children_[nodeIdx].getSplitter().name ] += children_[nodeIdx].getSplitter().fitness;
+  for ( size_t nodeIdx = 0; nodeIdx < this->nNodes(); ++nodeIdx ) {
+    if ( this->hasChildren(nodeIdx) ) {
+      DIBySplitter[ splitterIdx_[nodeIdx] ] += fitness_[nodeIdx];
     }
   }
 
-  unordered_map<string,num_t>::iterator it(DI.find(this->getSplitter().name));
-  if ( it == DI.end() ) {
-    DI[ this->getSplitter().name ]  = this->getSplitter().fitness;
-  } else {
-    DI[ this->getSplitter().name ] += this->getSplitter().fitness;
+  unordered_map<string,num_t> DI;
+
+  for ( size_t splitterIdx = 0; splitterIdx < splitterNames_.size(); ++splitterIdx ) {
+    DI[ splitterNames_[splitterIdx] ] = DIBySplitter[splitterIdx];
   }
 
   return(DI);
@@ -273,110 +1123,152 @@ void RootNode::verifyIntegrity() const {
 
   size_t nNodes = this->nNodes();
 
-  stack<const Node*> nodesToVisit;
-  nodesToVisit.push(this);
+  stack<size_t> nodesToVisit;
+  nodesToVisit.push(0);
 
-  unordered_set<const Node*> nodesReferred;
-  nodesReferred.rehash(4*nNodes);
+  vector<bool> isReferred(nNodes,false);
+  size_t nReferred = 0;
 
   while ( ! nodesToVisit.empty() ) {
 
-    const Node* node = nodesToVisit.top();
+    size_t nodeIdx = nodesToVisit.top();
     nodesToVisit.pop();
 
-    if ( nodesReferred.find(node) != nodesReferred.end() ) {
+    if ( isReferred[nodeIdx] ) {
       cerr << "RootNode::verifyIntegrity() -- double referral to the same node in the tree, which should be impossible!" << endl;
       exit(1);
     }
 
-    nodesReferred.insert(node);
+    isReferred[nodeIdx] = true;
+    ++nReferred;
 
-    if ( node->hasChildren() ) { 
-      nodesToVisit.push(node->leftChild());
-      nodesToVisit.push(node->rightChild());
+    if ( this->hasChildren(nodeIdx) ) {
+      nodesToVisit.push(this->leftChild(nodeIdx));
+      nodesToVisit.push(this->rightChild(nodeIdx));
     }
-    
-    if ( node->missingChild() ) {
-      nodesToVisit.push(node->missingChild());
+
+    if ( this->hasMissingChild(nodeIdx) ) {
+      nodesToVisit.push(this->missingChild(nodeIdx));
     }
-    
+
   }
-  
-  if ( nodesReferred.size() != nNodes ) {
-    cerr << "RootNode::verifyIntegrity() -- only " << nodesReferred.size() << " / " << nNodes << " nodes are reachable!" << endl;
+
+  if ( nReferred != nNodes ) {
+    cerr << "RootNode::verifyIntegrity() -- only " << nReferred << " / " << nNodes << " nodes are reachable!" << endl;
     exit(1);
   }
-  
-}
-
-// This is a bad function, it exposes the private data to public!!
-Node& RootNode::childRef(const size_t childIdx) {
-
-  assert( childIdx < children_.size() );
-
-  return( children_[childIdx] );
 
 }
 
 size_t RootNode::nNodes() const {
-  return( children_.size() + 1 );
+  return( splitterIdx_.size() );
 }
 
 size_t RootNode::nLeaves() const {
+  return( nLeaves_ );
+}
 
-  if ( nLeaves_ == 0 ) {
-    cerr << "ERROR: RootNode::nLeaves() -- trying to save a forest that has been read from file? Don't!" << endl;
-    exit(1);
+vector<size_t> RootNode::getOobIcs() const {
+
+  vector<size_t> oobIcs;
+  oobIcs.reserve(nOobSamples_);
+
+  for ( size_t sampleIdx = 0; sampleIdx < isOobSample_.size(); ++sampleIdx ) {
+    if ( isOobSample_[sampleIdx] ) {
+      oobIcs.push_back(sampleIdx);
+    }
   }
 
-  return( nLeaves_ );
+  return( oobIcs );
+
 }
 
-vector<size_t> RootNode::getOobIcs() {
-  return( oobIcs_ );
+size_t RootNode::nOobSamples() const {
+  return( nOobSamples_ );
 }
 
-size_t RootNode::nOobSamples() {
-  return( oobIcs_.size() ); 
+size_t RootNode::percolate(TreeData* testData, const size_t sampleIdx) const {
+  return( this->percolateNode(testData,sampleIdx,NULL,testData->end(),sampleIdx) );
 }
 
-const Node::Prediction& RootNode::getPrediction(TreeData* testData, const size_t sampleIdx) {
-  return( this->percolate(testData,sampleIdx)->getPrediction() );
+size_t RootNode::percolate(TreeData* testData, const size_t sampleIdx, const size_t scrambleFeatureIdx, const size_t scrambledSampleIdx) const {
+  return( this->percolateNode(testData,sampleIdx,NULL,scrambleFeatureIdx,scrambledSampleIdx) );
 }
 
+void RootNode::getSplitterFeatureIcs(TreeData* testData, vector<size_t>& splitterFeatureIcs) const {
+
+  splitterFeatureIcs.resize(splitterNames_.size());
 
-vector<num_t> RootNode::getChildLeafNumTrainData(TreeData* treeData, const size_t sampleIdx) {
+  for ( size_t splitterIdx = 0; splitterIdx < splitterNames_.size(); ++splitterIdx ) {
+    splitterFeatureIcs[splitterIdx] = testData->getFeatureIdx(splitterNames_[splitterIdx]);
+  }
 
-  vector<Node*> leaves = this->percolate(treeData,sampleIdx)->getSubTreeLeaves();
+}
 
-  vector<num_t> allTrainData;
+size_t RootNode::percolate(TreeData* testData, const size_t sampleIdx, const vector<size_t>& splitterFeatureIcs,
+			   const size_t scrambleFeatureIdx, const size_t scrambledSampleIdx) const {
 
-  for ( size_t i = 0; i < leaves.size(); ++i ) {
-    vector<num_t> trainData = leaves[i]->getPrediction().numTrainData;
-    for ( size_t j = 0; j < trainData.size(); ++j ) {
-      allTrainData.push_back(trainData[j]);
-    }
-  }
+  assert( splitterFeatureIcs.size() == splitterNames_.size() );
+
+  return( this->percolateNode(testData,sampleIdx,&splitterFeatureIcs,scrambleFeatureIdx,scrambledSampleIdx) );
 
-  return(allTrainData);
-  
 }
 
-vector<cat_t> RootNode::getChildLeafCatTrainData(TreeData* treeData, const size_t sampleIdx) {
+size_t RootNode::percolateNode(TreeData* testData, const size_t sampleIdx, const vector<size_t>* splitterFeatureIcs,
+			       const size_t scrambleFeatureIdx, const size_t scrambledSampleIdx) const {
 
-  vector<Node*> leaves = this->percolate(treeData,sampleIdx)->getSubTreeLeaves();
+  size_t nodeIdx = 0;
 
-  vector<cat_t> allTrainData;
+  while ( this->hasChildren(nodeIdx) ) {
+
+    size_t featureIdx = splitterFeatureIcs ?
+      (*splitterFeatureIcs)[splitterIdx_[nodeIdx]] :
+      testData->getFeatureIdx(splitterNames_[splitterIdx_[nodeIdx]]);
+
+    if ( featureIdx == testData->end() ) { break; }
+
+    const Feature* feature = testData->feature(featureIdx);
+
+    size_t dataIdx = featureIdx == scrambleFeatureIdx ? scrambledSampleIdx : sampleIdx;
+
+    if ( splitterType_[nodeIdx] == Feature::Type::NUM ) {
+
+      num_t data = feature->getNumData(dataIdx);
+
+      if ( datadefs::isNAN(data) ) {
+	if ( !this->hasMissingChild(nodeIdx) ) { break; }
+	nodeIdx = this->missingChild(nodeIdx);
+      } else {
+	nodeIdx = data <= splitValue_[nodeIdx].leftLeqValue ? this->leftChild(nodeIdx) : this->rightChild(nodeIdx);
+      }
+
+    } else if ( splitterType_[nodeIdx] == Feature::Type::CAT ) {
+
+      const cat_t& data = feature->catData[dataIdx];
+
+      if ( datadefs::isNAN(data) ) {
+	if ( !this->hasMissingChild(nodeIdx) ) { break; }
+	nodeIdx = this->missingChild(nodeIdx);
+      } else {
+	nodeIdx = this->isLeftValue(nodeIdx,data) ? this->leftChild(nodeIdx) : this->rightChild(nodeIdx);
+      }
+
+    } else {
+
+      nodeIdx = feature->hasHash(dataIdx,splitValue_[nodeIdx].hashValue) ? this->leftChild(nodeIdx) : this->rightChild(nodeIdx);
 
-  for ( size_t i = 0; i < leaves.size(); ++i ) {
-    vector<cat_t> trainData = leaves[i]->getPrediction().catTrainData;
-    for ( size_t j = 0; j < trainData.size(); ++j ) {
-      allTrainData.push_back(trainData[j]);
     }
+
   }
 
-  return(allTrainData);
+  return( nodeIdx );
 
 }
 
+num_t RootNode::getNumTrainPrediction(TreeData* testData, const size_t sampleIdx) const {
+  return( numTrainPrediction_[ this->percolate(testData,sampleIdx) ] );
+}
 
+cat_t RootNode::getCatTrainPrediction(TreeData* testData, const size_t sampleIdx) const {
+  return( categories_[ catTrainPrediction_[ this->percolate(testData,sampleIdx) ] ] );
+}
@@ -1,3 +1,7 @@
+//rootnode.hpp
+//
+//A CART stored in a compact structure-of-arrays form
+
 #ifndef ROOTNODE_HPP
 #define ROOTNODE_HPP
 
@@ -7,56 +11,187 @@
 #include <set>
 #include <utility>
 #include <fstream>
-#include "node.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
 #include "treedata.hpp"
 #include "options.hpp"
 #include "distributions.hpp"
 #include "datadefs.hpp"
+#include "splitengine.hpp"
 
 using datadefs::num_t;
 using datadefs::cat_t;
 
-class RootNode : public Node {
+class RootNode {
 public:
 
+  enum PredictionFunctionType { MEAN, MODE, GAMMA };
+
+  // Scratch space for growing trees. Reusing one cache across the trees grown
+  // by a thread keeps the buffers allocated from one tree to the next
+  struct SplitCache {
+
+    SplitCache(): targetDataSource(NULL), targetDataIdx(0) {}
+
+    // The tree is not grown beyond the size estimate
+    size_t nMaxNodes;
+
+    vector<size_t> featureSampleIcs;
+    vector<cat_t> catOrder;
+
+    // Samples of the winning split, partitioned once the best candidate is known
+    vector<size_t> sampleIcs_left;
+    vector<size_t> sampleIcs_right;
+    vector<size_t> sampleIcs_missing;
+    uint32_t hashIdx;
+    size_t splitFeatureIdx;
+    num_t splitValue;
+    unordered_set<cat_t> splitValues_left;
+    num_t splitFitness;
+
+    // Candidate splits are evaluated without materializing the branches
+    uint32_t newHashIdx;
+    size_t newSplitFeatureIdx;
+    num_t newSplitValue;
+    unordered_set<cat_t> newSplitValues_left;
+    num_t newSplitFitness;
+
+    // Buffers and branch statistics of the split kernels for either target type
+    splitengine::SplitScratch<num_t> numSplitScratch;
+    splitengine::SplitScratch<cat_t> catSplitScratch;
+
+    splitengine::SplitScratch<num_t>& splitScratch(const splitengine::TargetStat<num_t>&) { return( numSplitScratch ); }
+    splitengine::SplitScratch<cat_t>& splitScratch(const splitengine::TargetStat<cat_t>&) { return( catSplitScratch ); }
+
+    // Look-up tables for the splitter names and categories stored in the tree
+    unordered_map<string,uint32_t> splitterIcs;
+    unordered_map<cat_t,uint32_t> categoryIcs;
+
+    // Target column shared by the QRF trees grown with the cache, and the data and
+    // target it was copied from. The column is copied anew for any other target
+    shared_ptr<const vector<num_t> > numTargetData;
+    shared_ptr<const vector<cat_t> > catTargetData;
+    const TreeData* targetDataSource;
+    size_t targetDataIdx;
+
+    // Bootstrap sample of the tree being grown, and the multiplicity of each sample in it
+    vector<size_t> bootstrapIcs;
+    vector<size_t> oobIcs;
+    vector<uint8_t> sampleWeights;
+
+    // Decrease in impurity and minimal depth summed per feature index over the
+    // trees grown with the cache, and the number of those trees splitting with
+    // each feature. Nothing is collected while the vectors are empty. The
+    // impurity is summed in double precision so that the order in which the
+    // threads are merged does not show in the result
+    vector<double> DISums;
+    vector<size_t> minDepthSums;
+    vector<size_t> featureTreeCounts;
+
+    // Depth of each node of the tree being grown, and the smallest depth
+    // at which each splitter of the tree, and its feature index, split
+    vector<uint32_t> nodeDepths;
+    vector<uint32_t> minDepthBySplitter;
+    vector<size_t> splitterFeatureIcs;
+
+    // Sample index buffers released by finished nodes
+    vector<vector<size_t> > sampleIcsPool;
+
+    // Moves the contents of the buffer to sampleIcs, and refills the buffer from the pool
+    void takeSampleIcs(vector<size_t>& buffer, vector<size_t>& sampleIcs) {
+      sampleIcs.swap(buffer);
+      if ( !sampleIcsPool.empty() ) {
+	buffer.swap(sampleIcsPool.back());
+	sampleIcsPool.pop_back();
+      }
+      buffer.clear();
+    }
+
+    void releaseSampleIcs(vector<size_t>& sampleIcs) {
+      sampleIcsPool.push_back(vector<size_t>());
+      sampleIcsPool.back().swap(sampleIcs);
+    }
+
+  };
+
   // Empty tree
   RootNode();
-  
+
   // Learn Tree from data
   RootNode(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random);
 
   // Load tree from file
-  RootNode(ifstream& treeStream);
+  RootNode(istream& treeStream);
 
   ~RootNode();
 
-  void reset(const size_t nNodes);
-  
-  void loadTree(ifstream& treeStream);
-  
+  void reset();
+
+  void loadTree(istream& treeStream);
+
+  // The index of the tree and the seed of its forest are written in the header, if known
   void writeTree(ofstream& toFile);
-  
+
+  // Origin of the tree: its index in the forest and the seed of the forest, which
+  // together determine the random stream the tree was grown from
+  void setOrigin(const size_t treeIdx, const size_t forestSeed);
+  bool hasOrigin() const { return( hasOrigin_ ); }
+  size_t treeIdx() const { return( treeIdx_ ); }
+  size_t forestSeed() const { return( forestSeed_ ); }
+
   void growTree(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random);
-  
-  Node& childRef(const size_t childIdx);
-  
+  void growTree(TreeData* trainData, const size_t targetIdx, const distributions::PMF* pmf, const ForestOptions* forestOptions, distributions::Random* random, SplitCache& splitCache);
+
+  // Draws the bootstrap sample into the cache, and marks the samples left out of the
+  // bag. Growing a tree starts with this, so a tree loaded from file regains its
+  // out-of-bag samples by drawing again from the stream it was grown with
+  void drawBootstrap(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, distributions::Random* random, SplitCache& splitCache);
+
   size_t nNodes() const;
-  
+
   size_t nLeaves() const;
 
-  const Prediction& getPrediction(TreeData* treeData, const size_t sampleIdx);
+  // Descends the tree with the sample and returns the index of the node where the sample ends up
+  size_t percolate(TreeData* testData, const size_t sampleIdx) const;
+
+  // As above, but the values of one feature are read from another sample, as if the feature was permuted
+  size_t percolate(TreeData* testData, const size_t sampleIdx, const size_t scrambleFeatureIdx, const size_t scrambledSampleIdx) const;
+
+  // Feature index of each splitter of the tree in the data, or end() if missing from it
+  void getSplitterFeatureIcs(TreeData* testData, vector<size_t>& splitterFeatureIcs) const;
+
+  // As above, with the splitters resolved once to their feature indices for many samples
+  size_t percolate(TreeData* testData, const size_t sampleIdx, const vector<size_t>& splitterFeatureIcs,
+		   const size_t scrambleFeatureIdx, const size_t scrambledSampleIdx) const;
 
-  vector<num_t> getChildLeafNumTrainData(TreeData* treeData, const size_t sampleIdx);
-  vector<cat_t> getChildLeafCatTrainData(TreeData* treeData, const size_t sampleIdx);
+  num_t getNumTrainPrediction(TreeData* testData, const size_t sampleIdx) const;
+  cat_t getCatTrainPrediction(TreeData* testData, const size_t sampleIdx) const;
 
-  vector<size_t> getOobIcs();
+  // Predictions stored in a node, as returned by percolate()
+  inline num_t getNumTrainPrediction(const size_t nodeIdx) const { return( numTrainPrediction_[nodeIdx] ); }
+  inline const cat_t& getCatTrainPrediction(const size_t nodeIdx) const { return( categories_[ catTrainPrediction_[nodeIdx] ] ); }
 
-  size_t nOobSamples();
+  // Names of the features the tree splits with
+  inline const vector<string>& getSplitterNames() const { return( splitterNames_ ); }
+
+  // Train samples held by the leaves of the subtree of the node, read in place from the target column
+  inline size_t nTrainSamples(const size_t nodeIdx) const { return( trainDataEnd_[nodeIdx] - trainDataBegin_[nodeIdx] ); }
+  inline num_t getNumTrainData(const size_t nodeIdx, const size_t i) const { return( (*numTargetData_)[ trainSampleIcs_[ trainDataBegin_[nodeIdx] + i ] ] ); }
+  inline const cat_t& getCatTrainData(const size_t nodeIdx, const size_t i) const { return( (*catTargetData_)[ trainSampleIcs_[ trainDataBegin_[nodeIdx] + i ] ] ); }
+
+  // Out-of-bag samples of the tree, listed from the membership bitset
+  vector<size_t> getOobIcs() const;
+
+  size_t nOobSamples() const;
+
+  inline bool isOobSample(const size_t sampleIdx) const { return( isOobSample_[sampleIdx] ); }
 
   set<size_t> getFeaturesInTree() { return( featuresInTree_ ); }
 
   string getTargetName() const { return( targetName_ ); }
   bool isTargetNumerical() const { return( isTargetNumerical_ ); }
+  forest_t getForestType() const { return( forestType_ ); }
 
   unordered_map<string,num_t> getDI();
 
@@ -66,25 +201,143 @@ public:
 private:
 #endif
 
+  // Child index of nodes without children; the root is never a child
+  static const uint32_t NO_CHILD = 0;
+
+  // Splitter index of nodes without a splitter
+  static const uint32_t NO_SPLITTER = 0xffffffff;
+
+  // The split value is interpreted according to the type of the splitter
+  union SplitValue {
+    num_t leftLeqValue;
+    uint32_t leftValuesIdx;
+    uint32_t hashValue;
+  };
+
+  // Appends a node without children to the tree and returns its index
+  size_t addNode();
+
+  // Splitter setters append the left and right child to the tree
+  void setSplitter(const size_t nodeIdx,
+		   const num_t splitFitness,
+		   const uint32_t splitterIdx,
+		   const num_t splitLeftLeqValue);
+
+  void setSplitter(const size_t nodeIdx,
+		   const num_t splitFitness,
+		   const uint32_t splitterIdx,
+		   const unordered_set<cat_t>& leftSplitValues,
+		   unordered_map<cat_t,uint32_t>& categoryIcs);
+
+  void setSplitter(const size_t nodeIdx,
+		   const num_t splitFitness,
+		   const uint32_t splitterIdx,
+		   const uint32_t hashIdx);
+
+  void setMissingChild(const size_t nodeIdx);
+
+  inline bool hasChildren(const size_t nodeIdx) const { return( leftChild_[nodeIdx] != NO_CHILD ); }
+  inline size_t leftChild(const size_t nodeIdx) const { return( leftChild_[nodeIdx] ); }
+  inline size_t rightChild(const size_t nodeIdx) const { return( leftChild_[nodeIdx] + 1 ); }
+  inline bool hasMissingChild(const size_t nodeIdx) const { return( missingChild_[nodeIdx] != NO_CHILD ); }
+  inline size_t missingChild(const size_t nodeIdx) const { return( missingChild_[nodeIdx] ); }
+
+  bool isLeftValue(const size_t nodeIdx, const cat_t& value) const;
+
+  // Splitters are looked up by name, unless their feature indices are given
+  size_t percolateNode(TreeData* testData, const size_t sampleIdx, const vector<size_t>* splitterFeatureIcs,
+		       const size_t scrambleFeatureIdx, const size_t scrambledSampleIdx) const;
+
+  uint32_t getSplitterIdx(const string& splitterName, unordered_map<string,uint32_t>& splitterIcs);
+  uint32_t getCategoryIdx(const cat_t& category, unordered_map<cat_t,uint32_t>& categoryIcs);
+
+  // Grows the subtree of the node. sampleWeights holds the multiplicity of
+  // each sample in the bootstrap sample, and stat the sufficient statistics
+  // of the target over sampleIcs, as computed by the parent's split scan
+  template<typename T>
+  void recursiveNodeSplit(const size_t nodeIdx,
+			  TreeData* treeData,
+			  const size_t targetIdx,
+			  const ForestOptions* forestOptions,
+			  distributions::Random* random,
+			  const PredictionFunctionType& predictionFunctionType,
+			  const distributions::PMF* pmf,
+			  const vector<size_t>& sampleIcs,
+			  const vector<uint8_t>& sampleWeights,
+			  const splitengine::TargetStat<T>& stat,
+			  SplitCache& splitCache);
+
+  template<typename T>
+  bool regularSplitterSeek(const size_t nodeIdx,
+			   TreeData* treeData,
+			   const size_t targetIdx,
+			   const ForestOptions* forestOptions,
+			   distributions::Random* random,
+			   const vector<size_t>& sampleIcs,
+			   const vector<uint8_t>& sampleWeights,
+			   SplitCache& splitCache,
+			   splitengine::TargetStat<T>& stat_left,
+			   splitengine::TargetStat<T>& stat_right);
+
+  void setTrainPrediction(const size_t nodeIdx, const splitengine::TargetStat<num_t>& stat, SplitCache& splitCache);
+  void setTrainPrediction(const size_t nodeIdx, const splitengine::TargetStat<cat_t>& stat, SplitCache& splitCache);
+
+  // Appends the samples in the leaf, each sample repeated by its weight
+  void addTrainData(const vector<size_t>& sampleIcs,
+		    const vector<uint8_t>& sampleWeights);
+
+  size_t recursiveSetTrainDataEnd(const size_t nodeIdx);
+
+  // Writes the setup of the tree header, after the TREE field
+  void writeTreeSetup(ofstream& toFile);
+
+  void recursiveWriteTree(const size_t nodeIdx, string& traversal, ofstream& toFile);
+
   size_t getTreeSizeEstimate(const size_t nSamples, const size_t nMaxLeaves, const size_t nodeSize) const;
 
   forest_t forestType_;
   string targetName_;
   bool isTargetNumerical_;
 
-  // Parameters that are generated only when a tree is grown
-  vector<Node> children_;
+  bool hasOrigin_;
+  size_t treeIdx_;
+  size_t forestSeed_;
 
-  size_t nLeaves_;
+  // Per-node arrays. Node 0 is the root, and the right child of a node is
+  // stored right after its left child
+  vector<uint32_t> splitterIdx_;
+  vector<uint8_t> splitterType_;
+  vector<SplitValue> splitValue_;
+  vector<num_t> fitness_;
+  vector<uint32_t> leftChild_;
+  vector<uint32_t> missingChild_;
 
-  vector<size_t> bootstrapIcs_;
-  vector<size_t> oobIcs_;
+  // Predictions are numerical, or indices to categories_, depending on the target
+  vector<num_t> numTrainPrediction_;
+  vector<uint32_t> catTrainPrediction_;
 
-  set<size_t> featuresInTree_;
+  // Range of train data held by the leaves of the subtree of each node
+  vector<uint32_t> trainDataBegin_;
+  vector<uint32_t> trainDataEnd_;
 
-  vector<size_t> minDistToRoot_;
+  // Per-tree tables referenced by the node arrays
+  vector<string> splitterNames_;
+  vector<cat_t> categories_;
+  vector<uint32_t> leftValues_;
+  vector<uint32_t> leftValuesBegin_;
 
-  SplitCache splitCache_;
+  // Samples in the leaves, ordered depth-first, and the target column they index
+  vector<uint32_t> trainSampleIcs_;
+  shared_ptr<const vector<num_t> > numTargetData_;
+  shared_ptr<const vector<cat_t> > catTargetData_;
+
+  size_t nLeaves_;
+
+  // Out-of-bag membership of the train samples, one bit per sample
+  vector<bool> isOobSample_;
+  size_t nOobSamples_;
+
+  set<size_t> featuresInTree_;
 
 };
 
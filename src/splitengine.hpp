@@ -0,0 +1,630 @@
+//splitengine.hpp
+//
+//Split kernels specialized at compile time for the target data type. The
+//kernels operate on raw data vectors, so the inner loops contain neither
+//virtual calls nor runtime checks for the target type.
+
+#ifndef SPLITENGINE_HPP
+#define SPLITENGINE_HPP
+
+#include <cstdlib>
+#include <cassert>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+
+#include "datadefs.hpp"
+#include "math.hpp"
+
+using namespace std;
+using datadefs::num_t;
+using datadefs::cat_t;
+
+namespace splitengine {
+
+  /**
+     Sufficient statistics of the target data residing in one branch.
+     Numerical targets keep the running mean, categorical targets the
+     class frequencies and the sum of squared frequencies. Every sample
+     enters with an integer weight, its multiplicity in the bootstrap
+     sample, so n is the weighted sample count.
+  */
+  template<typename T> struct TargetStat;
+
+  template<> struct TargetStat<num_t> {
+
+    size_t n;
+    num_t mu;
+
+    TargetStat(): n(0), mu(0.0) {}
+
+    TargetStat(const vector<num_t>& tv, const vector<uint8_t>& wv): n(0), mu(0.0) {
+      this->set(tv,wv);
+    }
+
+    TargetStat(const vector<num_t>& data, const vector<size_t>& sampleIcs, const vector<uint8_t>& sampleWeights): n(0), mu(0.0) {
+      for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+	this->add(data[sampleIcs[i]],sampleWeights[sampleIcs[i]]);
+      }
+    }
+
+    inline void add(const num_t x, const size_t w = 1) {
+      n += w;
+      mu += w * ( x - mu ) / n;
+    }
+
+    inline void remove(const num_t x, const size_t w = 1) {
+      n -= w;
+      mu = n > 0 ? mu - w * ( x - mu ) / n : 0.0;
+    }
+
+    // The mean is summed before dividing, unlike with add()
+    inline void set(const vector<num_t>& tv, const vector<uint8_t>& wv) {
+      n = 0;
+      mu = 0.0;
+      for ( size_t i = 0; i < tv.size(); ++i ) {
+	n += wv[i];
+	mu += wv[i] * tv[i];
+      }
+      mu = n > 0 ? mu / n : 0.0;
+    }
+
+    inline void clear() {
+      n = 0;
+      mu = 0.0;
+    }
+
+    inline void assign(const TargetStat<num_t>& other) {
+      n = other.n;
+      mu = other.mu;
+    }
+
+    inline void swap(TargetStat<num_t>& other) {
+      std::swap(n,other.n);
+      std::swap(mu,other.mu);
+    }
+
+  };
+
+  template<> struct TargetStat<cat_t> {
+
+    size_t n;
+    size_t sf;
+    unordered_map<cat_t,size_t> freq;
+
+    TargetStat(): n(0), sf(0) {}
+
+    TargetStat(const vector<cat_t>& tv, const vector<uint8_t>& wv): n(0), sf(0), freq(tv.size()) {
+      for ( size_t i = 0; i < tv.size(); ++i ) {
+	this->add(tv[i],wv[i]);
+      }
+    }
+
+    TargetStat(const vector<cat_t>& data, const vector<size_t>& sampleIcs, const vector<uint8_t>& sampleWeights): n(0), sf(0) {
+      for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+	this->add(data[sampleIcs[i]],sampleWeights[sampleIcs[i]]);
+      }
+    }
+
+    // Categories stay in the table at zero frequency, so statistics that are
+    // reused stop allocating once they have seen every category. A weight w
+    // changes the squared frequency by ( f + w )^2 - f^2 at once
+    inline void add(const cat_t& x, const size_t w = 1) {
+      size_t& f = freq[x];
+      sf += 2*f*w + w*w;
+      f += w;
+      n += w;
+    }
+
+    inline void remove(const cat_t& x, const size_t w = 1) {
+      unordered_map<cat_t,size_t>::iterator it( freq.find(x) );
+      assert( it != freq.end() && it->second >= w );
+      sf -= 2*it->second*w - w*w;
+      it->second -= w;
+      n -= w;
+    }
+
+    inline void set(const vector<cat_t>& tv, const vector<uint8_t>& wv) {
+      this->clear();
+      for ( size_t i = 0; i < tv.size(); ++i ) {
+	this->add(tv[i],wv[i]);
+      }
+    }
+
+    inline void clear() {
+      for ( unordered_map<cat_t,size_t>::iterator it(freq.begin()); it != freq.end(); ++it ) {
+	it->second = 0;
+      }
+      n = 0;
+      sf = 0;
+    }
+
+    inline void assign(const TargetStat<cat_t>& other) {
+      this->clear();
+      for ( unordered_map<cat_t,size_t>::const_iterator it(other.freq.begin()); it != other.freq.end(); ++it ) {
+	if ( it->second > 0 ) {
+	  freq[it->first] = it->second;
+	}
+      }
+      n = other.n;
+      sf = other.sf;
+    }
+
+    inline void swap(TargetStat<cat_t>& other) {
+      std::swap(n,other.n);
+      std::swap(sf,other.sf);
+      freq.swap(other.freq);
+    }
+
+  };
+
+  // Node predictions derived from the sufficient statistics in O(1)
+  inline num_t prediction(const TargetStat<num_t>& stat) {
+    return( stat.mu );
+  }
+
+  // Ties go to the smallest category, so that the prediction does not depend
+  // on the order of the table, which varies with the history of reused statistics
+  inline cat_t prediction(const TargetStat<cat_t>& stat) {
+    unordered_map<cat_t,size_t>::const_iterator maxElement( stat.freq.end() );
+    for ( unordered_map<cat_t,size_t>::const_iterator it(stat.freq.begin()); it != stat.freq.end(); ++it ) {
+      if ( it->second == 0 ) {
+	continue;
+      }
+      if ( maxElement == stat.freq.end() || it->second > maxElement->second ||
+	   ( it->second == maxElement->second && it->first < maxElement->first ) ) {
+	maxElement = it;
+      }
+    }
+    return( maxElement != stat.freq.end() ? maxElement->first : datadefs::STR_NAN );
+  }
+
+  /**
+     Samples grouped by the category of their feature value, in the order
+     the categories first appear. The table of categories is kept between
+     features and stamped with the pass that filled each entry, so that
+     clearing the groups frees nothing and refilling them allocates only
+     for categories never seen before.
+  */
+  struct CategoryGroups {
+
+    size_t pass;
+    size_t nGroups;
+
+    // Pass and group index of each category seen so far
+    unordered_map<cat_t,pair<size_t,size_t> > groupIcs;
+
+    // Category, sample positions, and branch of each group of the current pass
+    vector<cat_t> categories;
+    vector<vector<size_t> > positions;
+    vector<bool> isLeft;
+
+    CategoryGroups(): pass(0), nGroups(0) {}
+
+    inline void clear() {
+      ++pass;
+      nGroups = 0;
+    }
+
+    // Returns the group of the category, which is added if new to the pass
+    inline size_t add(const cat_t& cat) {
+      pair<size_t,size_t>& entry = groupIcs[cat];
+      if ( entry.first != pass ) {
+	entry.first = pass;
+	entry.second = nGroups;
+	if ( nGroups == positions.size() ) {
+	  categories.push_back(cat);
+	  positions.push_back(vector<size_t>());
+	  isLeft.push_back(false);
+	} else {
+	  categories[nGroups] = cat;
+	  positions[nGroups].clear();
+	  isLeft[nGroups] = false;
+	}
+	++nGroups;
+      }
+      return( entry.second );
+    }
+
+    // Returns the group of the category, or MAX_IDX if not in the current pass
+    inline size_t find(const cat_t& cat) const {
+      unordered_map<cat_t,pair<size_t,size_t> >::const_iterator it( groupIcs.find(cat) );
+      if ( it == groupIcs.end() || it->second.first != pass ) {
+	return( datadefs::MAX_IDX );
+      }
+      return( it->second.second );
+    }
+
+  };
+
+  /**
+     Buffers of the split kernels, reused from one candidate to the next.
+     The statistics of the branches of the candidate being evaluated are
+     kept here as well, and the statistics of the best candidate are
+     swapped out of them rather than copied.
+  */
+  template<typename T>
+  struct SplitScratch {
+
+    // Feature values of the real samples paired with the sample indices, for sorting
+    vector<pair<num_t,size_t> > sortPairs;
+
+    vector<num_t> fv;
+    vector<cat_t> cv;
+    vector<T> tv;
+    vector<uint8_t> wv;
+
+    CategoryGroups catGroups;
+
+    TargetStat<T> tot;
+    TargetStat<T> left;
+    TargetStat<T> right;
+
+  };
+
+  inline num_t deltaImpurity(const TargetStat<num_t>& tot,
+			     const TargetStat<num_t>& left,
+			     const TargetStat<num_t>& right) {
+    return( math::deltaImpurity_regr(tot.mu,tot.n,left.mu,left.n,right.mu,right.n) );
+  }
+
+  inline num_t deltaImpurity(const TargetStat<cat_t>& tot,
+			     const TargetStat<cat_t>& left,
+			     const TargetStat<cat_t>& right) {
+    return( math::deltaImpurity_class(tot.sf,tot.n,left.sf,left.n,right.sf,right.n) );
+  }
+
+  /**
+     Finds the best split point for target data tv with sample weights wv,
+     given feature data fv sorted in increasing order. splitIdx will point
+     to the last sample on the left branch, and the statistics of the best
+     split are stored in stat_left and stat_right, which also serve as the
+     running statistics of the scan along with tot.
+  */
+  template<typename T>
+  num_t numericalFeatureSplit(const vector<T>& tv,
+			      const vector<num_t>& fv,
+			      const vector<uint8_t>& wv,
+			      const size_t minSamples,
+			      size_t& splitIdx,
+			      TargetStat<T>& tot,
+			      TargetStat<T>& stat_left,
+			      TargetStat<T>& stat_right) {
+
+    assert( tv.size() == fv.size() );
+    assert( tv.size() == wv.size() );
+
+    size_t n_tot = tv.size();
+
+    // We start with all samples on the right branch
+    TargetStat<T>& left = stat_left;
+    TargetStat<T>& right = stat_right;
+
+    tot.set(tv,wv);
+    left.clear();
+    right.assign(tot);
+
+    size_t bestSplitIdx = datadefs::MAX_IDX;
+    num_t DI_best = 0.0;
+
+    // Add samples one by one from right to left until we hit the
+    // minimum allowed size of the branch
+    for ( size_t i = 0; i < n_tot; ++i ) {
+
+      left.add(tv[i],wv[i]);
+      right.remove(tv[i],wv[i]);
+
+      if ( right.n < minSamples ) {
+	break;
+      }
+
+      // Samples with equal feature values cannot be split apart
+      if ( left.n < minSamples || ( i + 1 < n_tot && fv[ i + 1 ] == fv[ i ] ) ) {
+	continue;
+      }
+
+      // If the current split point yields a better split than the best,
+      // update DI_best and splitIdx
+      num_t DI = deltaImpurity(tot,left,right);
+
+      if ( DI > DI_best ) {
+	bestSplitIdx = i;
+	DI_best = DI;
+      }
+
+    }
+
+    if ( bestSplitIdx == datadefs::MAX_IDX ) {
+      return( DI_best );
+    }
+
+    // The statistics of the best split are replayed with the same updates as
+    // in the scan, which is cheaper than copying them at every improvement
+    splitIdx = bestSplitIdx;
+
+    left.clear();
+    right.assign(tot);
+
+    for ( size_t i = 0; i <= splitIdx; ++i ) {
+      left.add(tv[i],wv[i]);
+      right.remove(tv[i],wv[i]);
+    }
+
+    return( DI_best );
+
+  }
+
+  /**
+     Finds the best split of the categories of fv, with sample weights wv.
+     Categories are tested for moving from right to left in the order
+     given by catOrder. The categories moved to the left are flagged in
+     catGroups, and the statistics of the resulting branches are stored
+     in stat_left and stat_right.
+  */
+  template<typename T>
+  num_t categoricalFeatureSplit(const vector<T>& tv,
+				const vector<cat_t>& fv,
+				const vector<uint8_t>& wv,
+				const size_t minSamples,
+				const vector<cat_t>& catOrder,
+				CategoryGroups& catGroups,
+				TargetStat<T>& tot,
+				TargetStat<T>& stat_left,
+				TargetStat<T>& stat_right) {
+
+    catGroups.clear();
+    for ( size_t i = 0; i < fv.size(); ++i ) {
+      size_t groupIdx = catGroups.add(fv[i]);
+      catGroups.positions[groupIdx].push_back(i);
+    }
+
+    TargetStat<T>& left = stat_left;
+    TargetStat<T>& right = stat_right;
+
+    tot.set(tv,wv);
+    left.clear();
+    right.assign(tot);
+
+    num_t DI_best = 0.0;
+
+    for ( size_t i = 0; i < catOrder.size(); ++i ) {
+
+      size_t groupIdx = catGroups.find(catOrder[i]);
+
+      assert( groupIdx != datadefs::MAX_IDX );
+
+      const vector<size_t>& ics = catGroups.positions[groupIdx];
+
+      size_t n_cat = 0;
+      for ( size_t j = 0; j < ics.size(); ++j ) {
+	n_cat += wv[ ics[j] ];
+      }
+
+      if ( right.n - n_cat < minSamples ) {
+	continue;
+      }
+
+      for ( size_t j = 0; j < ics.size(); ++j ) {
+	left.add(tv[ ics[j] ],wv[ ics[j] ]);
+	right.remove(tv[ ics[j] ],wv[ ics[j] ]);
+      }
+
+      num_t DI = deltaImpurity(tot,left,right);
+
+      if ( DI > DI_best ) {
+
+	DI_best = DI;
+
+	catGroups.isLeft[groupIdx] = true;
+
+      } else {
+
+	for ( size_t j = 0; j < ics.size(); ++j ) {
+	  left.remove(tv[ ics[j] ],wv[ ics[j] ]);
+	  right.add(tv[ ics[j] ],wv[ ics[j] ]);
+	}
+
+      }
+    }
+
+    return( DI_best );
+
+  }
+
+  /**
+     Evaluates the split of samples based on whether they contain hashIdx
+     in the textual data txtData. Samples with missing data are skipped.
+     The statistics of the branches are stored in stat_left and stat_right.
+  */
+  template<typename T>
+  num_t textualFeatureSplit(const vector<T>& targetData,
+			    const vector<unordered_set<uint32_t> >& txtData,
+			    const uint32_t hashIdx,
+			    const vector<size_t>& sampleIcs,
+			    const vector<uint8_t>& sampleWeights,
+			    TargetStat<T>& stat_left,
+			    TargetStat<T>& stat_right) {
+
+    TargetStat<T> tot;
+    TargetStat<T>& left = stat_left;
+    TargetStat<T>& right = stat_right;
+
+    left = TargetStat<T>();
+    right = TargetStat<T>();
+
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      const unordered_set<uint32_t>& hs = txtData[sampleIcs[i]];
+      if ( hs.size() == 0 ) {
+	continue;
+      }
+      const T& x = targetData[sampleIcs[i]];
+      const size_t w = sampleWeights[sampleIcs[i]];
+      if ( hs.find(hashIdx) != hs.end() ) {
+	left.add(x,w);
+      } else {
+	right.add(x,w);
+      }
+      tot.add(x,w);
+    }
+
+    return( deltaImpurity(tot,left,right) );
+
+  }
+
+  /**
+     Evaluates a randomized split of the samples with numerical feature
+     data featureData. The threshold is placed at the relative position u
+     in [0,1) between the smallest and largest feature value, so that
+     splitValue = min + u * ( max - min ). Samples with missing data are
+     skipped. The split is scored in one linear pass without sorting, and
+     the statistics of the branches are stored in stat_left and stat_right.
+  */
+  template<typename T>
+  num_t randomNumericalFeatureSplit(const vector<T>& targetData,
+				    const vector<num_t>& featureData,
+				    const vector<size_t>& sampleIcs,
+				    const vector<uint8_t>& sampleWeights,
+				    const num_t u,
+				    num_t& splitValue,
+				    TargetStat<T>& stat_left,
+				    TargetStat<T>& stat_right) {
+
+    num_t minValue = datadefs::NUM_NAN;
+    num_t maxValue = datadefs::NUM_NAN;
+
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      num_t x = featureData[sampleIcs[i]];
+      if ( datadefs::isNAN(x) ) {
+	continue;
+      }
+      if ( datadefs::isNAN(minValue) || x < minValue ) {
+	minValue = x;
+      }
+      if ( datadefs::isNAN(maxValue) || x > maxValue ) {
+	maxValue = x;
+      }
+    }
+
+    // Constant or entirely missing features cannot split the samples
+    if ( datadefs::isNAN(minValue) || !( minValue < maxValue ) ) {
+      return( 0.0 );
+    }
+
+    splitValue = minValue + u * ( maxValue - minValue );
+
+    TargetStat<T> tot;
+    TargetStat<T>& left = stat_left;
+    TargetStat<T>& right = stat_right;
+
+    left = TargetStat<T>();
+    right = TargetStat<T>();
+
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      num_t x = featureData[sampleIcs[i]];
+      if ( datadefs::isNAN(x) ) {
+	continue;
+      }
+      const T& y = targetData[sampleIcs[i]];
+      const size_t w = sampleWeights[sampleIcs[i]];
+      if ( x <= splitValue ) {
+	left.add(y,w);
+      } else {
+	right.add(y,w);
+      }
+      tot.add(y,w);
+    }
+
+    if ( left.n == 0 || right.n == 0 ) {
+      return( 0.0 );
+    }
+
+    return( deltaImpurity(tot,left,right) );
+
+  }
+
+  /**
+     Evaluates the split of the samples that sends the categories in
+     splitValues_left to the left branch and the rest to the right.
+     Samples with missing data are skipped. The statistics of the branches
+     are stored in stat_left and stat_right.
+  */
+  template<typename T>
+  num_t categoricalFeatureSubsetSplit(const vector<T>& targetData,
+				      const vector<cat_t>& featureData,
+				      const vector<size_t>& sampleIcs,
+				      const vector<uint8_t>& sampleWeights,
+				      const unordered_set<cat_t>& splitValues_left,
+				      TargetStat<T>& stat_left,
+				      TargetStat<T>& stat_right) {
+
+    TargetStat<T> tot;
+    TargetStat<T>& left = stat_left;
+    TargetStat<T>& right = stat_right;
+
+    left = TargetStat<T>();
+    right = TargetStat<T>();
+
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      const cat_t& x = featureData[sampleIcs[i]];
+      if ( datadefs::isNAN(x) ) {
+	continue;
+      }
+      const T& y = targetData[sampleIcs[i]];
+      const size_t w = sampleWeights[sampleIcs[i]];
+      if ( splitValues_left.find(x) != splitValues_left.end() ) {
+	left.add(y,w);
+      } else {
+	right.add(y,w);
+      }
+      tot.add(y,w);
+    }
+
+    if ( left.n == 0 || right.n == 0 ) {
+      return( 0.0 );
+    }
+
+    return( deltaImpurity(tot,left,right) );
+
+  }
+
+  // Textual data is missing when the sample has no hashes
+  template<typename T>
+  inline bool isMissing(const T& x) {
+    return( datadefs::isNAN(x) );
+  }
+
+  template<>
+  inline bool isMissing(const unordered_set<uint32_t>& x) {
+    return( x.size() == 0 );
+  }
+
+  /**
+     Moves samples which have missing values in data from sampleIcs to
+     missingIcs, preserving the order of both.
+  */
+  template<typename T>
+  void separateMissingSamples(const vector<T>& data,
+			      vector<size_t>& sampleIcs,
+			      vector<size_t>& missingIcs) {
+
+    size_t nReal = 0;
+    size_t nMissing = 0;
+
+    missingIcs.resize(sampleIcs.size());
+
+    for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
+      if ( !isMissing(data[sampleIcs[i]]) ) {
+	sampleIcs[nReal++] = sampleIcs[i];
+      } else {
+	missingIcs[nMissing++] = sampleIcs[i];
+      }
+    }
+
+    sampleIcs.resize(nReal);
+    missingIcs.resize(nMissing);
+
+  }
+
+}
+
+#endif
@@ -2,11 +2,17 @@
 #include <ctime>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <cstdio>
 #include <iomanip>
 #include <stack>
+#include <algorithm>
+#include <unordered_map>
+#include <set>
 
 #ifndef NOTHREADS
 #include <thread>
+#include <mutex>
 #endif
 
 #include "stochasticforest.hpp"
@@ -17,7 +23,36 @@
 #include "options.hpp"
 
 StochasticForest::StochasticForest() :
-  forestType_(datadefs::forest_t::UNKNOWN) {
+  forestType_(datadefs::forest_t::UNKNOWN),
+  trainData_(NULL),
+  targetIdx_(0),
+  forestOptions_(NULL),
+  forestSeed_(0),
+  treeStream_(NULL),
+  evictTrees_(false),
+  isInOrder_(false),
+  nextTreeIdx_(0),
+  oobError_(datadefs::NUM_NAN) {
+}
+
+#ifndef NOTHREADS
+// Forests growing in parallel may append to the same stream
+static mutex treeStreamLock;
+#endif
+
+void StochasticForest::setTreeStream(ofstream* treeStream, const bool evictTrees, const bool isInOrder) {
+  treeStream_ = treeStream;
+  evictTrees_ = treeStream && evictTrees;
+  isInOrder_ = isInOrder;
+}
+
+bool StochasticForest::hasEvictedTrees() const {
+  for ( size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx ) {
+    if ( !rootNodes_[treeIdx] ) {
+      return( true );
+    }
+  }
+  return( false );
 }
 
 void StochasticForest::loadForest(const string& fileName) {
@@ -25,12 +60,118 @@ void StochasticForest::loadForest(const string& fileName) {
   ifstream forestStream(fileName.c_str());
   assert(forestStream.good());
 
+  // The impurity sums of grown trees do not cover the loaded ones
+  DISums_.clear();
+  minDepthSums_.clear();
+  featureTreeCounts_.clear();
+
   while ( forestStream.good() ) {
     rootNodes_.push_back( new RootNode(forestStream) );
   }
 
 }
 
+size_t StochasticForest::mergeForestFiles(const vector<string>& fileNames, const string& mergedFileName) {
+
+  // The merged forest replaces its file only once all inputs are read, since the file may be one of them
+  string tmpFileName = mergedFileName + ".tmp";
+
+  ofstream toFile(tmpFileName.c_str());
+
+  if ( !toFile.good() ) {
+    cerr << "StochasticForest::mergeForestFiles() -- could not open file '" << tmpFileName << "' for writing" << endl;
+    exit(1);
+  }
+
+  // Setup of the first tree, which the other trees are validated against
+  map<string,string> forestSetup;
+
+  // Seeds and indices of the trees merged so far. The same pair means the same tree
+  set<pair<string,string> > treeOrigins;
+
+  size_t nTrees = 0;
+
+  for ( size_t fileIdx = 0; fileIdx < fileNames.size(); ++fileIdx ) {
+
+    ifstream forestStream(fileNames[fileIdx].c_str());
+
+    if ( !forestStream.good() ) {
+      cerr << "StochasticForest::mergeForestFiles() -- could not open forest file '" << fileNames[fileIdx] << "'" << endl;
+      remove(tmpFileName.c_str());
+      exit(1);
+    }
+
+    string newLine;
+    size_t nFileTrees = 0;
+
+    while ( getline(forestStream,newLine) ) {
+
+      newLine = utils::chomp(newLine);
+
+      if ( newLine == "" ) {
+	continue;
+      }
+
+      if ( newLine.compare(0,5,"TREE=") == 0 ) {
+
+	map<string,string> treeSetup = utils::parse(newLine,',','=','"');
+
+	// Boosted trees fit the residuals of the trees before them, so they cannot be pooled
+	if ( treeSetup["FOREST"] == "GBT" ) {
+	  cerr << "StochasticForest::mergeForestFiles() -- GBT forests cannot be merged, found one in '" << fileNames[fileIdx] << "'" << endl;
+	  remove(tmpFileName.c_str());
+	  exit(1);
+	}
+
+	if ( nTrees == 0 ) {
+	  forestSetup = treeSetup;
+	}
+
+	const char* keys[] = { "TARGET", "FOREST", "ISTARGETNUMERICAL" };
+
+	for ( size_t i = 0; i < 3; ++i ) {
+	  if ( treeSetup[keys[i]] != forestSetup[keys[i]] ) {
+	    cerr << "StochasticForest::mergeForestFiles() -- tree in '" << fileNames[fileIdx] << "' has " << keys[i] << "="
+		 << treeSetup[keys[i]] << ", but the first tree has " << keys[i] << "=" << forestSetup[keys[i]] << endl;
+	    remove(tmpFileName.c_str());
+	    exit(1);
+	  }
+	}
+
+	if ( treeSetup["TREE"] != "" && treeSetup["SEED"] != "" &&
+	     !treeOrigins.insert( make_pair(treeSetup["SEED"],treeSetup["TREE"]) ).second ) {
+	  cerr << "StochasticForest::mergeForestFiles() -- tree " << treeSetup["TREE"] << " of the forest with seed " << treeSetup["SEED"]
+	       << " is found twice, last in '" << fileNames[fileIdx] << "'. Use different seeds or tree offsets for the forests" << endl;
+	  remove(tmpFileName.c_str());
+	  exit(1);
+	}
+
+	++nTrees;
+	++nFileTrees;
+
+      } else if ( nFileTrees == 0 ) {
+	cerr << "StochasticForest::mergeForestFiles() -- '" << fileNames[fileIdx] << "' does not start with a tree" << endl;
+	remove(tmpFileName.c_str());
+	exit(1);
+      }
+
+      toFile << newLine << endl;
+
+    }
+
+  }
+
+  toFile.close();
+
+  if ( rename(tmpFileName.c_str(),mergedFileName.c_str()) != 0 ) {
+    cerr << "StochasticForest::mergeForestFiles() -- could not move '" << tmpFileName << "' to '" << mergedFileName << "'" << endl;
+    exit(1);
+  }
+
+  return( nTrees );
+
+}
+
 StochasticForest::~StochasticForest() {
   
   for (size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx) {
@@ -41,10 +182,15 @@ StochasticForest::~StochasticForest() {
 
 /* Prints the forest into a file, so that the forest can be loaded for later use (e.g. prediction).
  */
-void StochasticForest::writeForest(ofstream& toFile) {
+void StochasticForest::writeForest(ofstream& toFile, const size_t firstTreeIdx) {
+
+  if ( this->hasEvictedTrees() ) {
+    cerr << "StochasticForest::writeForest() -- the trees were freed once written to file" << endl;
+    exit(1);
+  }
   
   // Save each tree in the forest
-  for (size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx) {
+  for (size_t treeIdx = firstTreeIdx; treeIdx < rootNodes_.size(); ++treeIdx) {
     //toFile << "TREE=" << treeIdx << ",NNODES=" << rootNodes_[treeIdx]->nNodes() << ",NLEAVES=" << rootNodes_[treeIdx]->nLeaves() << endl;
     rootNodes_[treeIdx]->writeTree(toFile);
   }
@@ -54,28 +200,22 @@ void StochasticForest::writeForest(ofstream& toFile) {
 
 }
 
-void growTreesPerThread(vector<RootNode*>& rootNodes, TreeData* trainData,
-    const size_t targetIdx, const ForestOptions* forestOptions,
-    const distributions::PMF* pmf, distributions::Random* random) {
-
-  for (size_t i = 0; i < rootNodes.size(); ++i) {
-    rootNodes[i]->growTree(trainData, targetIdx, pmf, forestOptions, random);
-  }
-
+StochasticForest::OobAccumulator::OobAccumulator(const size_t nSamples, const size_t nCategories):
+  numPredictionSum(nSamples,0.0),
+  nPredictions(nSamples,0),
+  catVotes(nSamples*nCategories,0) {
 }
 
-void StochasticForest::learnRF(TreeData* trainData, 
+void StochasticForest::beginRF(TreeData* trainData,
 			       const size_t targetIdx,
-			       const ForestOptions* forestOptions, 
+			       const ForestOptions* forestOptions,
 			       const vector<num_t>& featureWeights,
-			       vector<distributions::Random>& randoms) {
+			       const size_t forestSeed,
+			       const size_t nWorkers) {
 
   assert(forestOptions->forestType != forest_t::GBT );
 
   forestType_ = forestOptions->forestType;
-  string targetName = trainData->feature(targetIdx)->name();
-  //bool isTargetNumerical = trainData->feature(targetIdx)->isNumerical();
-  //categories_ = trainData->feature(targetIdx)->categories();
 
   assert(trainData->nFeatures() == featureWeights.size());
 
@@ -84,75 +224,671 @@ void StochasticForest::learnRF(TreeData* trainData,
     exit(1);
   }
 
-  rootNodes_.resize(forestOptions->nTrees);
-
-  distributions::PMF pmf(featureWeights);
-
   if (forestOptions->isRandomSplit && forestOptions->mTry == 0) {
     cerr << "StochasticForest::learnRF() -- for randomized splits mTry must be greater than 0" << endl;
     exit(1);
   }
 
-  size_t nThreads = randoms.size();
+  assert(forestOptions->nTrees > 0);
+  assert(nWorkers > 0);
+
+  // Trees left from a previous call are grown again in place, reusing their storage
+  for ( size_t treeIdx = forestOptions->nTrees; treeIdx < rootNodes_.size(); ++treeIdx ) {
+    delete rootNodes_[treeIdx];
+  }
+
+  rootNodes_.resize(forestOptions->nTrees,NULL);
+
+  for ( size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx ) {
+    if ( !rootNodes_[treeIdx] ) {
+      rootNodes_[treeIdx] = new RootNode();
+    }
+  }
+
+  trainData_ = trainData;
+  targetIdx_ = targetIdx;
+  forestOptions_ = forestOptions;
+  forestSeed_ = forestSeed;
+
+  nextTreeIdx_ = 0;
+  waitingTreeIcs_.clear();
+  pmf_ = make_shared<distributions::PMF>(featureWeights);
+
+  // The scratch space is private to each worker, but the QRF trees of all workers
+  // share one copy of the target column
+  splitCaches_.resize(nWorkers);
+
+  shared_ptr<const vector<num_t> > numTargetData;
+  shared_ptr<const vector<cat_t> > catTargetData;
+
+  if ( forestType_ == forest_t::QRF ) {
+    if ( trainData->feature(targetIdx)->isNumerical() ) {
+      numTargetData = make_shared<const vector<num_t> >(trainData->feature(targetIdx)->numData);
+    } else {
+      catTargetData = make_shared<const vector<cat_t> >(trainData->feature(targetIdx)->catData);
+    }
+  }
+
+  // Every worker sums the decrease in impurity and minimal depth into its own dense vectors,
+  // covering the contrasts as well
+  size_t nAllFeatures = trainData->nAllFeatures();
+
+  for ( size_t workerIdx = 0; workerIdx < nWorkers; ++workerIdx ) {
+    splitCaches_[workerIdx].numTargetData = numTargetData;
+    splitCaches_[workerIdx].catTargetData = catTargetData;
+    splitCaches_[workerIdx].targetDataSource = trainData;
+    splitCaches_[workerIdx].targetDataIdx = targetIdx;
+    splitCaches_[workerIdx].DISums.assign(nAllFeatures,0.0);
+    splitCaches_[workerIdx].minDepthSums.assign(nAllFeatures,0);
+    splitCaches_[workerIdx].featureTreeCounts.assign(nAllFeatures,0);
+  }
+
+  const Feature* target = trainData->feature(targetIdx);
+
+  targetCategories_.clear();
+  targetCategoryIcs_.clear();
+
+  if ( !target->isNumerical() ) {
+    targetCategories_ = target->categories();
+    for ( size_t i = 0; i < targetCategories_.size(); ++i ) {
+      targetCategoryIcs_[ targetCategories_[i] ] = i;
+    }
+  }
+
+  oobAccumulators_.assign(nWorkers,OobAccumulator(trainData->nSamples(),targetCategories_.size()));
+
+}
+
+// Each tree draws from its own stream, seeded by the forest seed and the index
+// of the tree, so the trees do not depend on how they are divided among workers.
+// The index counts from the tree offset, so that runs with the same seed and
+// different offsets grow different trees of the same forest
+void StochasticForest::growTree(const size_t treeIdx, const size_t workerIdx) {
+
+  RootNode* rootNode = rootNodes_[treeIdx];
+  RootNode::SplitCache& splitCache = splitCaches_[workerIdx];
+
+  size_t forestTreeIdx = forestOptions_->treeOffset + treeIdx;
+
+  distributions::Random random( distributions::streamSeed(forestSeed_,forestTreeIdx) );
+
+  rootNode->growTree(trainData_, targetIdx_, pmf_.get(), forestOptions_, &random, splitCache);
+  rootNode->setOrigin(forestTreeIdx,forestSeed_);
+
+  // The samples left out of the bag are predicted while the tree is fresh
+  this->addOobPredictions(treeIdx,workerIdx);
+
+  if ( treeStream_ ) {
+    this->writeTree(treeIdx);
+  }
+
+}
+
+// The decrease in impurity is recovered from the splits of the tree
+void StochasticForest::addTreeDI(RootNode* rootNode, vector<double>& DISums, vector<size_t>& featureTreeCounts) {
+
+  unordered_map<string,num_t> DIByFeature = rootNode->getDI();
+
+  for ( unordered_map<string,num_t>::const_iterator it(DIByFeature.begin()); it != DIByFeature.end(); ++it ) {
+    size_t featureIdx = trainData_->getFeatureIdx(it->first);
+    if ( featureIdx != trainData_->end() ) {
+      DISums[featureIdx] += it->second;
+      ++featureTreeCounts[featureIdx];
+    }
+  }
+
+}
+
+void StochasticForest::writeTree(const size_t treeIdx) {
+
+#ifndef NOTHREADS
+  lock_guard<mutex> lock(treeStreamLock);
+#endif
+
+  // In order a tree waits for the trees before it, otherwise it is written at once
+  waitingTreeIcs_.insert(treeIdx);
+
+  if ( !isInOrder_ ) {
+    nextTreeIdx_ = treeIdx;
+  }
+
+  while ( waitingTreeIcs_.erase(nextTreeIdx_) ) {
+
+    rootNodes_[nextTreeIdx_]->writeTree(*treeStream_);
+
+    if ( evictTrees_ ) {
+      delete rootNodes_[nextTreeIdx_];
+      rootNodes_[nextTreeIdx_] = NULL;
+    }
+
+    ++nextTreeIdx_;
+  }
+
+  treeStream_->flush();
+
+}
+
+void StochasticForest::addOobPredictions(const size_t treeIdx, const size_t workerIdx) {
+
+  RootNode* rootNode = rootNodes_[treeIdx];
+  OobAccumulator& oobAccumulator = oobAccumulators_[workerIdx];
+
+  bool isTargetNumerical = trainData_->feature(targetIdx_)->isNumerical();
+  size_t nCategories = targetCategories_.size();
+
+  const vector<size_t>& oobIcs = splitCaches_[workerIdx].oobIcs;
+
+  for ( size_t j = 0; j < oobIcs.size(); ++j ) {
+    size_t sampleIdx = oobIcs[j];
+    if ( isTargetNumerical ) {
+      oobAccumulator.numPredictionSum[sampleIdx] += rootNode->getNumTrainPrediction(trainData_,sampleIdx);
+    } else {
+      size_t categoryIdx = targetCategoryIcs_.find(rootNode->getCatTrainPrediction(trainData_,sampleIdx))->second;
+      ++oobAccumulator.catVotes[ sampleIdx * nCategories + categoryIdx ];
+    }
+    ++oobAccumulator.nPredictions[sampleIdx];
+  }
+
+}
+
+void StochasticForest::growTrees(const vector<size_t> treeIcs, const size_t workerIdx) {
+  for ( size_t i = 0; i < treeIcs.size(); ++i ) {
+    this->growTree(treeIcs[i],workerIdx);
+  }
+}
+
+void StochasticForest::updateOobError() {
+
+  const Feature* target = trainData_->feature(targetIdx_);
+
+  size_t nSamples = trainData_->nSamples();
+  size_t nWorkers = oobAccumulators_.size();
+
+  // Merge the per-worker accumulators into out-of-bag predictions, and
+  // compare them with the true target values. The accumulators may keep
+  // collecting afterwards, so they are merged into a copy
+  OobAccumulator oob(oobAccumulators_[0]);
+
+  for ( size_t workerIdx = 1; workerIdx < nWorkers; ++workerIdx ) {
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      oob.numPredictionSum[i] += oobAccumulators_[workerIdx].numPredictionSum[i];
+      oob.nPredictions[i] += oobAccumulators_[workerIdx].nPredictions[i];
+    }
+    for ( size_t i = 0; i < oob.catVotes.size(); ++i ) {
+      oob.catVotes[i] += oobAccumulators_[workerIdx].catVotes[i];
+    }
+  }
+
+  num_t oobErrorSum = 0.0;
+  size_t nOobSamples = 0;
+
+  if ( target->isNumerical() ) {
+
+    numOobPredictions_.assign(nSamples,datadefs::NUM_NAN);
+    catOobPredictions_.clear();
+
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      if ( oob.nPredictions[i] > 0 ) {
+	numOobPredictions_[i] = oob.numPredictionSum[i] / oob.nPredictions[i];
+	oobErrorSum += pow(numOobPredictions_[i] - target->numData[i],2);
+	++nOobSamples;
+      }
+    }
+
+  } else {
+
+    size_t nCategories = targetCategories_.size();
+
+    catOobPredictions_.assign(nSamples,datadefs::STR_NAN);
+    numOobPredictions_.clear();
+
+    for ( size_t i = 0; i < nSamples; ++i ) {
+      if ( oob.nPredictions[i] > 0 ) {
+	vector<size_t>::const_iterator votes( oob.catVotes.begin() + i * nCategories );
+	catOobPredictions_[i] = targetCategories_[ max_element(votes,votes + nCategories) - votes ];
+	oobErrorSum += catOobPredictions_[i] != target->catData[i] ? 1.0 : 0.0;
+	++nOobSamples;
+      }
+    }
+
+  }
+
+  // Mean squared error for numerical and misclassification rate for categorical targets
+  oobError_ = nOobSamples > 0 ? oobErrorSum / nOobSamples : datadefs::NUM_NAN;
+
+}
+
+void StochasticForest::endRF(const size_t nGrownTrees) {
+
+  assert( nGrownTrees <= rootNodes_.size() );
+
+  this->updateOobError();
+
+  size_t nWorkers = splitCaches_.size();
+  size_t nAllFeatures = splitCaches_[0].DISums.size();
+
+  DISums_.swap(splitCaches_[0].DISums);
+  minDepthSums_.swap(splitCaches_[0].minDepthSums);
+  featureTreeCounts_.swap(splitCaches_[0].featureTreeCounts);
+
+  for ( size_t workerIdx = 1; workerIdx < nWorkers; ++workerIdx ) {
+    for ( size_t featureIdx = 0; featureIdx < nAllFeatures; ++featureIdx ) {
+      DISums_[featureIdx] += splitCaches_[workerIdx].DISums[featureIdx];
+      minDepthSums_[featureIdx] += splitCaches_[workerIdx].minDepthSums[featureIdx];
+      featureTreeCounts_[featureIdx] += splitCaches_[workerIdx].featureTreeCounts[featureIdx];
+    }
+  }
+
+  // Trees that were not needed are dropped from the forest
+  for ( size_t treeIdx = nGrownTrees; treeIdx < rootNodes_.size(); ++treeIdx ) {
+    delete rootNodes_[treeIdx];
+  }
+
+  rootNodes_.resize(nGrownTrees);
+
+}
+
+size_t StochasticForest::readCheckpoint(const string& fileName, const size_t treeOffset, const size_t nTrees, vector<RootNode*>& trees, size_t& forestSeed) {
+
+  trees.assign(nTrees,NULL);
+
+  // Without a checkpoint there is nothing to resume from
+  ifstream fromFile(fileName.c_str());
+  if ( !fromFile.good() ) {
+    return( 0 );
+  }
+
+  size_t nTreesRead = 0;
+  string newLine;
+
+  while ( getline(fromFile,newLine) ) {
+
+    newLine = utils::chomp(newLine);
+
+    if ( newLine == "" ) {
+      continue;
+    }
+
+    // Every line of a tree is terminated, unless the writing of the tree was interrupted,
+    // possibly in the middle of its header
+    bool isComplete = !fromFile.eof();
+
+    if ( !isComplete ) {
+      break;
+    }
+
+    map<string,string> treeSetup = utils::parse(newLine,',','=','"');
+
+    if ( newLine.compare(0,5,"TREE=") != 0 || treeSetup["TREE"] == "" || treeSetup.find("SEED") == treeSetup.end() ) {
+      cerr << "StochasticForest::readCheckpoint() -- '" << fileName << "' is not a checkpoint, found line '" << newLine << "'" << endl;
+      exit(1);
+    }
+
+    stringstream treeStream;
+    treeStream << newLine << endl;
+
+    size_t nNodes = utils::str2<size_t>(treeSetup["NNODES"]);
+
+    for ( size_t i = 0; i < nNodes && isComplete; ++i ) {
+      isComplete = getline(fromFile,newLine) && !fromFile.eof();
+      treeStream << utils::chomp(newLine) << endl;
+    }
+
+    if ( !isComplete ) {
+      break;
+    }
+
+    size_t treeIdx = utils::str2<size_t>(treeSetup["TREE"]);
+    size_t treeSeed = utils::str2<size_t>(treeSetup["SEED"]);
+
+    if ( nTreesRead > 0 && treeSeed != forestSeed ) {
+      cerr << "StochasticForest::readCheckpoint() -- trees in '" << fileName << "' come from forests with different seeds" << endl;
+      exit(1);
+    }
+
+    forestSeed = treeSeed;
+
+    // Trees outside the range of the forest, and trees written twice, are not needed
+    if ( treeIdx < treeOffset || treeIdx >= treeOffset + nTrees || trees[treeIdx - treeOffset] ) {
+      continue;
+    }
+
+    trees[treeIdx - treeOffset] = new RootNode(treeStream);
+    ++nTreesRead;
+
+  }
+
+  return( nTreesRead );
+
+}
+
+void StochasticForest::addCheckpointTree(const size_t treeIdx, RootNode* rootNode, const bool evictTrees) {
+
+  delete rootNodes_[treeIdx];
+  rootNodes_[treeIdx] = rootNode;
+
+  // The bootstrap sample of the tree is drawn again for the out-of-bag predictions
+  distributions::Random random( distributions::streamSeed(forestSeed_,rootNode->treeIdx()) );
+  rootNode->drawBootstrap(trainData_,targetIdx_,forestOptions_,&random,splitCaches_[0]);
+  this->addOobPredictions(treeIdx,0);
+
+  this->addTreeDI(rootNode,splitCaches_[0].DISums,splitCaches_[0].featureTreeCounts);
+
+  if ( evictTrees ) {
+    delete rootNodes_[treeIdx];
+    rootNodes_[treeIdx] = NULL;
+  }
+
+}
+
+void StochasticForest::trimCheckpoint(const string& fileName, const size_t treeOffset, const size_t nTrees) {
+
+  string tmpFile = fileName + ".tmp";
+
+  ifstream fromFile(fileName.c_str());
+  ofstream toFile(tmpFile.c_str());
+
+  string newLine;
+  bool isKept = false;
+
+  while ( getline(fromFile,newLine) ) {
+
+    if ( newLine.compare(0,5,"TREE=") == 0 ) {
+      size_t treeIdx = utils::str2<size_t>(utils::parse(newLine,',','=','"')["TREE"]);
+      isKept = treeIdx < treeOffset + nTrees;
+    }
+
+    if ( isKept ) {
+      toFile << newLine << endl;
+    }
+
+  }
+
+  fromFile.close();
+  toFile.close();
+
+  if ( rename(tmpFile.c_str(),fileName.c_str()) != 0 ) {
+    cerr << "StochasticForest::trimCheckpoint() -- could not replace checkpoint '" << fileName << "'" << endl;
+    exit(1);
+  }
+
+}
+
+size_t StochasticForest::chooseForestSeed(const ForestOptions* forestOptions,
+					  vector<distributions::Random>& randoms,
+					  const string& checkpointFile,
+					  const bool resume,
+					  vector<RootNode*>& checkpointTrees) {
+
+  // The first generator alone seeds the streams of the trees, which makes the
+  // forest identical for any number of threads
+  size_t forestSeed = randoms[0].integer();
+
+  // Trees of an interrupted run take the seed of the forest they belong to
+  checkpointTrees.assign(forestOptions->nTrees,NULL);
+
+  if ( checkpointFile != "" && resume ) {
+    size_t nCheckpointTrees = this->readCheckpoint(checkpointFile,forestOptions->treeOffset,forestOptions->nTrees,checkpointTrees,forestSeed);
+    cout << "-Resuming with " << nCheckpointTrees << " trees read from checkpoint '" << checkpointFile << "'" << endl;
+  }
+
+  return( forestSeed );
+
+}
+
+void StochasticForest::learnRF(TreeData* trainData, 
+			       const size_t targetIdx,
+			       const ForestOptions* forestOptions, 
+			       const vector<num_t>& featureWeights,
+			       vector<distributions::Random>& randoms,
+			       const string& checkpointFile,
+			       const bool resume,
+			       const bool evictTrees) {
+
+  vector<RootNode*> checkpointTrees;
+
+  size_t forestSeed = this->chooseForestSeed(forestOptions,randoms,checkpointFile,resume,checkpointTrees);
+
+  this->growRF(trainData,targetIdx,forestOptions,featureWeights,randoms.size(),forestSeed,checkpointTrees,checkpointFile,evictTrees);
+
+}
+
+void StochasticForest::growRF(TreeData* trainData,
+			      const size_t targetIdx,
+			      const ForestOptions* forestOptions,
+			      const vector<num_t>& featureWeights,
+			      const size_t nThreads,
+			      const size_t forestSeed,
+			      vector<RootNode*>& checkpointTrees,
+			      const string& checkpointFile,
+			      const bool evictTrees) {
 
   assert(nThreads > 0);
-  assert(forestOptions->nTrees > 0);
-  assert(rootNodes_.size() == forestOptions->nTrees);
 
 #ifdef NOTHREADS
   assert( nThreads == 1 );
 #endif
 
-  if (nThreads == 1) {
+  size_t nCheckpointTrees = 0;
+  for ( size_t treeIdx = 0; treeIdx < checkpointTrees.size(); ++treeIdx ) {
+    nCheckpointTrees += checkpointTrees[treeIdx] ? 1 : 0;
+  }
+
+  this->beginRF(trainData,targetIdx,forestOptions,featureWeights,forestSeed,nThreads);
+
+  if ( checkpointFile != "" ) {
+
+    // The checkpoint is written anew from the trees read, so that a tree cut short is
+    // not left in the middle of the file. The old checkpoint stays until the new one is complete
+    string tmpFile = checkpointFile + ".tmp";
+    ofstream toFile(tmpFile.c_str());
 
-    vector<size_t> treeIcs = utils::range(forestOptions->nTrees);
+    for ( size_t treeIdx = 0; treeIdx < checkpointTrees.size(); ++treeIdx ) {
+
+      if ( !checkpointTrees[treeIdx] ) {
+	continue;
+      }
+
+      if ( checkpointTrees[treeIdx]->getTargetName() != trainData->feature(targetIdx)->name() ||
+	   checkpointTrees[treeIdx]->isTargetNumerical() != trainData->feature(targetIdx)->isNumerical() ) {
+	cerr << "StochasticForest::learnRF() -- checkpoint '" << checkpointFile << "' has trees for target '"
+	     << checkpointTrees[treeIdx]->getTargetName() << "'" << endl;
+	exit(1);
+      }
+
+      checkpointTrees[treeIdx]->writeTree(toFile);
 
-    for (size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx) {
-      rootNodes_[treeIdx] = new RootNode(trainData, targetIdx, &pmf, forestOptions, &randoms[0]);
     }
 
+    toFile.close();
+
+    if ( rename(tmpFile.c_str(),checkpointFile.c_str()) != 0 ) {
+      cerr << "StochasticForest::learnRF() -- could not replace checkpoint '" << checkpointFile << "'" << endl;
+      exit(1);
+    }
+
+    checkpointStream_.open(checkpointFile.c_str(),ios::app);
+
+    this->setTreeStream(&checkpointStream_,evictTrees);
+
   }
-#ifndef NOTHREADS  
-  else {
 
-    vector<vector<size_t> > treeIcs = utils::splitRange(forestOptions->nTrees, nThreads);
+  // With early stopping the trees are grown a window at a time, and the
+  // out-of-bag error is checked in between; otherwise all trees are grown at once
+  size_t nTrees = forestOptions->nTrees;
+  bool isEarlyStopping = forestOptions->oobTolerance > 0.0;
+  size_t nTreesPerRound = isEarlyStopping ? forestOptions->oobWindow : nTrees;
+  size_t nGrownTrees = 0;
 
-    vector<thread> threads;
+  num_t prevOobError = datadefs::NUM_NAN;
+
+  while ( nGrownTrees < nTrees ) {
+
+    size_t nNewTrees = min(nTreesPerRound,nTrees - nGrownTrees);
+
+    // Trees read from the checkpoint are not grown again, but they join the forest in
+    // the round of their index, so that the error checks see the same trees as before
+    vector<size_t> newTreeIcs;
+    for ( size_t treeIdx = nGrownTrees; treeIdx < nGrownTrees + nNewTrees; ++treeIdx ) {
+      if ( checkpointTrees[treeIdx] ) {
+	this->addCheckpointTree(treeIdx,checkpointTrees[treeIdx],evictTrees);
+	checkpointTrees[treeIdx] = NULL;
+      } else {
+	newTreeIcs.push_back(treeIdx);
+      }
+    }
+
+    vector<vector<size_t> > treeIcs = utils::splitRange(newTreeIcs.size(), nThreads);
 
     for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+      for ( size_t i = 0; i < treeIcs[threadIdx].size(); ++i ) {
+	treeIcs[threadIdx][i] = newTreeIcs[ treeIcs[threadIdx][i] ];
+      }
+    }
 
-      vector<size_t>& treeIcsPerThread = treeIcs[threadIdx];
-      vector<RootNode*> rootNodesPerThread(treeIcsPerThread.size());
+    if (nThreads == 1) {
 
-      for ( size_t i = 0; i < treeIcsPerThread.size(); ++i ) {
+      this->growTrees(treeIcs[0],0);
 
-        rootNodes_[treeIcsPerThread[i]] = new RootNode();
+    }
+#ifndef NOTHREADS  
+    else {
 
-        rootNodesPerThread[i] = rootNodes_[treeIcsPerThread[i]];
+      vector<thread> threads;
 
+      for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+	threads.push_back(thread(&StochasticForest::growTrees, this, treeIcs[threadIdx], threadIdx));
       }
 
-      threads.push_back(thread(growTreesPerThread, 
-			       rootNodesPerThread, 
-			       trainData, 
-			       targetIdx, 
-			       forestOptions, 
-			       &pmf, 
-			       &randoms[threadIdx])); 
+      for ( size_t threadIdx = 0; threadIdx < threads.size(); ++threadIdx ) {
+	threads[threadIdx].join();
+      }
     }
+#endif
 
-    for ( size_t threadIdx = 0; threadIdx < threads.size(); ++threadIdx ) {
-      threads[threadIdx].join();
+    nGrownTrees += nNewTrees;
+
+    if ( !isEarlyStopping ) {
+      continue;
     }
+
+    this->updateOobError();
+
+    // The forest is large enough once another window of trees no longer moves the error
+    if ( !datadefs::isNAN(prevOobError) && !datadefs::isNAN(oobError_) &&
+	 fabs(oobError_ - prevOobError) <= forestOptions->oobTolerance * prevOobError ) {
+      break;
+    }
+
+    prevOobError = oobError_;
+
+  }
+
+  this->endRF(nGrownTrees);
+
+  if ( checkpointStream_.is_open() ) {
+    checkpointStream_.close();
+    treeStream_ = NULL;
+  }
+
+  // Trees read from the checkpoint beyond the point where the growth stopped are not
+  // part of the forest, and are dropped from the checkpoint as well
+  size_t nUnusedTrees = 0;
+  for ( size_t treeIdx = nGrownTrees; treeIdx < checkpointTrees.size(); ++treeIdx ) {
+    if ( checkpointTrees[treeIdx] ) {
+      delete checkpointTrees[treeIdx];
+      ++nUnusedTrees;
+    }
+  }
+
+  if ( nUnusedTrees > 0 ) {
+    this->trimCheckpoint(checkpointFile,forestOptions->treeOffset,nGrownTrees);
+  }
+
+  // The depths of the splits are not recovered from the trees read from the
+  // checkpoint, which leaves the minimal depth of the forest unknown
+  if ( nCheckpointTrees > 0 ) {
+    minDepthSums_.clear();
+  }
+
+}
+
+void StochasticForest::addTreesRF(TreeData* trainData,
+				  const size_t targetIdx,
+				  const ForestOptions* forestOptions,
+				  const vector<num_t>& featureWeights,
+				  vector<distributions::Random>& randoms,
+				  const string& checkpointFile,
+				  const bool resume) {
+
+  if ( this->hasEvictedTrees() ) {
+    cerr << "StochasticForest::addTreesRF() -- the trees of the forest were freed once written to file" << endl;
+    exit(1);
   }
-#endif
 
-  // Get features in the forest for fast look-up
   for ( size_t treeIdx = 0; treeIdx < rootNodes_.size(); ++treeIdx ) {
-    set <size_t> featuresInTree = rootNodes_[treeIdx]->getFeaturesInTree();
-    for ( set<size_t>::const_iterator it(featuresInTree.begin()); it != featuresInTree.end(); ++it ) {
-      //featuresInForest_.insert(*it);
+
+    if ( rootNodes_[treeIdx]->getForestType() == forest_t::GBT || forestOptions->forestType == forest_t::GBT ) {
+      cerr << "StochasticForest::addTreesRF() -- boosted trees fit the residuals of the trees before them, so GBT forests cannot be extended" << endl;
+      exit(1);
     }
+
+    if ( rootNodes_[treeIdx]->getForestType() != forestOptions->forestType ) {
+      cerr << "StochasticForest::addTreesRF() -- the forest has trees of another forest type than the ones to be added" << endl;
+      exit(1);
+    }
+
+    if ( rootNodes_[treeIdx]->getTargetName() != trainData->feature(targetIdx)->name() ||
+	 rootNodes_[treeIdx]->isTargetNumerical() != trainData->feature(targetIdx)->isNumerical() ) {
+      cerr << "StochasticForest::addTreesRF() -- the forest has trees for target '" << rootNodes_[treeIdx]->getTargetName()
+	   << "', not for '" << trainData->feature(targetIdx)->name() << "'" << endl;
+      exit(1);
+    }
+
+  }
+
+  // The new trees are grown as a forest of their own, and the earlier trees put in front of them
+  vector<RootNode*> prevTrees;
+  prevTrees.swap(rootNodes_);
+
+  // The new trees are numbered after the earlier ones, so that the forest grown again
+  // with the seed of the earlier trees continues them instead of repeating them
+  ForestOptions newTreeOptions(*forestOptions);
+  newTreeOptions.treeOffset += prevTrees.size();
+
+  vector<RootNode*> checkpointTrees;
+
+  size_t forestSeed = this->chooseForestSeed(&newTreeOptions,randoms,checkpointFile,resume,checkpointTrees);
+
+  // The new trees are checked against the earlier ones before any of them is grown
+  set<pair<size_t,size_t> > prevTreeOrigins;
+  for ( size_t treeIdx = 0; treeIdx < prevTrees.size(); ++treeIdx ) {
+    if ( prevTrees[treeIdx]->hasOrigin() ) {
+      prevTreeOrigins.insert( make_pair(prevTrees[treeIdx]->forestSeed(),prevTrees[treeIdx]->treeIdx()) );
+    }
+  }
+
+  for ( size_t treeIdx = 0; treeIdx < newTreeOptions.nTrees; ++treeIdx ) {
+    if ( prevTreeOrigins.count( make_pair(forestSeed,newTreeOptions.treeOffset + treeIdx) ) ) {
+      cerr << "StochasticForest::addTreesRF() -- tree " << newTreeOptions.treeOffset + treeIdx << " of the forest with seed "
+	   << forestSeed << " is already in the forest. Use another seed or tree offset" << endl;
+      exit(1);
+    }
+  }
+
+  this->growRF(trainData,targetIdx,&newTreeOptions,featureWeights,randoms.size(),forestSeed,checkpointTrees,checkpointFile,false);
+
+  forestOptions_ = forestOptions;
+
+  for ( size_t treeIdx = 0; treeIdx < prevTrees.size(); ++treeIdx ) {
+    this->addTreeDI(prevTrees[treeIdx],DISums_,featureTreeCounts_);
+  }
+
+  rootNodes_.insert(rootNodes_.begin(),prevTrees.begin(),prevTrees.end());
+
+  // The depths of the splits are not recovered from the earlier trees
+  if ( prevTrees.size() > 0 ) {
+    minDepthSums_.clear();
   }
 
 }
@@ -247,7 +983,7 @@ void StochasticForest::growNumericalGBT(TreeData* trainData,
     // What kind of a prediction does the new tree produce?
     vector<num_t> curPrediction(nSamples); // = rootNodes_[treeIdx]->getTrainPrediction(); 
     for (size_t i = 0; i < nSamples; ++i) {
-      curPrediction[i] = rootNodes_[treeIdx]->getPrediction(trainData, i).numTrainPrediction;
+      curPrediction[i] = rootNodes_[treeIdx]->getNumTrainPrediction(trainData, i);
     }
 
     // Calculate the current total prediction adding the newly generated tree
@@ -341,7 +1077,7 @@ void StochasticForest::growCategoricalGBT(TreeData* trainData,
       // out of the whole training data set?
       curPrediction[k] = vector<num_t> (nSamples); //rootNodes_[treeIdx]->getTrainPrediction();
       for (size_t i = 0; i < nSamples; ++i) {
-        curPrediction[k][i] = rootNodes_[treeIdx]->getPrediction(trainData, i).numTrainPrediction;
+        curPrediction[k][i] = rootNodes_[treeIdx]->getNumTrainPrediction(trainData, i);
       }
 
       // Calculate the current total prediction adding the newly generated tree
@@ -357,73 +1093,198 @@ void StochasticForest::growCategoricalGBT(TreeData* trainData,
   //trainData->replaceFeatureData(targetIdx, trueTargetData);
 }
 
-/*
- void StochasticForest::getImportanceValues(vector<num_t>& importanceValues, vector<num_t>& contrastImportanceValues) {
+// Contribution of one out-of-bag prediction to the error: squared error for
+// numerical and misclassification for categorical targets
+inline num_t oobPredictionError(const RootNode* rootNode, const size_t nodeIdx, const Feature* target, const size_t sampleIdx) {
+  if ( target->isNumerical() ) {
+    return( pow(rootNode->getNumTrainPrediction(nodeIdx) - target->numData[sampleIdx],2) );
+  } else {
+    return( rootNode->getCatTrainPrediction(nodeIdx) != target->catData[sampleIdx] ? 1.0 : 0.0 );
+  }
+}
 
- this->getMeanMinimalDepthValues(importanceValues,contrastImportanceValues);
- return;
+// Permutation importance summed over a subset of trees. Each tree percolates
+// only its own out-of-bag samples, and only the features the tree splits with
+// are permuted, since the others cannot change its predictions
+void permutationImportancePerThread(const vector<RootNode*>& rootNodes, const vector<size_t>& treeIcs,
+    TreeData* trainData, const size_t targetIdx, const size_t permutationSeed,
+    vector<double>* importanceSum, vector<size_t>* featureCounts, size_t* nOobTrees) {
 
- if ( featuresInForest_.size() == 0 ) {
- cout << "NOTE: forest is empty!" << endl;
- }
+  const Feature* target = trainData->feature(targetIdx);
 
- vector<num_t> oobPredictions = this->getOobPredictions();
+  distributions::Random random;
 
- size_t nRealFeatures = trainData_->nFeatures();
- size_t nAllFeatures = 2*nRealFeatures;
+  vector<size_t> splitterFeatureIcs;
 
- size_t targetIdx = trainData_->getFeatureIdx(params_->targetStr);
+  for ( size_t i = 0; i < rootNodes.size(); ++i ) {
 
- vector<num_t> trueData = trainData_->getFeatureData(targetIdx);
+    const RootNode* rootNode = rootNodes[i];
 
- importanceValues.clear();
- importanceValues.resize(nAllFeatures,0.0);
+    random.seed( distributions::streamSeed(permutationSeed,treeIcs[i]) );
 
- num_t oobError = this->error(oobPredictions,trueData);
+    vector<size_t> oobIcs = rootNode->getOobIcs();
+    size_t nOobSamples = oobIcs.size();
 
- for ( set<size_t>::const_iterator it(featuresInForest_.begin()); it != featuresInForest_.end(); ++it ) {
+    if ( nOobSamples == 0 ) {
+      continue;
+    }
 
- size_t featureIdx = *it;
+    ++(*nOobTrees);
 
- vector<num_t> permutedOobPredictions = this->getPermutedOobPredictions(featureIdx);
+    // The splitters are looked up in the data once per tree, not once per node visited
+    rootNode->getSplitterFeatureIcs(trainData,splitterFeatureIcs);
 
- num_t permutedOobError = this->error(permutedOobPredictions,trueData);
+    num_t oobError = 0.0;
+    for ( size_t j = 0; j < nOobSamples; ++j ) {
+      size_t nodeIdx = rootNode->percolate(trainData,oobIcs[j],splitterFeatureIcs,trainData->end(),oobIcs[j]);
+      oobError += oobPredictionError(rootNode,nodeIdx,target,oobIcs[j]);
+    }
 
- importanceValues[featureIdx] = permutedOobError - oobError;
+    vector<size_t> permutedIcs = oobIcs;
 
- if ( params_->normalizeImportanceValues ) {
- if ( oobError < datadefs::EPS ) {
- importanceValues[featureIdx] /= datadefs::EPS;
- } else {
- importanceValues[featureIdx] /= oobError;
- }
- }
+    for ( size_t s = 0; s < splitterFeatureIcs.size(); ++s ) {
 
- }
+      size_t featureIdx = splitterFeatureIcs[s];
 
- assert( !datadefs::containsNAN(importanceValues) );
+      if ( featureIdx == trainData->end() ) {
+	continue;
+      }
 
+      utils::permute(permutedIcs,&random);
 
- contrastImportanceValues.resize(nRealFeatures);
+      num_t permutedOobError = 0.0;
+      for ( size_t j = 0; j < nOobSamples; ++j ) {
+	size_t nodeIdx = rootNode->percolate(trainData,oobIcs[j],splitterFeatureIcs,featureIdx,permutedIcs[j]);
+	permutedOobError += oobPredictionError(rootNode,nodeIdx,target,oobIcs[j]);
+      }
 
- copy(importanceValues.begin() + nRealFeatures,
- importanceValues.end(),
- contrastImportanceValues.begin());
+      (*importanceSum)[featureIdx] += ( permutedOobError - oobError ) / nOobSamples;
+      ++(*featureCounts)[featureIdx];
 
- importanceValues.resize(nRealFeatures);
+    }
+  }
 
- }
- */
+}
+
+void StochasticForest::getImportanceValues(TreeData* trainData,
+					   vector<num_t>& importanceValues,
+					   vector<num_t>& contrastImportanceValues,
+					   vector<distributions::Random>& randoms) {
+
+  assert( randoms.size() > 0 );
+
+  // Permutations are drawn per tree, so the values do not depend on the number of threads
+  this->getImportanceValues(trainData,importanceValues,contrastImportanceValues,randoms[0].integer(),randoms.size());
+
+}
+
+void StochasticForest::getImportanceValues(TreeData* trainData,
+					   vector<num_t>& importanceValues,
+					   vector<num_t>& contrastImportanceValues,
+					   const size_t permutationSeed,
+					   const size_t nThreads) {
+
+  size_t nRealFeatures = trainData->nFeatures();
+  size_t nAllFeatures = trainData->nAllFeatures();
+
+  size_t targetIdx = trainData->getFeatureIdx(this->getTargetName());
+
+  if ( targetIdx == trainData->end() ) {
+    cerr << "StochasticForest::getImportanceValues() -- target '" << this->getTargetName() << "' not found in data" << endl;
+    exit(1);
+  }
+
+  assert( nThreads > 0 );
+
+#ifdef NOTHREADS
+  assert( nThreads == 1 );
+#endif
+
+  // Every thread sums into its own vectors, which are merged once the threads are done.
+  // The sums are kept in double precision so that the merge order does not show
+  vector<vector<double> > importanceSums(nThreads,vector<double>(nAllFeatures,0.0));
+  vector<vector<size_t> > featureCounts(nThreads,vector<size_t>(nAllFeatures,0));
+  vector<size_t> nOobTrees(nThreads,0);
+
+  if ( nThreads == 1 ) {
+
+    permutationImportancePerThread(rootNodes_, utils::range(this->nTrees()), trainData, targetIdx, permutationSeed, &importanceSums[0], &featureCounts[0], &nOobTrees[0]);
+
+  }
+#ifndef NOTHREADS
+  else {
+
+    vector<vector<size_t> > treeIcs = utils::splitRange(this->nTrees(), nThreads);
+
+    vector<thread> threads;
+
+    for ( size_t threadIdx = 0; threadIdx < nThreads; ++threadIdx ) {
+
+      vector<RootNode*> rootNodesPerThread(treeIcs[threadIdx].size());
+
+      for ( size_t i = 0; i < treeIcs[threadIdx].size(); ++i ) {
+	rootNodesPerThread[i] = rootNodes_[treeIcs[threadIdx][i]];
+      }
+
+      threads.push_back(thread(permutationImportancePerThread,
+			       rootNodesPerThread,
+			       treeIcs[threadIdx],
+			       trainData,
+			       targetIdx,
+			       permutationSeed,
+			       &importanceSums[threadIdx],
+			       &featureCounts[threadIdx],
+			       &nOobTrees[threadIdx]));
+    }
+
+    for ( size_t threadIdx = 0; threadIdx < threads.size(); ++threadIdx ) {
+      threads[threadIdx].join();
+    }
+  }
+#endif
+
+  for ( size_t threadIdx = 1; threadIdx < nThreads; ++threadIdx ) {
+    for ( size_t featureIdx = 0; featureIdx < nAllFeatures; ++featureIdx ) {
+      importanceSums[0][featureIdx] += importanceSums[threadIdx][featureIdx];
+      featureCounts[0][featureIdx] += featureCounts[threadIdx][featureIdx];
+    }
+    nOobTrees[0] += nOobTrees[threadIdx];
+  }
+
+  // Trees loaded from file keep no out-of-bag samples
+  if ( nOobTrees[0] == 0 ) {
+    cerr << "StochasticForest::getImportanceValues() -- none of the " << this->nTrees()
+	 << " trees has out-of-bag samples, so permutation importance cannot be measured. Trees loaded from file have none" << endl;
+    exit(1);
+  }
+
+  // Trees that do not split with a feature contribute zero to its mean, and
+  // features that appear in no tree are left without an importance
+  importanceValues.assign(nAllFeatures,datadefs::NUM_NAN);
+
+  for ( size_t featureIdx = 0; featureIdx < nAllFeatures; ++featureIdx ) {
+    if ( featureCounts[0][featureIdx] > 0 ) {
+      importanceValues[featureIdx] = importanceSums[0][featureIdx] / nOobTrees[0];
+    }
+  }
+
+  contrastImportanceValues.resize(nAllFeatures - nRealFeatures);
+
+  copy(importanceValues.begin() + nRealFeatures, importanceValues.end(), contrastImportanceValues.begin());
+
+  importanceValues.resize(nRealFeatures);
+
+}
 
 void predictCatPerThread(TreeData* testData, 
-			 vector<RootNode*>& rootNodes,
+			 const vector<RootNode*>& rootNodes,
 			 forest_t forestType,
-			 vector<size_t>& sampleIcs, 
+			 const vector<size_t>& sampleIcs, 
 			 vector<cat_t>* predictions,
 			 vector<num_t>* confidence, 
-			 vector<cat_t>& categories,
-			 vector<num_t>& GBTConstants, 
-			 num_t& GBTShrinkage) {
+			 const vector<cat_t>& categories,
+			 const vector<num_t>& GBTConstants, 
+			 const num_t& GBTShrinkage) {
 
   size_t nTrees = rootNodes.size();
   for ( size_t i = 0; i < sampleIcs.size(); ++i ) {
@@ -445,7 +1306,7 @@ void predictCatPerThread(TreeData* testData,
 
         for ( size_t iterIdx = 0; iterIdx < nTrees / nCategories; ++iterIdx ) {
           size_t treeIdx = iterIdx * nCategories + categoryIdx;
-          cumProb += GBTShrinkage * rootNodes[treeIdx]->getPrediction(testData, sampleIdx).numTrainPrediction;
+          cumProb += GBTShrinkage * rootNodes[treeIdx]->getNumTrainPrediction(testData, sampleIdx);
         }
 
         if (cumProb > maxProb) {
@@ -462,7 +1323,7 @@ void predictCatPerThread(TreeData* testData,
 
       vector<string> predictionVec(nTrees);
       for ( size_t treeIdx = 0; treeIdx < nTrees; ++treeIdx ) {
-        predictionVec[treeIdx] = rootNodes[treeIdx]->getPrediction(testData, sampleIdx).catTrainPrediction;
+        predictionVec[treeIdx] = rootNodes[treeIdx]->getCatTrainPrediction(testData, sampleIdx);
       }
 
       (*predictions)[sampleIdx] = math::mode(predictionVec);
@@ -472,20 +1333,20 @@ void predictCatPerThread(TreeData* testData,
 }
 
 void predictNumPerThread(TreeData* testData, 
-			 vector<RootNode*>& rootNodes,
+			 const vector<RootNode*>& rootNodes,
 			 forest_t forestType, 
-			 vector<size_t>& sampleIcs,
+			 const vector<size_t>& sampleIcs,
 			 vector<num_t>* predictions, 
 			 vector<num_t>* confidence,
-			 vector<num_t>& GBTConstants, 
-			 num_t& GBTShrinkage) {
+			 const vector<num_t>& GBTConstants, 
+			 const num_t& GBTShrinkage) {
 
   size_t nTrees = rootNodes.size();
   for (size_t i = 0; i < sampleIcs.size(); ++i) {
     size_t sampleIdx = sampleIcs[i];
     vector<num_t> predictionVec(nTrees);
     for (size_t treeIdx = 0; treeIdx < nTrees; ++treeIdx) {
-      predictionVec[treeIdx] = rootNodes[treeIdx]->getPrediction(testData,sampleIdx).numTrainPrediction;
+      predictionVec[treeIdx] = rootNodes[treeIdx]->getNumTrainPrediction(testData,sampleIdx);
     }
     if (forestType == forest_t::GBT) {
       (*predictions)[sampleIdx] = GBTConstants[0];
@@ -611,10 +1472,10 @@ void StochasticForest::getNumDistributions(TreeData* testData,
   
   for ( size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx ) {
     for ( size_t treeIdx = 0; treeIdx < nTrees; ++treeIdx ) {
-      vector<num_t> treeData = rootNodes_[treeIdx]->getChildLeafNumTrainData(testData,sampleIdx);
-      size_t nSamplesInTreeData = treeData.size();
+      size_t nodeIdx = rootNodes_[treeIdx]->percolate(testData,sampleIdx);
+      size_t nSamplesInTreeData = rootNodes_[treeIdx]->nTrainSamples(nodeIdx);
       for ( size_t i = 0; i < nSamplesPerTree; ++i ) {
-	distributions[sampleIdx][ treeIdx * nSamplesPerTree + i ] = treeData[ random->integer() % nSamplesInTreeData ];
+	distributions[sampleIdx][ treeIdx * nSamplesPerTree + i ] = rootNodes_[treeIdx]->getNumTrainData(nodeIdx, random->integer() % nSamplesInTreeData );
       }
     }
   }
@@ -633,10 +1494,10 @@ void StochasticForest::getCatDistributions(TreeData* testData,
 
   for ( size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx ) {
     for ( size_t treeIdx = 0; treeIdx < nTrees; ++treeIdx ) {
-      vector<cat_t> treeData = rootNodes_[treeIdx]->getChildLeafCatTrainData(testData,sampleIdx);
-      size_t nSamplesInTreeData = treeData.size();
+      size_t nodeIdx = rootNodes_[treeIdx]->percolate(testData,sampleIdx);
+      size_t nSamplesInTreeData = rootNodes_[treeIdx]->nTrainSamples(nodeIdx);
       for ( size_t i = 0; i < nSamplesPerTree; ++i ) {
-        distributions[sampleIdx][ treeIdx * nSamplesPerTree + i ] = treeData[ random->integer() % nSamplesInTreeData ];
+        distributions[sampleIdx][ treeIdx * nSamplesPerTree + i ] = rootNodes_[treeIdx]->getCatTrainData(nodeIdx, random->integer() % nSamplesInTreeData );
       }
     }
   }
@@ -657,29 +1518,44 @@ void StochasticForest::getMDI(TreeData* trainData,
 			      vector<num_t>& contrastMDI) {
 
   size_t nRealFeatures = trainData->nFeatures();
-  size_t nAllFeatures = 2 * nRealFeatures;
+  size_t nAllFeatures = trainData->nAllFeatures();
 
   MDI.clear();
   MDI.resize(nAllFeatures, 0.0);
 
   vector<size_t> featureCounts(nAllFeatures, 0);
 
-  for (size_t treeIdx = 0; treeIdx < this->nTrees(); ++treeIdx) {
+  // Forests grown by learnRF() have the sums ready by feature index; loaded
+  // forests are resolved from the splitter names of each tree
+  if ( DISums_.size() == nAllFeatures ) {
 
-    unordered_map<string,num_t> DIByFeature = rootNodes_[treeIdx]->getDI();
-
-    for ( unordered_map<string,num_t>::const_iterator it(DIByFeature.begin()); it != DIByFeature.end(); ++it ) {
-      
-      size_t featureIdx = trainData->getFeatureIdx(it->first);
-      if ( featureIdx == trainData->end() ) {
-	continue;
+    for ( size_t featureIdx = 0; featureIdx < nAllFeatures; ++featureIdx ) {
+      featureCounts[featureIdx] = featureTreeCounts_[featureIdx];
+      if ( featureCounts[featureIdx] > 0 ) {
+	MDI[featureIdx] = DISums_[featureIdx] / featureCounts[featureIdx];
       }
+    }
+
+  } else {
+
+    for (size_t treeIdx = 0; treeIdx < this->nTrees(); ++treeIdx) {
 
-      num_t DI = it->second;
+      unordered_map<string,num_t> DIByFeature = rootNodes_[treeIdx]->getDI();
 
-      ++featureCounts[featureIdx];
+      for ( unordered_map<string,num_t>::const_iterator it(DIByFeature.begin()); it != DIByFeature.end(); ++it ) {
 
-      MDI[featureIdx] += 1.0 * (DI - MDI[featureIdx]) / featureCounts[featureIdx];
+	size_t featureIdx = trainData->getFeatureIdx(it->first);
+	if ( featureIdx == trainData->end() ) {
+	  continue;
+	}
+
+	num_t DI = it->second;
+
+	++featureCounts[featureIdx];
+
+	MDI[featureIdx] += 1.0 * (DI - MDI[featureIdx]) / featureCounts[featureIdx];
+
+      }
 
     }
 
@@ -691,10 +1567,38 @@ void StochasticForest::getMDI(TreeData* trainData,
     }
   }
 
-  contrastMDI.resize(nRealFeatures);
+  contrastMDI.resize(nAllFeatures - nRealFeatures);
 
   copy(MDI.begin() + nRealFeatures, MDI.end(), contrastMDI.begin());
 
   MDI.resize(nRealFeatures);
 
 }
+
+void StochasticForest::getMeanMinimalDepthValues(TreeData* trainData,
+						 vector<num_t>& depthValues,
+						 vector<num_t>& contrastDepthValues) {
+
+  size_t nRealFeatures = trainData->nFeatures();
+  size_t nAllFeatures = trainData->nAllFeatures();
+
+  if ( minDepthSums_.size() != nAllFeatures ) {
+    cerr << "StochasticForest::getMeanMinimalDepthValues() -- minimal depths are only collected while growing the forest" << endl;
+    exit(1);
+  }
+
+  depthValues.assign(nAllFeatures,datadefs::NUM_NAN);
+
+  for ( size_t featureIdx = 0; featureIdx < nAllFeatures; ++featureIdx ) {
+    if ( featureTreeCounts_[featureIdx] > 0 ) {
+      depthValues[featureIdx] = 1.0 * minDepthSums_[featureIdx] / featureTreeCounts_[featureIdx];
+    }
+  }
+
+  contrastDepthValues.resize(nAllFeatures - nRealFeatures);
+
+  copy(depthValues.begin() + nRealFeatures, depthValues.end(), contrastDepthValues.begin());
+
+  depthValues.resize(nRealFeatures);
+
+}
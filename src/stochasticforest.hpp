@@ -3,6 +3,7 @@
 
 #include <cstdlib>
 #include <fstream>
+#include <set>
 #include "rootnode.hpp"
 #include "treedata.hpp"
 #include "options.hpp"
@@ -17,11 +18,49 @@ public:
   
   ~StochasticForest();
 
-  void learnRF(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const vector<num_t>& featureWeights, vector<distributions::Random>& randoms);
+  // With a checkpoint file every tree is appended to the file as soon as it is grown,
+  // along with its index and the seed of the forest. Resuming loads the trees in the
+  // file, continues with the seed they were grown with, and grows only the missing trees.
+  // Evicting frees the trees once they are in the checkpoint
+  void learnRF(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const vector<num_t>& featureWeights, vector<distributions::Random>& randoms,
+	       const string& checkpointFile = "", const bool resume = false, const bool evictTrees = false);
+
+  // Appends every tree grown from now on to the stream, along with its index and the
+  // seed of the forest; forests may share a stream. With eviction a tree is freed once
+  // written, after its out-of-bag predictions and importance sums have been collected,
+  // so that the trees in memory are only the ones being grown. In order, a finished tree
+  // waits for the trees before it, which makes the file independent of the timing of the workers
+  void setTreeStream(ofstream* treeStream, const bool evictTrees, const bool isInOrder = false);
+
+  // Evicted trees live only in the file they were written to
+  bool hasEvictedTrees() const;
+
+  // Grows forestOptions->nTrees new trees and adds them after the trees already in the
+  // forest, e.g. ones loaded from file. The bootstrap samples of the earlier trees are
+  // not known, and the data may have changed since, so the out-of-bag error covers the
+  // new trees only. The decrease in impurity covers all trees. The new trees are numbered
+  // from the tree offset on after the earlier trees, and may not repeat any of them
+  void addTreesRF(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const vector<num_t>& featureWeights, vector<distributions::Random>& randoms,
+		  const string& checkpointFile = "", const bool resume = false);
+
   void learnGBT(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const vector<num_t>& featureWeights, vector<distributions::Random>& randoms);
 
+  // Training in stages, for callers that schedule the trees themselves. beginRF()
+  // prepares the trees and the scratch space of nWorkers workers, after which
+  // growTree() can be called once for every tree from any of the workers, one
+  // call per worker at a time. endRF() merges the statistics of the workers
+  void beginRF(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const vector<num_t>& featureWeights, const size_t forestSeed, const size_t nWorkers);
+  void growTree(const size_t treeIdx, const size_t workerIdx);
+  void endRF(const size_t nGrownTrees);
+
   void loadForest(const string& fileName);
 
+  // Concatenates the trees of forests trained independently, e.g. with different seeds,
+  // into one forest file. The trees are copied one at a time, without loading the
+  // forests, and must all agree on the target and the forest type. The same tree, i.e.
+  // the same tree index and forest seed, may not be found twice. Returns the number of trees
+  static size_t mergeForestFiles(const vector<string>& fileNames, const string& mergedFileName);
+
 
   void trainForestAndPredictQuantiles(TreeData* trainData,
 				      const size_t targetIdx,
@@ -32,11 +71,21 @@ public:
 				      vector<vector<num_t> >& predictions); 
 
   //num_t getError() { return(0.0); }
-  //num_t getOobError();
 
-  //void getImportanceValues(TreeData* trainData, vector<num_t>& importanceValues, vector<num_t>& contrastImportanceValues);
+  // Out-of-bag error of the forest from the last learnRF() call: mean squared
+  // error for numerical and misclassification rate for categorical targets
+  num_t getOobError() const { return( oobError_ ); }
+
+  // Mean increase of the out-of-bag error over the trees when the values of a
+  // feature are permuted. Trees are processed in parallel, one thread per generator
+  void getImportanceValues(TreeData* trainData, vector<num_t>& importanceValues, vector<num_t>& contrastImportanceValues, vector<distributions::Random>& randoms);
+  void getImportanceValues(TreeData* trainData, vector<num_t>& importanceValues, vector<num_t>& contrastImportanceValues, const size_t permutationSeed, const size_t nThreads);
   void getMDI(TreeData* trainData, vector<num_t>& impurityValues, vector<num_t>& contrastImpurityValues);
 
+  // Mean over the trees of the depth of the shallowest split with each feature; only
+  // trees splitting with the feature count. Available for forests grown with learnRF()
+  void getMeanMinimalDepthValues(TreeData* trainData, vector<num_t>& depthValues, vector<num_t>& contrastDepthValues);
+
   void predict(TreeData* testData, vector<string>& predictions, vector<num_t>& confidence, size_t nThreads = 1);
   void predict(TreeData* testData, vector<num_t>& predictions, vector<num_t>& confidence, size_t nThreads = 1);
 
@@ -45,8 +94,9 @@ public:
   void getNumDistributions(TreeData* testData, vector<vector<num_t> >& distributions, distributions::Random* random, const size_t nSamplesPerTree);
   void getCatDistributions(TreeData* testData, vector<vector<cat_t> >& distributions, distributions::Random* random, const size_t nSamplesPerTree);
 
-  //vector<num_t> getOobPredictions();
-  //vector<num_t> getPermutedOobPredictions(const size_t featureIdx);
+  // Out-of-bag predictions per train sample; NaN for samples that were in-bag in all trees
+  vector<num_t> getNumOobPredictions() const { return( numOobPredictions_ ); }
+  vector<cat_t> getCatOobPredictions() const { return( catOobPredictions_ ); }
 
   //Counts the number of nodes in the forest
   //size_t nNodes();
@@ -60,12 +110,64 @@ public:
   inline string getTargetName() const { assert(rootNodes_.size() > 0); return( rootNodes_[0]->getTargetName() ); }
   inline bool isTargetNumerical() const { assert(rootNodes_.size() > 0); return( rootNodes_[0]->isTargetNumerical() ); }
 
-  void writeForest(ofstream& toFile);
+  // Writes the trees from firstTreeIdx on, e.g. only the trees added to a loaded forest
+  void writeForest(ofstream& toFile, const size_t firstTreeIdx = 0);
 
 #ifndef TEST__
 private:
 #endif
 
+  // Out-of-bag predictions summed over the trees grown by one worker. Every
+  // worker has its own accumulator, so no locking is needed
+  struct OobAccumulator {
+
+    OobAccumulator(const size_t nSamples, const size_t nCategories);
+
+    vector<num_t> numPredictionSum;
+    vector<size_t> nPredictions;
+
+    // Votes of sample i for category c are at i*nCategories + c
+    vector<size_t> catVotes;
+
+  };
+
+  void growTrees(const vector<size_t> treeIcs, const size_t workerIdx);
+
+  // Adds the predictions of the tree for the out-of-bag samples in the cache of the worker
+  void addOobPredictions(const size_t treeIdx, const size_t workerIdx);
+
+  // Appends the tree to the tree stream, one worker at a time, and frees it if evicting.
+  // In order, the tree is held until the trees before it are written
+  void writeTree(const size_t treeIdx);
+
+  // Adds the decrease in impurity of the tree to the sums, for trees not grown by the forest
+  void addTreeDI(RootNode* rootNode, vector<double>& DISums, vector<size_t>& featureTreeCounts);
+
+  // Reads the trees of a checkpoint file into their place among the nTrees trees starting
+  // at treeOffset, and the seed of their forest. A tree cut short at the end of the file
+  // is dropped. Returns the number of trees read
+  size_t readCheckpoint(const string& fileName, const size_t treeOffset, const size_t nTrees, vector<RootNode*>& trees, size_t& forestSeed);
+
+  // Puts a tree read from the checkpoint in its place in the forest, and adds its
+  // out-of-bag predictions and decrease in impurity as if it had been grown
+  void addCheckpointTree(const size_t treeIdx, RootNode* rootNode, const bool evictTrees);
+
+  // Draws the seed of the forest to be grown, or takes it from the checkpoint when
+  // resuming, along with the trees of the checkpoint in their places among the trees
+  size_t chooseForestSeed(const ForestOptions* forestOptions, vector<distributions::Random>& randoms,
+			  const string& checkpointFile, const bool resume, vector<RootNode*>& checkpointTrees);
+
+  // Grows the forest with the given seed, for learnRF() and addTreesRF()
+  void growRF(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const vector<num_t>& featureWeights,
+	      const size_t nThreads, const size_t forestSeed, vector<RootNode*>& checkpointTrees,
+	      const string& checkpointFile, const bool evictTrees);
+
+  // Drops the trees past the first nTrees trees from the tree offset on from the checkpoint
+  void trimCheckpoint(const string& fileName, const size_t treeOffset, const size_t nTrees);
+
+  // Merges the accumulators into out-of-bag predictions and error
+  void updateOobError();
+
   void readForestHeader(ifstream& forestStream);
   
   void growNumericalGBT(TreeData* trainData, const size_t targetIdx, const ForestOptions* forestOptions, const distributions::PMF* pmf, vector<distributions::Random>& randoms);
@@ -82,6 +184,37 @@ private:
   // Root nodes for every tree
   vector<RootNode*> rootNodes_;
 
+  // Training state from beginRF() on
+  TreeData* trainData_;
+  size_t targetIdx_;
+  const ForestOptions* forestOptions_;
+  size_t forestSeed_;
+  shared_ptr<distributions::PMF> pmf_;
+  vector<cat_t> targetCategories_;
+  unordered_map<cat_t,size_t> targetCategoryIcs_;
+  vector<RootNode::SplitCache> splitCaches_;
+  vector<OobAccumulator> oobAccumulators_;
+
+  // Stream the trees are appended to as they are grown, and whether they are freed then
+  ofstream* treeStream_;
+  bool evictTrees_;
+  ofstream checkpointStream_;
+
+  // Whether the trees are written in order, the next tree to write, and the finished trees waiting for it
+  bool isInOrder_;
+  size_t nextTreeIdx_;
+  set<size_t> waitingTreeIcs_;
+
+  // Decrease in impurity and minimal depth per train feature index summed over
+  // the trees, and the number of trees splitting with each feature, collected during growth
+  vector<double> DISums_;
+  vector<size_t> minDepthSums_;
+  vector<size_t> featureTreeCounts_;
+
+  vector<num_t> numOobPredictions_;
+  vector<cat_t> catOobPredictions_;
+  num_t oobError_;
+
   // Container for all features in the forest for fast look-up
   //set<size_t> featuresInForest_;
   
@@ -6,6 +6,7 @@
 #define TREEDATA_HPP
 
 #include <cstdlib>
+#include <algorithm>
 #include <vector>
 
 #include "datadefs.hpp"
@@ -13,6 +14,7 @@
 #include "options.hpp"
 #include "feature.hpp"
 #include "reader.hpp"
+#include "splitengine.hpp"
 
 using namespace std;
 using datadefs::num_t;
@@ -20,6 +22,11 @@ using datadefs::num_t;
 class TreeData {
 public:
 
+  virtual ~TreeData() {}
+
+  // Returns a deep copy of the data, e.g. to hold another permutation of the contrasts
+  virtual TreeData* clone() const = 0;
+
   // Reveals the Feature class interface to the user
   virtual const Feature* feature(const size_t featureIdx) const = 0;
   
@@ -44,27 +51,136 @@ public:
 				      vector<size_t>& sampleIcs,
 				      vector<size_t>& missingIcs) = 0;
   
+  // Evaluates the best split of the samples with the numerical feature featureIdx.
+  // Samples with missing feature data are ignored. Only the fitness, the split
+  // value and the target statistics of the branches are returned; use
+  // numericalFeaturePartition() to apply the split. The statistics type must
+  // match the type of the target.
+  virtual num_t numericalFeatureSplit(const size_t targetIdx,
+				      const size_t featureIdx,
+				      const size_t minSamples,
+				      const vector<size_t>& sampleIcs,
+				      const vector<uint8_t>& sampleWeights,
+				      num_t& splitValue,
+				      splitengine::TargetStat<num_t>& stat_left,
+				      splitengine::TargetStat<num_t>& stat_right,
+				      splitengine::SplitScratch<num_t>& scratch) = 0;
+
   virtual num_t numericalFeatureSplit(const size_t targetIdx,
 				      const size_t featureIdx,
 				      const size_t minSamples,
-				      vector<size_t>& sampleIcs_left,
-				      vector<size_t>& sampleIcs_right,
-				      num_t& splitValue) = 0;
+				      const vector<size_t>& sampleIcs,
+				      const vector<uint8_t>& sampleWeights,
+				      num_t& splitValue,
+				      splitengine::TargetStat<cat_t>& stat_left,
+				      splitengine::TargetStat<cat_t>& stat_right,
+				      splitengine::SplitScratch<cat_t>& scratch) = 0;
 
   virtual num_t categoricalFeatureSplit(const size_t targetIdx,
 					const size_t featureIdx,
 					const vector<cat_t>& catOrder,
 					const size_t minSamples,
-					vector<size_t>& sampleIcs_left,
-					vector<size_t>& sampleIcs_right,
-					unordered_set<cat_t>& splitValues_left) = 0;
-  
+					const vector<size_t>& sampleIcs,
+					const vector<uint8_t>& sampleWeights,
+					unordered_set<cat_t>& splitValues_left,
+					splitengine::TargetStat<num_t>& stat_left,
+					splitengine::TargetStat<num_t>& stat_right,
+					splitengine::SplitScratch<num_t>& scratch) = 0;
+
+  virtual num_t categoricalFeatureSplit(const size_t targetIdx,
+					const size_t featureIdx,
+					const vector<cat_t>& catOrder,
+					const size_t minSamples,
+					const vector<size_t>& sampleIcs,
+					const vector<uint8_t>& sampleWeights,
+					unordered_set<cat_t>& splitValues_left,
+					splitengine::TargetStat<cat_t>& stat_left,
+					splitengine::TargetStat<cat_t>& stat_right,
+					splitengine::SplitScratch<cat_t>& scratch) = 0;
+
   virtual num_t textualFeatureSplit(const size_t targetIdx,
 				    const size_t featureIdx,
 				    const uint32_t hashIdx,
 				    const size_t minSamples,
-				    vector<size_t>& sampleIcs_left,
-				    vector<size_t>& sampleIcs_right) = 0;
+				    const vector<size_t>& sampleIcs,
+				    const vector<uint8_t>& sampleWeights,
+				    splitengine::TargetStat<num_t>& stat_left,
+				    splitengine::TargetStat<num_t>& stat_right) = 0;
+
+  virtual num_t textualFeatureSplit(const size_t targetIdx,
+				    const size_t featureIdx,
+				    const uint32_t hashIdx,
+				    const size_t minSamples,
+				    const vector<size_t>& sampleIcs,
+				    const vector<uint8_t>& sampleWeights,
+				    splitengine::TargetStat<cat_t>& stat_left,
+				    splitengine::TargetStat<cat_t>& stat_right) = 0;
+
+  // Randomized splits for extremely randomized trees. The numerical split
+  // places the threshold at the relative position u in [0,1) between the
+  // smallest and largest feature value of the samples, and the categorical
+  // split sends the given categories to the left. Both are scored in one
+  // pass over the samples.
+  virtual num_t randomNumericalFeatureSplit(const size_t targetIdx,
+					    const size_t featureIdx,
+					    const size_t minSamples,
+					    const vector<size_t>& sampleIcs,
+					    const vector<uint8_t>& sampleWeights,
+					    const num_t u,
+					    num_t& splitValue,
+					    splitengine::TargetStat<num_t>& stat_left,
+					    splitengine::TargetStat<num_t>& stat_right) = 0;
+
+  virtual num_t randomNumericalFeatureSplit(const size_t targetIdx,
+					    const size_t featureIdx,
+					    const size_t minSamples,
+					    const vector<size_t>& sampleIcs,
+					    const vector<uint8_t>& sampleWeights,
+					    const num_t u,
+					    num_t& splitValue,
+					    splitengine::TargetStat<cat_t>& stat_left,
+					    splitengine::TargetStat<cat_t>& stat_right) = 0;
+
+  virtual num_t categoricalFeatureSubsetSplit(const size_t targetIdx,
+					      const size_t featureIdx,
+					      const size_t minSamples,
+					      const vector<size_t>& sampleIcs,
+					      const vector<uint8_t>& sampleWeights,
+					      const unordered_set<cat_t>& splitValues_left,
+					      splitengine::TargetStat<num_t>& stat_left,
+					      splitengine::TargetStat<num_t>& stat_right) = 0;
+
+  virtual num_t categoricalFeatureSubsetSplit(const size_t targetIdx,
+					      const size_t featureIdx,
+					      const size_t minSamples,
+					      const vector<size_t>& sampleIcs,
+					      const vector<uint8_t>& sampleWeights,
+					      const unordered_set<cat_t>& splitValues_left,
+					      splitengine::TargetStat<cat_t>& stat_left,
+					      splitengine::TargetStat<cat_t>& stat_right) = 0;
+
+  // Partitions the samples according to a split. Samples with missing
+  // feature data are stored in sampleIcs_missing.
+  virtual void numericalFeaturePartition(const size_t featureIdx,
+					 const num_t splitValue,
+					 const vector<size_t>& sampleIcs,
+					 vector<size_t>& sampleIcs_left,
+					 vector<size_t>& sampleIcs_right,
+					 vector<size_t>& sampleIcs_missing) = 0;
+
+  virtual void categoricalFeaturePartition(const size_t featureIdx,
+					   const unordered_set<cat_t>& splitValues_left,
+					   const vector<size_t>& sampleIcs,
+					   vector<size_t>& sampleIcs_left,
+					   vector<size_t>& sampleIcs_right,
+					   vector<size_t>& sampleIcs_missing) = 0;
+
+  virtual void textualFeaturePartition(const size_t featureIdx,
+				       const uint32_t hashIdx,
+				       const vector<size_t>& sampleIcs,
+				       vector<size_t>& sampleIcs_left,
+				       vector<size_t>& sampleIcs_right,
+				       vector<size_t>& sampleIcs_missing) = 0;
     
   // Generates a bootstrap sample from the real samples of featureIdx. Samples not in the bootstrap sample will be stored in oob_ics,
   // and the number of oob samples is stored in noob.
@@ -75,7 +191,30 @@ public:
 					vector<size_t>& ics, 
 					vector<size_t>& oobIcs) = 0;
 
+  // Generates a bootstrap sample from the real samples of featureIdx as per-sample
+  // multiplicities: sampleWeights[i] is the number of times sample i was drawn.
+  // ics will hold the unique samples in the bootstrap sample in increasing order,
+  // and oobIcs the real samples with zero weight. Drawing a sample more than 255
+  // times, which the weights cannot hold, is an error.
+  virtual void bootstrapWeightsFromRealSamples(distributions::Random* random,
+					       const bool withReplacement,
+					       const num_t sampleSize,
+					       const size_t featureIdx,
+					       vector<uint8_t>& sampleWeights,
+					       vector<size_t>& ics,
+					       vector<size_t>& oobIcs) = 0;
+
   virtual void createContrasts() = 0;
+
+  // Contrast set k, for k = 1 ... nContrastSets(), holds the contrasts of the
+  // real features at indices k * nFeatures() ... ( k + 1 ) * nFeatures() - 1
+  virtual void setNContrastSets(const size_t nContrastSets) = 0;
+  virtual size_t nContrastSets() const = 0;
+
+  // Feature indices covered by the importance vectors: the real features
+  // followed by at least one set of contrasts
+  size_t nAllFeatures() const { return( this->nFeatures() * ( 1 + max(this->nContrastSets(),static_cast<size_t>(1)) ) ); }
+
   virtual void permuteContrasts(distributions::Random* random) = 0;
   
 };
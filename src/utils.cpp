@@ -378,273 +378,3 @@ vector<vector<size_t> > utils::splitRange(const size_t nElements, const size_t n
   return( splits );
 
 }
-
-num_t utils::numericalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
-						   const vector<num_t>& fv,
-						   const size_t minSamples,
-						   size_t& splitIdx) {
-
-  size_t n_tot = tv.size();
-  size_t n_left = 0;
-  size_t n_right = n_tot;
-
-  // We start with all samples on the left branch
-  num_t mu_tot = math::mean(tv);
-  num_t mu_left = 0.0;
-  num_t mu_right = mu_tot;
-
-  // Make sure the squared error didn't become corrupted by NANs
-  assert( !datadefs::isNAN(mu_tot) );
-
-  num_t DI_best = 0.0;
-
-  // Add samples one by one from left to right until we hit the
-  // minimum allowed size of the branch
-  for( size_t i = 0; i < n_tot - minSamples; ++i ) {
-
-    // Add n'th sample tv[i] from left to right and update
-    // mean and squared error
-    ++n_left;
-    --n_right;
-    mu_left  += ( tv[i] - mu_left  ) / n_left;
-    mu_right -= ( tv[i] - mu_right ) / n_right;
-
-    // If the sample is repeated and we can continue, continue
-    if ( n_left < minSamples || (n_left < n_tot - minSamples && fv[ i + 1 ] == fv[ i ]) ) {
-      continue;
-    }
-
-    // If the current split point yields a better split than the best,
-    // update DI_best and bestSplitIdx
-    num_t DI = math::deltaImpurity_regr(mu_tot,n_tot,mu_left,n_left,mu_right,n_right);
-    //cout << "(" << n_left << "," << tv[i] << "," << DI << ")";
-    if (  DI > DI_best ) {
-
-      splitIdx = i;
-      DI_best = DI;
-
-    }
-
-  }
-
-  return(DI_best);
-}
-
-num_t utils::numericalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
-						     const vector<num_t>& fv,
-						     const size_t minSamples,
-						     size_t& splitIdx) {
- 
-  size_t n_tot = tv.size();
-  size_t n_left = 0;
-  size_t n_right = n_tot;
- 
-  unordered_map<cat_t,size_t> freq_right(n_tot);
-  size_t sf_right = 0;
-  
-  for ( size_t i = 0; i < n_tot; ++i ) {
-    math::incrementSquaredFrequency(tv[i],freq_right,sf_right);
-  }
-  
-  size_t sf_tot = sf_right;
-  
-  unordered_map<cat_t,size_t> freq_left(n_tot);
-  size_t sf_left = 0;
-
-  num_t DI_best = 0.0;
-  
-  // Add samples one by one from right to left until we hit the
-  // minimum allowed size of the branch
-  for( size_t i = 0; i < n_tot - minSamples; ++i ) {
-    
-    // Add n'th sample tv[i] from right to left and update
-    // mean and squared frequency
-    math::incrementSquaredFrequency(tv[i],freq_left,sf_left);
-    ++n_left;
-    
-    math::decrementSquaredFrequency(tv[i],freq_right,sf_right);
-    --n_right;
-    
-    // If we have repeated samples and can continue, continue
-    if ( n_left < minSamples || (n_left < n_tot - minSamples && fv[ i + 1 ] == fv[ i ]) ) {
-      continue;
-    }
-    
-    // If the split point "i-1" yields a better split than the previous one,
-    // update se_best and bestSplitIdx
-    num_t DI = math::deltaImpurity_class(sf_tot,n_tot,sf_left,n_left,sf_right,n_right);
-    
-    if ( DI > DI_best ) {
-      splitIdx = i;
-      DI_best = DI;
-    }
-    
-  }
-  
-  return(DI_best);
-  
-}
-
-num_t utils::categoricalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
-						     const vector<cat_t>& fv,
-						     const size_t minSamples,
-						     const vector<cat_t>& catOrder,
-						     unordered_map<cat_t,vector<size_t> >& fmap_left,
-						     unordered_map<cat_t,vector<size_t> >& fmap_right) {
-  
-  fmap_left.clear();
-  fmap_left.rehash(2*catOrder.size());
-  fmap_right.clear();
-  fmap_right.rehash(2*catOrder.size());
-
-  size_t n_tot = 0;
-  
-  datadefs::map_data(fv,fmap_right,n_tot);
-
-  size_t n_right = n_tot;
-  size_t n_left = 0;
-  
-  num_t mu_tot = math::mean(tv);
-  num_t mu_right = mu_tot;
-  num_t mu_left = 0.0;
-  
-  num_t DI_best = 0.0;
-  
-  for ( size_t i = 0; i < catOrder.size(); ++i ) {
-    
-    unordered_map<cat_t,vector<size_t> >::const_iterator it( fmap_right.find(catOrder[i]) );
-
-    assert( it != fmap_right.end() );
-
-    if ( n_right - it->second.size() < minSamples ) {
-      continue;
-    }
-    
-    for ( size_t j = 0; j < it->second.size(); ++j ) {
-      
-      ++n_left;
-      --n_right;
-      mu_left  += ( tv[ it->second[j] ] - mu_left  ) / n_left;
-      mu_right -= ( tv[ it->second[j] ] - mu_right ) / n_right;
-      
-    }
-    
-    num_t DI = math::deltaImpurity_regr(mu_tot,n_tot,mu_left,n_left,mu_right,n_right);
-    
-    if ( DI > DI_best ) { 
-
-      DI_best = DI;
-      
-      fmap_left.insert( *it );
-      fmap_right.erase( it->first );
-      
-    } else {
-      
-      for ( size_t j = 0; j < it->second.size(); ++j ) {
-	
-	--n_left;
-	++n_right;
-	mu_left  -= ( tv[ it->second[j] ] - mu_left  ) / n_left;
-	mu_right += ( tv[ it->second[j] ] - mu_right ) / n_right;
-	
-      }    
-    }
-  }    
-  
-  return(DI_best);
-  
-}
-
-num_t utils::categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
-						       const vector<cat_t>& fv,
-						       const size_t minSamples,
-						       const vector<cat_t>& catOrder,
-						       unordered_map<cat_t,vector<size_t> >& fmap_left,
-						       unordered_map<cat_t,vector<size_t> >& fmap_right) {
-
-  fmap_left.clear();
-  fmap_left.rehash(2*catOrder.size());
-  fmap_right.clear();
-  fmap_right.rehash(2*catOrder.size());
-
-  size_t n_tot = 0;
-
-  datadefs::map_data(fv,fmap_right,n_tot);
-
-  size_t n_right = n_tot;
-  size_t n_left = 0;
-
-  size_t sf_right = 0;
-  size_t sf_left = 0;
-
-  unordered_map<cat_t,size_t> freq_left(catOrder.size());
-  unordered_map<cat_t,size_t> freq_right(catOrder.size());
-
-  for( size_t i = 0; i < n_tot; ++i ) {
-    math::incrementSquaredFrequency(tv[i], freq_right, sf_right);
-  }
-
-  size_t sf_tot = sf_right;
- 
-  num_t DI_best = 0.0;
-
-  for ( size_t i = 0; i < catOrder.size(); ++i ) {
-
-    unordered_map<cat_t,vector<size_t> >::const_iterator it( fmap_right.find(catOrder[i]) );
-
-    assert( it != fmap_right.end() );
-
-    if ( n_right - it->second.size() < minSamples ) {
-      continue;
-    }
-
-    //cout << "Sending category " << catOrder[i] << " from right to left: [" << flush;
-    for ( size_t j = 0; j < it->second.size(); ++j ) {
-
-      //cout << " " << tv[it->second[j]] << flush;
-
-      ++n_left;
-      math::incrementSquaredFrequency(tv[ it->second[j] ],freq_left,sf_left);
-      
-      --n_right;
-      math::decrementSquaredFrequency(tv[ it->second[j] ],freq_right,sf_right);
-      
-    }
-    
-    //cout << "]" << flush;
-
-    num_t DI = math::deltaImpurity_class(sf_tot,n_tot,sf_left,n_left,sf_right,n_right);
-
-    if ( DI > DI_best ) {
-
-      //cout << " IMPROVED " << DI << " > " << DI_best << flush;
-
-      DI_best = DI;
-
-      fmap_left.insert( *it );
-      fmap_right.erase( it->first );
-
-    } else {
-
-      //cout << " moving back: [" << flush;
-
-      for ( size_t j = 0; j < it->second.size(); ++j ) {
-
-	//cout << " " << tv[ it->second[j] ] << flush;
-
-        --n_left;
-	math::decrementSquaredFrequency(tv[ it->second[j] ],freq_left,sf_left);
-
-        ++n_right;
-	math::incrementSquaredFrequency(tv[ it->second[j] ],freq_right,sf_right);
-
-      }
-      //cout << "] " << flush;
-    }
-    //cout << endl;
-  }
-
-  return(DI_best);
-
-}
-
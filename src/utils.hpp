@@ -176,31 +176,23 @@ namespace utils {
 
   }
 
-  num_t numericalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
-					      const vector<num_t>& fv,
-					      const size_t minSamples,
-					      size_t& splitIdx);
-  
-  num_t numericalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
-						const vector<num_t>& fv,
-						const size_t minSamples,
-						size_t& splitIdx);
-  
-  num_t categoricalFeatureSplitsNumericalTarget(const vector<num_t>& tv,
-						const vector<cat_t>& fv,
-						const size_t minSamples,
-						const vector<cat_t>& catOrder,
-						unordered_map<cat_t,vector<size_t> >& fmap_left,
-						unordered_map<cat_t,vector<size_t> >& fmap_right);
-  
-  num_t categoricalFeatureSplitsCategoricalTarget(const vector<cat_t>& tv,
-						  const vector<cat_t>& fv,
-						  const size_t minSamples,
-						  const vector<cat_t>& catOrder,
-						  unordered_map<cat_t,vector<size_t> >& fmap_left,
-						  unordered_map<cat_t,vector<size_t> >& fmap_right);
-  
-  
+  // Collects data[ics[i]], each repeated multiplicity[ics[i]] times
+  template<typename T>
+  vector<T> repeat(const vector<T>& data, const vector<size_t>& ics, const vector<uint8_t>& multiplicity) {
+
+    vector<T> repeated;
+    repeated.reserve(ics.size());
+
+    for ( size_t i = 0; i < ics.size(); ++i ) {
+      for ( size_t k = 0; k < multiplicity[ics[i]]; ++k ) {
+	repeated.push_back(data[ics[i]]);
+      }
+    }
+
+    return( repeated );
+
+  }
+
 }
 
 #endif
@@ -9,9 +9,11 @@
 using namespace std;
 
 void math_newtest_erf();
+void math_newtest_normalQuantile();
 void math_newtest_var();
 void math_newtest_pearsonCorrelation();
 void math_newtest_ttest();
+void math_newtest_moments();
 void math_newtest_mean();
 void math_newtest_mode();
 void math_newtest_gamma();
@@ -21,9 +23,11 @@ void math_newtest_deltaImpurity_class();
 void math_newtest() {
 
   newtest( "erf(x)", &math_newtest_erf );
+  newtest( "normalQuantile(x)", &math_newtest_normalQuantile );
   newtest( "var(x)", &math_newtest_var );
   newtest( "corr(x)", &math_newtest_pearsonCorrelation );
   newtest( "ttest(x,y)", &math_newtest_ttest );
+  newtest( "Moments(x)", &math_newtest_moments );
   newtest( "mean(x)", &math_newtest_mean );
   newtest( "mode(x)", &math_newtest_mode );
   newtest( "gamma(x)", &math_newtest_gamma );
@@ -47,6 +51,16 @@ void math_newtest_erf() {
 
 }
 
+void math_newtest_normalQuantile() {
+
+  newassert(fabs(math::normalQuantile(0.5)) < 1e-5 );
+  newassert(fabs(math::normalQuantile(0.975) - 1.959964) < 1e-2 );
+  newassert(fabs(math::normalQuantile(0.025) + 1.959964) < 1e-2 );
+  newassert(fabs(math::normalQuantile(0.999) - 3.090232) < 2e-2 );
+  newassert(datadefs::isNAN(math::normalQuantile(1.0)));
+
+}
+
 void math_newtest_var() {
 
   vector<datadefs::num_t> data;
@@ -215,6 +229,43 @@ void math_newtest_ttest() {
 
 }
 
+void math_newtest_moments() {
+
+  vector<datadefs::num_t> x,y;
+  math::Moments mx,my;
+
+  for(size_t i = 0; i < 10; ++i) {
+    x.push_back(static_cast<datadefs::num_t>(i*i+6.0));
+    y.push_back(static_cast<datadefs::num_t>(3.0*i+4.0));
+    mx.add(x.back());
+    my.add(y.back());
+  }
+
+  newassert( mx.n == 10 );
+  newassert( fabs( mx.mean - math::mean(x) ) < 1e-5 );
+  newassert( fabs( mx.var() - math::var(x) ) < 1e-3 );
+
+  // The test from the moments equals the test from the samples
+  newassert( fabs( math::ttest(mx,my) - math::ttest(x,y) ) < 1e-5 );
+  newassert( fabs( math::ttest(my,mx,true) - math::ttest(y,x,true) ) < 1e-5 );
+
+  // Merging moments equals adding the values one by one
+  math::Moments mxy = mx;
+  mxy.merge(my);
+  math::Moments mxy2 = mx;
+  for(size_t i = 0; i < y.size(); ++i) {
+    mxy2.add(y[i]);
+  }
+  newassert( mxy.n == 20 );
+  newassert( fabs( mxy.mean - mxy2.mean ) < 1e-9 );
+  newassert( fabs( mxy.M2 - mxy2.M2 ) < 1e-6 );
+
+  math::Moments empty;
+  newassert( datadefs::isNAN(empty.var()) );
+  newassert( datadefs::isNAN(math::ttest(empty,my)) );
+
+}
+
 void math_newtest_mean() {
 
   vector<datadefs::num_t> x;
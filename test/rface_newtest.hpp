@@ -3,6 +3,9 @@
 
 #include <cstdlib>
 #include <cmath>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
 #include "options.hpp"
 #include "densetreedata.hpp"
 #include "rf_ace.hpp"
@@ -21,6 +24,24 @@ void rface_newtest_RF_save_load_regression();
 void rface_newtest_QRF_save_load_regression();
 void rface_newtest_GBT_save_load_classification();
 void rface_newtest_GBT_save_load_regression();
+void rface_newtest_RF_oob_error();
+void rface_newtest_RF_oob_early_stopping();
+void rface_newtest_RF_permutation_importance();
+void rface_newtest_RF_MDI_and_minimal_depth();
+void rface_newtest_RF_thread_independence();
+void rface_newtest_filter_thread_independence();
+void rface_newtest_filter_multiple_targets();
+void rface_newtest_filter_adaptive_permutations();
+void rface_newtest_filter_adaptive_permutations_null();
+void rface_newtest_filter_multiple_contrast_sets();
+void rface_newtest_filter_merge_partials();
+void rface_newtest_RF_merge_forests();
+void rface_newtest_RF_merge_forest_shards();
+void rface_newtest_RF_resume_from_checkpoint();
+void rface_newtest_RF_resume_with_early_stopping();
+void rface_newtest_RF_evict_trees();
+void rface_newtest_filter_evict_trees();
+void rface_newtest_RF_warm_start();
 
 void rface_newtest() {
   
@@ -34,6 +55,24 @@ void rface_newtest() {
   newtest( "save/load QRF for regression", &rface_newtest_QRF_save_load_regression );
   //newtest( "Testing save/load GBT for classification", &rface_newtest_GBT_save_load_classification );
   //newtest( "Testing save/load GBT for regression", &rface_newtest_GBT_save_load_regression );
+  newtest( "OOB error for RF", &rface_newtest_RF_oob_error );
+  newtest( "OOB early stopping for RF", &rface_newtest_RF_oob_early_stopping );
+  newtest( "permutation importance for RF", &rface_newtest_RF_permutation_importance );
+  newtest( "MDI and minimal depth for RF", &rface_newtest_RF_MDI_and_minimal_depth );
+  newtest( "RF independent of the number of threads", &rface_newtest_RF_thread_independence );
+  newtest( "filter independent of the number of threads", &rface_newtest_filter_thread_independence );
+  newtest( "filter for multiple targets", &rface_newtest_filter_multiple_targets );
+  newtest( "filter with adaptive permutations", &rface_newtest_filter_adaptive_permutations );
+  newtest( "filter with adaptive permutations on null data", &rface_newtest_filter_adaptive_permutations_null );
+  newtest( "filter with multiple contrast sets", &rface_newtest_filter_multiple_contrast_sets );
+  newtest( "filter merged from partial results", &rface_newtest_filter_merge_partials );
+  newtest( "merge RF trained in parts", &rface_newtest_RF_merge_forests );
+  newtest( "merge RF trained in disjoint tree ranges", &rface_newtest_RF_merge_forest_shards );
+  newtest( "resume RF from a checkpoint", &rface_newtest_RF_resume_from_checkpoint );
+  newtest( "resume RF with early stopping", &rface_newtest_RF_resume_with_early_stopping );
+  newtest( "RF with trees evicted to file", &rface_newtest_RF_evict_trees );
+  newtest( "filter with trees evicted to file", &rface_newtest_filter_evict_trees );
+  newtest( "RF warm started from a saved model", &rface_newtest_RF_warm_start );
 
 }
 
@@ -276,4 +315,955 @@ void rface_newtest_GBT_save_load_regression() {
 
 }
 
+void rface_newtest_RF_oob_error() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.setRFDefaults();
+  forestOptions.mTry = 30;
+
+  vector<distributions::Random> randoms(2,distributions::Random(0));
+
+  size_t targetIdx = trainData.getFeatureIdx("C:class");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  StochasticForest SF;
+  SF.learnRF(&trainData,targetIdx,&forestOptions,weights,randoms);
+
+  vector<cat_t> catOobPredictions = SF.getCatOobPredictions();
+
+  newassert( catOobPredictions.size() == trainData.nSamples() );
+
+  // The errors are recomputed from the predictions of the samples that were out-of-bag at least once
+  size_t nMisses = 0;
+  size_t nOobSamples = 0;
+  for ( size_t i = 0; i < trainData.nSamples(); ++i ) {
+    if ( !datadefs::isNAN(catOobPredictions[i]) ) {
+      nMisses += catOobPredictions[i] != trainData.feature(targetIdx)->catData[i];
+      ++nOobSamples;
+    }
+  }
+
+  newassert( nOobSamples > 0 );
+  newassert( fabs(SF.getOobError() - 1.0 * nMisses / nOobSamples) < 1e-6 );
+
+  // Better than guessing among the three classes
+  newassert( SF.getOobError() < 0.66 );
+
+  targetIdx = trainData.getFeatureIdx("N:output");
+  weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  SF.learnRF(&trainData,targetIdx,&forestOptions,weights,randoms);
+
+  vector<num_t> numOobPredictions = SF.getNumOobPredictions();
+
+  newassert( numOobPredictions.size() == trainData.nSamples() );
+  newassert( SF.getCatOobPredictions().size() == 0 );
+
+  // Mean squared error is below the variance of the target
+  vector<num_t> trueData = utils::removeNANs(trainData.feature(targetIdx)->numData);
+  newassert( SF.getOobError() > 0.0 );
+  newassert( SF.getOobError() < math::var(trueData) );
+
+}
+
+void rface_newtest_RF_oob_early_stopping() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.setRFDefaults();
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 500;
+  forestOptions.oobTolerance = 0.5;
+  forestOptions.oobWindow = 10;
+
+  vector<distributions::Random> randoms(2,distributions::Random(0));
+
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  StochasticForest SF;
+  SF.learnRF(&trainData,targetIdx,&forestOptions,weights,randoms);
+
+  // With a loose tolerance the error settles well before all trees are grown,
+  // and the forest is cut at a window boundary
+  newassert( SF.nTrees() < forestOptions.nTrees );
+  newassert( SF.nTrees() >= 2 * forestOptions.oobWindow );
+  newassert( SF.nTrees() % forestOptions.oobWindow == 0 );
+  newassert( !datadefs::isNAN(SF.getOobError()) );
+
+  // Without a tolerance every tree is grown
+  forestOptions.oobTolerance = 0.0;
+  forestOptions.nTrees = 50;
+
+  SF.learnRF(&trainData,targetIdx,&forestOptions,weights,randoms);
+
+  newassert( SF.nTrees() == 50 );
+
+}
+
+void rface_newtest_RF_permutation_importance() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.setRFDefaults();
+  forestOptions.mTry = 30;
+
+  vector<distributions::Random> randoms(2,distributions::Random(0));
+
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  StochasticForest SF;
+  SF.learnRF(&trainData,targetIdx,&forestOptions,weights,randoms);
+
+  vector<num_t> importanceValues;
+  vector<num_t> contrastImportanceValues;
+
+  SF.getImportanceValues(&trainData,importanceValues,contrastImportanceValues,randoms);
+
+  newassert( importanceValues.size() == trainData.nFeatures() );
+  newassert( contrastImportanceValues.size() == trainData.nFeatures() );
+
+  // The target is never split with, and the strongest predictor ranks first
+  newassert( datadefs::isNAN(importanceValues[targetIdx]) );
+
+  size_t inputIdx = trainData.getFeatureIdx("N:input");
+  newassert( importanceValues[inputIdx] > 0.0 );
+
+  bool isMax = true;
+  for ( size_t featureIdx = 0; featureIdx < trainData.nFeatures(); ++featureIdx ) {
+    if ( !datadefs::isNAN(importanceValues[featureIdx]) ) {
+      isMax = isMax && importanceValues[featureIdx] <= importanceValues[inputIdx];
+    }
+  }
+  newassert( isMax );
+
+  // One thread gives the same ranking for the top feature
+  vector<distributions::Random> random(1,distributions::Random(0));
+  SF.getImportanceValues(&trainData,importanceValues,contrastImportanceValues,random);
+
+  newassert( importanceValues[inputIdx] > 0.0 );
+
+}
+
+void rface_newtest_RF_MDI_and_minimal_depth() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',true);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.setRFDefaults();
+  forestOptions.mTry = 30;
+  forestOptions.useContrasts = true;
+
+  vector<distributions::Random> randoms(2,distributions::Random(0));
+
+  trainData.permuteContrasts(&randoms[0]);
+
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  StochasticForest SF;
+  SF.learnRF(&trainData,targetIdx,&forestOptions,weights,randoms);
+
+  vector<num_t> MDI,contrastMDI;
+  SF.getMDI(&trainData,MDI,contrastMDI);
+
+  // The sums collected during growth agree with the ones read back from the trees
+  SF.DISums_.clear();
+  SF.featureTreeCounts_.clear();
+
+  vector<num_t> treeMDI,treeContrastMDI;
+  SF.getMDI(&trainData,treeMDI,treeContrastMDI);
+
+  newassert( MDI.size() == treeMDI.size() );
+  newassert( contrastMDI.size() == treeContrastMDI.size() );
+
+  bool isEqual = true;
+  for ( size_t featureIdx = 0; featureIdx < MDI.size(); ++featureIdx ) {
+    isEqual = isEqual && datadefs::isNAN(MDI[featureIdx]) == datadefs::isNAN(treeMDI[featureIdx]);
+    isEqual = isEqual && ( datadefs::isNAN(MDI[featureIdx]) || fabs(MDI[featureIdx] - treeMDI[featureIdx]) < 1e-4 * fabs(treeMDI[featureIdx]) + 1e-6 );
+    isEqual = isEqual && datadefs::isNAN(contrastMDI[featureIdx]) == datadefs::isNAN(treeContrastMDI[featureIdx]);
+    isEqual = isEqual && ( datadefs::isNAN(contrastMDI[featureIdx]) || fabs(contrastMDI[featureIdx] - treeContrastMDI[featureIdx]) < 1e-4 * fabs(treeContrastMDI[featureIdx]) + 1e-6 );
+  }
+  newassert( isEqual );
+
+  newassert( !datadefs::isNAN(MDI[trainData.getFeatureIdx("N:input")]) );
+
+  // The strongest predictor splits closer to the root than the contrasts
+  vector<num_t> depthValues,contrastDepthValues;
+  SF.getMeanMinimalDepthValues(&trainData,depthValues,contrastDepthValues);
+
+  newassert( depthValues.size() == trainData.nFeatures() );
+  newassert( contrastDepthValues.size() == trainData.nFeatures() );
+
+  num_t inputDepth = depthValues[trainData.getFeatureIdx("N:input")];
+  vector<num_t> contrastDepths = utils::removeNANs(contrastDepthValues);
+
+  newassert( inputDepth >= 0.0 );
+  newassert( contrastDepths.size() > 0 );
+  newassert( inputDepth < math::mean(contrastDepths) );
+
+}
+
+void rface_newtest_RF_thread_independence() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+
+  ForestOptions forestOptions(forest_t::QRF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 20;
+
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  // The same seed for the first generator, but a different number of threads
+  vector<distributions::Random> randoms1(1,distributions::Random(0));
+  vector<distributions::Random> randoms3(3,distributions::Random(0));
+
+  StochasticForest SF1,SF3;
+  SF1.learnRF(&trainData,targetIdx,&forestOptions,weights,randoms1);
+  SF3.learnRF(&trainData,targetIdx,&forestOptions,weights,randoms3);
+
+  string fileName1 = "test/data/rface_newtest_threads1.sf";
+  string fileName3 = "test/data/rface_newtest_threads3.sf";
+
+  ofstream toFile1(fileName1.c_str());
+  SF1.writeForest(toFile1);
+  ofstream toFile3(fileName3.c_str());
+  SF3.writeForest(toFile3);
+
+  ifstream fromFile1(fileName1.c_str());
+  ifstream fromFile3(fileName3.c_str());
+  string forest1((istreambuf_iterator<char>(fromFile1)),istreambuf_iterator<char>());
+  string forest3((istreambuf_iterator<char>(fromFile3)),istreambuf_iterator<char>());
+
+  remove(fileName1.c_str());
+  remove(fileName3.c_str());
+
+  newassert( forest1.size() > 0 );
+  newassert( forest1 == forest3 );
+
+  vector<num_t> MDI1,contrastMDI1,MDI3,contrastMDI3;
+  SF1.getMDI(&trainData,MDI1,contrastMDI1);
+  SF3.getMDI(&trainData,MDI3,contrastMDI3);
+
+  bool isEqual = true;
+  for ( size_t featureIdx = 0; featureIdx < MDI1.size(); ++featureIdx ) {
+    isEqual = isEqual && ( MDI1[featureIdx] == MDI3[featureIdx] || ( datadefs::isNAN(MDI1[featureIdx]) && datadefs::isNAN(MDI3[featureIdx]) ) );
+  }
+  newassert( isEqual );
+
+}
+
+void rface_newtest_filter_thread_independence() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData filterData1(fileName,'\t',':',true);
+  DenseTreeData filterData3(fileName,'\t',':',true);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 10;
+
+  FilterOptions filterOptions;
+  filterOptions.nPerms = 5;
+
+  size_t targetIdx = filterData1.getFeatureIdx("N:output");
+  vector<num_t> weights = filterData1.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  // With three threads the permutations are grown in a pipeline
+  RFACE rface1(1,7);
+  RFACE rface3(3,7);
+
+  string forestFile1 = "test/data/rface_newtest_filter1.sf";
+  string forestFile3 = "test/data/rface_newtest_filter3.sf";
+
+  RFACE::FilterOutput filterOutput1 = rface1.filter(&filterData1,targetIdx,weights,&forestOptions,&filterOptions,forestFile1);
+  RFACE::FilterOutput filterOutput3 = rface3.filter(&filterData3,targetIdx,weights,&forestOptions,&filterOptions,forestFile3);
+
+  ifstream fromFile1(forestFile1.c_str());
+  ifstream fromFile3(forestFile3.c_str());
+  string forests1((istreambuf_iterator<char>(fromFile1)),istreambuf_iterator<char>());
+  string forests3((istreambuf_iterator<char>(fromFile3)),istreambuf_iterator<char>());
+
+  remove(forestFile1.c_str());
+  remove(forestFile3.c_str());
+
+  // The forests of all permutations are written, in order
+  newassert( forests1.size() > 0 );
+  newassert( forests1 == forests3 );
+
+  newassert( filterOutput1.featureNames == filterOutput3.featureNames );
+  newassert( filterOutput1.pValues == filterOutput3.pValues );
+  newassert( filterOutput1.importances == filterOutput3.importances );
+
+}
+
+void rface_newtest_filter_multiple_targets() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData filterData(fileName,'\t',':',true);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 5;
+
+  FilterOptions filterOptions;
+  filterOptions.nPerms = 5;
+
+  string forestFile = "test/data/rface_newtest_filter_targets.sf";
+  remove(forestFile.c_str());
+
+  RFACE rface(2,3);
+
+  // The same data serves both targets, and the forests of both end up in one file
+  size_t targetIcs[] = { filterData.getFeatureIdx("N:output"), filterData.getFeatureIdx("C:class") };
+
+  vector<RFACE::FilterOutput> filterOutputs;
+
+  for ( size_t i = 0; i < 2; ++i ) {
+    vector<num_t> weights = filterData.getFeatureWeights();
+    weights[targetIcs[i]] = 0;
+    rface.resetRandomNumberGenerators(2,3);
+    filterOutputs.push_back( rface.filter(&filterData,targetIcs[i],weights,&forestOptions,&filterOptions,forestFile) );
+  }
+
+  newassert( filterOutputs[0].targetName == "N:output" );
+  newassert( filterOutputs[1].targetName == "C:class" );
+
+  ifstream fromFile(forestFile.c_str());
+  size_t nTrees = 0;
+  string line;
+  while ( getline(fromFile,line) ) {
+    if ( line.compare(0,5,"TREE=") == 0 ) {
+      ++nTrees;
+    }
+  }
+
+  remove(forestFile.c_str());
+
+  newassert( nTrees == 2 * filterOptions.nPerms * forestOptions.nTrees );
+
+  // Filtering the first target again gives the same associations as before
+  vector<num_t> weights = filterData.getFeatureWeights();
+  weights[targetIcs[0]] = 0;
+  rface.resetRandomNumberGenerators(2,3);
+  RFACE::FilterOutput filterOutput = rface.filter(&filterData,targetIcs[0],weights,&forestOptions,&filterOptions);
+
+  newassert( filterOutput.featureNames == filterOutputs[0].featureNames );
+  newassert( filterOutput.pValues == filterOutputs[0].pValues );
+
+}
+
+void rface_newtest_filter_adaptive_permutations() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData filterData(fileName,'\t',':',true);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 10;
+
+  FilterOptions filterOptions;
+  filterOptions.nPerms = 20;
+  filterOptions.permBatch = 5;
+  filterOptions.pValueThreshold = 0.01;
+
+  size_t targetIdx = filterData.getFeatureIdx("N:output");
+  vector<num_t> weights = filterData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  RFACE rface(2,1);
+  RFACE::FilterOutput filterOutput = rface.filter(&filterData,targetIdx,weights,&forestOptions,&filterOptions);
+
+  // The features the target is made of are settled significant early on
+  newassert( filterOutput.nSignificantFeatures >= 2 );
+  newassert( find(filterOutput.featureNames.begin(),filterOutput.featureNames.end(),"N:input") != filterOutput.featureNames.end() );
+  newassert( find(filterOutput.featureNames.begin(),filterOutput.featureNames.end(),"C:class") != filterOutput.featureNames.end() );
+
+  for ( size_t i = 0; i < filterOutput.pValues.size(); ++i ) {
+    newassert( filterOutput.pValues[i] <= filterOptions.pValueThreshold );
+  }
+
+}
+
+void rface_newtest_filter_adaptive_permutations_null() {
+
+  // Noise features and a noise target
+  size_t nFeatures = 40;
+  size_t nSamples = 200;
+
+  distributions::Random random(3);
+
+  ofstream toFile("foo_null.afm");
+  for ( size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx ) {
+    toFile << "\ts" << sampleIdx;
+  }
+  toFile << endl;
+  for ( size_t featureIdx = 0; featureIdx <= nFeatures; ++featureIdx ) {
+    toFile << "N:" << ( featureIdx == nFeatures ? string("target") : "noise" + utils::num2str(featureIdx) );
+    for ( size_t sampleIdx = 0; sampleIdx < nSamples; ++sampleIdx ) {
+      toFile << "\t" << random.uniform();
+    }
+    toFile << endl;
+  }
+  toFile.close();
+
+  DenseTreeData filterData("foo_null.afm",'\t',':',true);
+  remove("foo_null.afm");
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 10;
+  forestOptions.nTrees = 20;
+
+  FilterOptions filterOptions;
+  filterOptions.nPerms = 20;
+  filterOptions.permBatch = 4;
+  filterOptions.pValueThreshold = 0.05;
+
+  size_t targetIdx = filterData.getFeatureIdx("N:target");
+  vector<num_t> weights = filterData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  // The early looks and the final test together keep the false positives within the threshold
+  size_t nRuns = 10;
+  size_t nFalsePositives = 0;
+
+  for ( size_t runIdx = 0; runIdx < nRuns; ++runIdx ) {
+    RFACE rface(2,runIdx);
+    RFACE::FilterOutput filterOutput = rface.filter(&filterData,targetIdx,weights,&forestOptions,&filterOptions);
+    nFalsePositives += filterOutput.nSignificantFeatures;
+  }
+
+  newassert( nFalsePositives <= filterOptions.pValueThreshold * nRuns * nFeatures );
+
+}
+
+void rface_newtest_filter_multiple_contrast_sets() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData filterData(fileName,'\t',':',true);
+
+  size_t nFeatures = filterData.nFeatures();
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 10;
+
+  FilterOptions filterOptions;
+  filterOptions.nPerms = 5;
+  filterOptions.nContrastSets = 4;
+  filterOptions.pValueThreshold = 0.01;
+
+  size_t targetIdx = filterData.getFeatureIdx("N:output");
+  vector<num_t> weights = filterData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  RFACE rface(2,1);
+  RFACE::FilterOutput filterOutput = rface.filter(&filterData,targetIdx,weights,&forestOptions,&filterOptions);
+
+  // The extra sets are appended after the first set of contrasts
+  newassert( filterData.nContrastSets() == 4 );
+  newassert( filterData.nFeatures() == nFeatures );
+  newassert( filterData.getFeatureIdx("N:input_CONTRAST") == nFeatures + filterData.getFeatureIdx("N:input") );
+  newassert( filterData.getFeatureIdx("N:input_CONTRAST4") == 4 * nFeatures + filterData.getFeatureIdx("N:input") );
+
+  newassert( find(filterOutput.featureNames.begin(),filterOutput.featureNames.end(),"N:input") != filterOutput.featureNames.end() );
+  newassert( find(filterOutput.featureNames.begin(),filterOutput.featureNames.end(),"C:class") != filterOutput.featureNames.end() );
+
+  // Going back to one set drops the extra sets
+  filterData.setNContrastSets(1);
+  newassert( filterData.nFeatures() == nFeatures );
+  newassert( filterData.getFeatureIdx("N:input_CONTRAST2") == filterData.end() );
+
+}
+
+void rface_newtest_filter_merge_partials() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData filterData(fileName,'\t',':',true);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 10;
+
+  FilterOptions filterOptions;
+  filterOptions.nPerms = 5;
+  filterOptions.pValueThreshold = 0.05;
+
+  size_t targetIdx = filterData.getFeatureIdx("N:output");
+  vector<num_t> weights = filterData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  vector<string> partialFiles;
+  partialFiles.push_back("foo_partial0.tsv");
+  partialFiles.push_back("foo_partial1.tsv");
+
+  RFACE rface(1,1);
+  RFACE::FilterOutput filterOutput0 = rface.filter(&filterData,targetIdx,weights,&forestOptions,&filterOptions,"",partialFiles[0]);
+
+  // Merging a single partial result reproduces the filter
+  vector<RFACE::FilterOutput> mergedOutputs = rface.mergeFilterPartials(vector<string>(1,partialFiles[0]),&filterOptions);
+
+  newassert( mergedOutputs.size() == 1 );
+  newassert( mergedOutputs[0].targetName == "N:output" );
+  newassert( mergedOutputs[0].featureNames == filterOutput0.featureNames );
+  newassert( mergedOutputs[0].pValues == filterOutput0.pValues );
+
+  rface.resetRandomNumberGenerators(1,2);
+  rface.filter(&filterData,targetIdx,weights,&forestOptions,&filterOptions,"",partialFiles[1]);
+
+  // Two partials of 5 permutations test like 10 permutations, so the
+  // features the target is made of get smaller p-values
+  mergedOutputs = rface.mergeFilterPartials(partialFiles,&filterOptions);
+
+  newassert( mergedOutputs.size() == 1 );
+  newassert( find(mergedOutputs[0].featureNames.begin(),mergedOutputs[0].featureNames.end(),"N:input") != mergedOutputs[0].featureNames.end() );
+  newassert( mergedOutputs[0].pValues[0] < filterOutput0.pValues[0] );
+
+  // With adaptive permutations the merge splits the threshold over the same tests as the filter
+  FilterOptions batchOptions = filterOptions;
+  batchOptions.nPerms = 6;
+  batchOptions.permBatch = 2;
+  batchOptions.pValueThreshold = 0.5;
+
+  remove(partialFiles[0].c_str());
+  rface.resetRandomNumberGenerators(1,1);
+  RFACE::FilterOutput batchOutput = rface.filter(&filterData,targetIdx,weights,&forestOptions,&batchOptions,"",partialFiles[0]);
+
+  mergedOutputs = rface.mergeFilterPartials(vector<string>(1,partialFiles[0]),&batchOptions);
+
+  newassert( mergedOutputs.size() == 1 );
+  newassert( mergedOutputs[0].featureNames == batchOutput.featureNames );
+  newassert( mergedOutputs[0].pValues == batchOutput.pValues );
+  for ( size_t i = 0; i < mergedOutputs[0].pValues.size(); ++i ) {
+    newassert( mergedOutputs[0].pValues[i] <= batchOptions.pValueThreshold / 3 );
+  }
+
+  remove(partialFiles[0].c_str());
+  remove(partialFiles[1].c_str());
+
+}
+
+void rface_newtest_RF_merge_forests() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+
+  vector<string> forestFiles;
+  forestFiles.push_back("foo_part0.sf");
+  forestFiles.push_back("foo_part1.sf");
+
+  // The parts are trained with different seeds and sizes
+  for ( size_t i = 0; i < forestFiles.size(); ++i ) {
+    forestOptions.nTrees = 10 + 5 * i;
+    RFACE rface(1,i);
+    rface.train(&trainData,targetIdx,weights,&forestOptions);
+    rface.save(forestFiles[i]);
+  }
+
+  RFACE rface;
+
+  newassert( rface.mergeForests(forestFiles,"foo.sf") == 25 );
+
+  rface.load("foo.sf");
+
+  newassert( rface.nTrees() == 25 );
+
+  RFACE::TestOutput testOutput = rface.test(&trainData);
+
+  newassert( testOutput.targetName == "N:output" );
+  newassert( testOutput.numPredictions.size() == trainData.nSamples() );
+
+  remove(forestFiles[0].c_str());
+  remove(forestFiles[1].c_str());
+
+}
+
+void rface_newtest_RF_merge_forest_shards() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 20;
+
+  RFACE rface(2,1);
+  rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+  RFACE::TestOutput testOutput = rface.test(&trainData);
+
+  vector<string> forestFiles;
+  forestFiles.push_back("foo_shard0.sf");
+  forestFiles.push_back("foo_shard1.sf");
+
+  // The shards share the seed and cover the trees 0-9 and 10-19 of the same forest
+  forestOptions.nTrees = 10;
+  for ( size_t i = 0; i < forestFiles.size(); ++i ) {
+    forestOptions.treeOffset = 10 * i;
+    RFACE rface2(1 + i,1);
+    rface2.train(&trainData,targetIdx,weights,&forestOptions);
+    rface2.save(forestFiles[i]);
+  }
+
+  // The merged forest may replace one of its parts
+  RFACE rface2;
+
+  newassert( rface2.mergeForests(forestFiles,forestFiles[0]) == 20 );
+
+  rface2.load(forestFiles[0]);
+
+  RFACE::TestOutput testOutput2 = rface2.test(&trainData);
+
+  // The merged forest differs from the one grown at once only by the rounding of the file
+  newassert( rface2.nTrees() == 20 );
+  newassert( testOutput2.numPredictions.size() == testOutput.numPredictions.size() );
+  for ( size_t i = 0; i < testOutput.numPredictions.size(); ++i ) {
+    newassert( fabs( testOutput2.numPredictions[i] - testOutput.numPredictions[i] ) < 1e-3 * ( 1 + fabs(testOutput.numPredictions[i]) ) );
+  }
+
+  remove(forestFiles[0].c_str());
+  remove(forestFiles[1].c_str());
+
+}
+
+void rface_newtest_RF_resume_from_checkpoint() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 20;
+
+  RFACE rface(2,1);
+  rface.train(&trainData,targetIdx,weights,&forestOptions,"foo_checkpoint.sf");
+
+  RFACE::TestOutput testOutput = rface.test(&trainData);
+
+  // Interrupt the training in the middle of writing a tree
+  ifstream fromFile("foo_checkpoint.sf");
+  string checkpoint( (istreambuf_iterator<char>(fromFile)), istreambuf_iterator<char>() );
+  fromFile.close();
+
+  ofstream toFile("foo_checkpoint.sf");
+  toFile << checkpoint.substr(0,checkpoint.size() / 2);
+  toFile.close();
+
+  // The missing trees are grown from the seed in the checkpoint, not from the generators
+  RFACE rface2(3,2);
+  rface2.train(&trainData,targetIdx,weights,&forestOptions,"foo_checkpoint.sf",true);
+
+  RFACE::TestOutput testOutput2 = rface2.test(&trainData);
+
+  // The trees read back differ from the grown ones only by the rounding of the file
+  newassert( rface2.nTrees() == 20 );
+  newassert( testOutput2.numPredictions.size() == testOutput.numPredictions.size() );
+  for ( size_t i = 0; i < testOutput.numPredictions.size(); ++i ) {
+    newassert( fabs( testOutput2.numPredictions[i] - testOutput.numPredictions[i] ) < 1e-3 * ( 1 + fabs(testOutput.numPredictions[i]) ) );
+  }
+  newassert( fabs( rface2.getOobError() - rface.getOobError() ) < 1e-3 * rface.getOobError() );
+
+  // The checkpoint holds all the trees again
+  RFACE rface3;
+  rface3.load("foo_checkpoint.sf");
+  newassert( rface3.nTrees() == 20 );
+
+  // Interrupt the training in the middle of writing the header of a tree
+  size_t headerPos = checkpoint.find("\nTREE=",checkpoint.size() / 2);
+  newassert( headerPos != string::npos );
+
+  toFile.open("foo_checkpoint.sf");
+  toFile << checkpoint.substr(0,headerPos + 10);
+  toFile.close();
+
+  RFACE rface4(3,2);
+  rface4.train(&trainData,targetIdx,weights,&forestOptions,"foo_checkpoint.sf",true);
+
+  newassert( rface4.nTrees() == 20 );
+  newassert( fabs( rface4.getOobError() - rface.getOobError() ) < 1e-3 * rface.getOobError() );
+
+  remove("foo_checkpoint.sf");
+
+}
+
+void rface_newtest_RF_resume_with_early_stopping() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 200;
+  forestOptions.oobTolerance = 0.05;
+  forestOptions.oobWindow = 10;
+
+  RFACE rface(2,1);
+  rface.train(&trainData,targetIdx,weights,&forestOptions,"foo_checkpoint.sf");
+
+  // The run stops past the second window, where an error check seeing all trees would stop it
+  size_t nTrees = rface.nTrees();
+  newassert( nTrees < forestOptions.nTrees );
+  newassert( nTrees > 2 * forestOptions.oobWindow );
+
+  // Resuming a complete run stops where the run stopped
+  RFACE rface2(2,2);
+  rface2.train(&trainData,targetIdx,weights,&forestOptions,"foo_checkpoint.sf",true);
+
+  newassert( rface2.nTrees() == nTrees );
+  newassert( fabs( rface2.getOobError() - rface.getOobError() ) < 1e-3 * rface.getOobError() );
+
+  // Trees of the checkpoint past the stopping point are left out of the forest and the checkpoint
+  forestOptions.oobTolerance = 0.0;
+  RFACE rface3(2,1);
+  rface3.train(&trainData,targetIdx,weights,&forestOptions,"foo_checkpoint.sf");
+
+  forestOptions.oobTolerance = 0.05;
+  RFACE rface4(2,2);
+  rface4.train(&trainData,targetIdx,weights,&forestOptions,"foo_checkpoint.sf",true);
+
+  newassert( rface4.nTrees() == nTrees );
+  newassert( fabs( rface4.getOobError() - rface.getOobError() ) < 1e-3 * rface.getOobError() );
+
+  ifstream fromFile("foo_checkpoint.sf");
+  size_t nFileTrees = 0;
+  string newLine;
+  while ( getline(fromFile,newLine) ) {
+    nFileTrees += newLine.compare(0,5,"TREE=") == 0 ? 1 : 0;
+  }
+  fromFile.close();
+
+  newassert( nFileTrees == nTrees );
+
+  remove("foo_checkpoint.sf");
+
+}
+
+void rface_newtest_RF_evict_trees() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 20;
+
+  RFACE rface(3,1);
+  rface.train(&trainData,targetIdx,weights,&forestOptions);
+
+  RFACE rface2(3,1);
+  rface2.train(&trainData,targetIdx,weights,&forestOptions,"foo_evict.sf",false,true);
+
+  newassert( !rface.hasEvictedTrees() );
+  newassert( rface2.hasEvictedTrees() );
+
+  // The out-of-bag predictions and the impurity sums are collected before a tree is freed
+  newassert( rface2.getOobError() == rface.getOobError() );
+
+  vector<num_t> MDI,contrastMDI,MDI2,contrastMDI2;
+  rface.forestRef()->getMDI(&trainData,MDI,contrastMDI);
+  rface2.forestRef()->getMDI(&trainData,MDI2,contrastMDI2);
+
+  bool isEqual = MDI.size() == MDI2.size();
+  for ( size_t featureIdx = 0; isEqual && featureIdx < MDI.size(); ++featureIdx ) {
+    isEqual = MDI[featureIdx] == MDI2[featureIdx] || ( datadefs::isNAN(MDI[featureIdx]) && datadefs::isNAN(MDI2[featureIdx]) );
+  }
+  newassert( isEqual );
+
+  // All the trees are in the file
+  RFACE rface3;
+  rface3.load("foo_evict.sf");
+  newassert( rface3.nTrees() == 20 );
+
+  RFACE::TestOutput testOutput = rface.test(&trainData);
+  RFACE::TestOutput testOutput3 = rface3.test(&trainData);
+
+  for ( size_t i = 0; i < testOutput.numPredictions.size(); ++i ) {
+    newassert( fabs( testOutput3.numPredictions[i] - testOutput.numPredictions[i] ) < 1e-3 * ( 1 + fabs(testOutput.numPredictions[i]) ) );
+  }
+
+  remove("foo_evict.sf");
+
+}
+
+void rface_newtest_filter_evict_trees() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData filterData1(fileName,'\t',':',true);
+  DenseTreeData filterData3(fileName,'\t',':',true);
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 10;
+
+  FilterOptions filterOptions;
+  filterOptions.nPerms = 5;
+
+  size_t targetIdx = filterData1.getFeatureIdx("N:output");
+  vector<num_t> weights = filterData1.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  // Both the sequential filter and the pipeline evict
+  RFACE rface1(1,7);
+  RFACE rface3(3,7);
+  RFACE rface(3,7);
+
+  RFACE::FilterOutput filterOutput1 = rface1.filter(&filterData1,targetIdx,weights,&forestOptions,&filterOptions,"foo_evict1.sf","",true);
+  RFACE::FilterOutput filterOutput3 = rface3.filter(&filterData3,targetIdx,weights,&forestOptions,&filterOptions,"foo_evict3.sf","",true);
+  RFACE::FilterOutput filterOutput = rface.filter(&filterData3,targetIdx,weights,&forestOptions,&filterOptions);
+
+  newassert( filterOutput1.pValues == filterOutput.pValues );
+  newassert( filterOutput3.pValues == filterOutput.pValues );
+  newassert( filterOutput3.importances == filterOutput.importances );
+
+  // The trees of every permutation are in the files, in the same order for any number of threads
+  vector<string> forestTexts;
+  for ( size_t i = 0; i < 2; ++i ) {
+    string forestFile = i == 0 ? "foo_evict1.sf" : "foo_evict3.sf";
+    ifstream fromFile(forestFile.c_str());
+    size_t nTrees = 0;
+    string newLine;
+    string forestText;
+    while ( getline(fromFile,newLine) ) {
+      nTrees += newLine.compare(0,5,"TREE=") == 0 ? 1 : 0;
+      forestText += newLine + "\n";
+    }
+    fromFile.close();
+    remove(forestFile.c_str());
+    newassert( nTrees == 5 * 10 );
+    forestTexts.push_back(forestText);
+  }
+
+  newassert( forestTexts[0] == forestTexts[1] );
+
+  // The files of the pipeline slots are gone
+  newassert( !ifstream("foo_evict3.sf.slot0").good() );
+
+}
+
+void rface_newtest_RF_warm_start() {
+
+  string fileName = "test_103by300_mixed_nan_matrix.afm";
+  DenseTreeData trainData(fileName,'\t',':',false);
+  size_t targetIdx = trainData.getFeatureIdx("N:output");
+  vector<num_t> weights = trainData.getFeatureWeights();
+  weights[targetIdx] = 0;
+
+  ForestOptions forestOptions(forest_t::RF);
+  forestOptions.mTry = 30;
+  forestOptions.nTrees = 10;
+
+  RFACE rface(2,1);
+  rface.train(&trainData,targetIdx,weights,&forestOptions);
+  rface.save("foo_warm.sf");
+
+  // The forest is warm started with the seed it was grown with
+  RFACE rface2(2,1);
+  rface2.load("foo_warm.sf");
+  rface2.addTrees(&trainData,targetIdx,weights,&forestOptions);
+
+  newassert( rface2.nTrees() == 20 );
+
+  // The added trees are the trees 10-19 of the forest, and only they have known out-of-bag samples
+  forestOptions.treeOffset = 10;
+  RFACE rface3(2,1);
+  rface3.train(&trainData,targetIdx,weights,&forestOptions);
+  forestOptions.treeOffset = 0;
+  newassert( rface2.getOobError() == rface3.getOobError() );
+
+  // Only the added trees are appended to the file
+  rface2.save("foo_warm.sf",10);
+
+  RFACE rface4;
+  rface4.load("foo_warm.sf");
+  newassert( rface4.nTrees() == 20 );
+
+  // The trees in the file are numbered 0-19, and no added tree repeats a loaded one
+  ifstream fromFile("foo_warm.sf");
+  vector<string> treeIcs,treeTexts;
+  string newLine;
+  while ( getline(fromFile,newLine) ) {
+    if ( newLine.compare(0,5,"TREE=") == 0 ) {
+      treeIcs.push_back( utils::parse(newLine,',','=','"')["TREE"] );
+      treeTexts.push_back("");
+    } else {
+      treeTexts.back() += newLine + "\n";
+    }
+  }
+  fromFile.close();
+
+  newassert( treeIcs.size() == 20 );
+  for ( size_t i = 0; i < treeIcs.size(); ++i ) {
+    newassert( treeIcs[i] == utils::num2str(i) );
+    for ( size_t j = 0; j < i; ++j ) {
+      newassert( treeTexts[i] != treeTexts[j] );
+    }
+  }
+
+  // The warm started forest is the forest of 20 trees grown at once, up to the rounding of the file
+  forestOptions.nTrees = 20;
+  RFACE rface5(2,1);
+  rface5.train(&trainData,targetIdx,weights,&forestOptions);
+
+  RFACE::TestOutput testOutput2 = rface2.test(&trainData);
+  RFACE::TestOutput testOutput4 = rface4.test(&trainData);
+  RFACE::TestOutput testOutput5 = rface5.test(&trainData);
+
+  for ( size_t i = 0; i < testOutput2.numPredictions.size(); ++i ) {
+    newassert( fabs( testOutput4.numPredictions[i] - testOutput2.numPredictions[i] ) < 1e-3 * ( 1 + fabs(testOutput2.numPredictions[i]) ) );
+    newassert( fabs( testOutput5.numPredictions[i] - testOutput2.numPredictions[i] ) < 1e-3 * ( 1 + fabs(testOutput2.numPredictions[i]) ) );
+  }
+
+  // The impurity of the loaded trees is counted with the added ones
+  vector<num_t> MDI2,contrastMDI2,MDI5,contrastMDI5;
+  rface2.forestRef()->getMDI(&trainData,MDI2,contrastMDI2);
+  rface5.forestRef()->getMDI(&trainData,MDI5,contrastMDI5);
+
+  newassert( MDI2.size() == MDI5.size() );
+  for ( size_t featureIdx = 0; featureIdx < MDI2.size(); ++featureIdx ) {
+    newassert( datadefs::isNAN(MDI2[featureIdx]) == datadefs::isNAN(MDI5[featureIdx]) );
+    if ( !datadefs::isNAN(MDI5[featureIdx]) ) {
+      newassert( fabs( MDI2[featureIdx] - MDI5[featureIdx] ) < 1e-3 * ( 1 + fabs(MDI5[featureIdx]) ) );
+    }
+  }
+
+  remove("foo_warm.sf");
+
+}
+
 #endif
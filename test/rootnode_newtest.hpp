@@ -3,26 +3,376 @@
 
 #include <cstdlib>
 #include <set>
-#incluce <vector>
+#include <vector>
+#include <fstream>
 
 #include "newtest.hpp"
 #include "rootnode.hpp"
+#include "densetreedata.hpp"
+#include "murmurhash3.hpp"
+#include "options.hpp"
+#include "distributions.hpp"
 #include "datadefs.hpp"
 
 using namespace std;
+using datadefs::num_t;
 
-void rootnode_newtest_getChildLeafTrainData();
+void rootnode_newtest_getTrainData();
+void rootnode_newtest_setSplitter();
+void rootnode_newtest_percolateData();
+void rootnode_newtest_writeAndLoadTree();
+void rootnode_newtest_sampleIcsPool();
+void rootnode_newtest_growTree();
+void rootnode_newtest_minDepth();
 
 void rootnode_newtest() {
 
-  newtest( "Testing extraction of train samples from child leaf nodes", &rootnode_newtest_getChildLeafTrainData );
+  newtest( "getTrainData(x)", &rootnode_newtest_getTrainData );
+  newtest( "setSplitter(x)", &rootnode_newtest_setSplitter );
+  newtest( "percolateData(x)", &rootnode_newtest_percolateData );
+  newtest( "writeAndLoadTree(x)", &rootnode_newtest_writeAndLoadTree );
+  newtest( "sampleIcsPool(x)", &rootnode_newtest_sampleIcsPool );
+  newtest( "growTree(x)", &rootnode_newtest_growTree );
+  newtest( "minDepth(x)", &rootnode_newtest_minDepth );
 
 }
 
-void rootnode_newtest_getChildLeafTrainData() {
+void rootnode_newtest_getTrainData() {
 
-  Rootnode rootNode;
-  Node nodeL,nodeR,nodeM;
+  RootNode rootNode;
+
+  size_t node = rootNode.addNode();
+
+  rootNode.setSplitter(node,0.0,0,static_cast<num_t>(5.0));
+
+  size_t nodeL = rootNode.leftChild(node);
+  size_t nodeR = rootNode.rightChild(node);
+
+  rootNode.setSplitter(nodeL,0.0,1,static_cast<num_t>(6.0));
+  rootNode.setMissingChild(node);
+
+  size_t nodeM = rootNode.missingChild(node);
+  size_t nodeLL = rootNode.leftChild(nodeL);
+  size_t nodeLR = rootNode.rightChild(nodeL);
+
+  newassert( rootNode.nNodes() == 6 );
+  newassert( nodeR == nodeL + 1 );
+  newassert( nodeLR == nodeLL + 1 );
+  newassert( rootNode.hasChildren(node) );
+  newassert( rootNode.hasChildren(nodeL) );
+  newassert( !rootNode.hasChildren(nodeR) );
+  newassert( !rootNode.hasChildren(nodeM) );
+  newassert( rootNode.hasMissingChild(node) );
+  newassert( !rootNode.hasMissingChild(nodeL) );
+
+  // Leaves hold their data in depth-first order: LL, LR, R, M
+  rootNode.numTargetData_ = make_shared<const vector<num_t> >(vector<num_t>({7,6,5,4,3,2,1}));
+  rootNode.trainSampleIcs_ = {6,5,4,3,2,1,0};
+  rootNode.trainDataBegin_[nodeLL] = 0; rootNode.trainDataEnd_[nodeLL] = 3;
+  rootNode.trainDataBegin_[nodeLR] = 3; rootNode.trainDataEnd_[nodeLR] = 5;
+  rootNode.trainDataBegin_[nodeR] = 5; rootNode.trainDataEnd_[nodeR] = 6;
+  rootNode.trainDataBegin_[nodeM] = 6; rootNode.trainDataEnd_[nodeM] = 7;
+
+  newassert( rootNode.recursiveSetTrainDataEnd(node) == 7 );
+
+  newassert( rootNode.trainDataBegin_[node] == 0 );
+  newassert( rootNode.trainDataEnd_[node] == 7 );
+  newassert( rootNode.trainDataBegin_[nodeL] == 0 );
+  newassert( rootNode.trainDataEnd_[nodeL] == 5 );
+
+  // Leaf data is read through the sample indices from the target column
+  newassert( rootNode.nTrainSamples(node) == 7 );
+  newassert( rootNode.nTrainSamples(nodeL) == 5 );
+  newassert( rootNode.nTrainSamples(nodeM) == 1 );
+  newassert( fabs(rootNode.getNumTrainData(nodeLR,0) - 4) < datadefs::EPS );
+  newassert( fabs(rootNode.getNumTrainData(nodeL,4) - 5) < datadefs::EPS );
+  newassert( fabs(rootNode.getNumTrainData(nodeM,0) - 7) < datadefs::EPS );
+
+  rootNode.verifyIntegrity();
+
+}
+
+void rootnode_newtest_setSplitter() {
+
+  RootNode rootNode;
+
+  num_t splitLeftLeqValue = 0.5;
+
+  size_t node = rootNode.addNode();
+
+  rootNode.setSplitter(node,0.0,0,splitLeftLeqValue);
+
+  newassert( rootNode.splitterType_[node] == Feature::Type::NUM );
+  newassert( fabs(rootNode.splitValue_[node].leftLeqValue - splitLeftLeqValue) < datadefs::EPS );
+
+  size_t nodeL = rootNode.leftChild(node);
+  size_t nodeR = rootNode.rightChild(node);
+
+  unordered_map<cat_t,uint32_t> categoryIcs;
+
+  rootNode.setSplitter(nodeL,0.0,1,unordered_set<cat_t>({"a","b"}),categoryIcs);
+  rootNode.setSplitter(nodeR,0.0,1,unordered_set<cat_t>({"c","a"}),categoryIcs);
+
+  newassert( rootNode.splitterType_[nodeL] == Feature::Type::CAT );
+  newassert( rootNode.isLeftValue(nodeL,"a") );
+  newassert( rootNode.isLeftValue(nodeL,"b") );
+  newassert( !rootNode.isLeftValue(nodeL,"c") );
+  newassert( rootNode.isLeftValue(nodeR,"c") );
+  newassert( rootNode.isLeftValue(nodeR,"a") );
+  newassert( !rootNode.isLeftValue(nodeR,"b") );
+
+  // Categories shared by the sets are stored once
+  newassert( rootNode.categories_.size() == 3 );
+  newassert( rootNode.leftValues_.size() == 4 );
+
+}
+
+void rootnode_newtest_percolateData() {
+
+  DenseTreeData treeData("test_2by10_text_matrix.afm",'\t',':');
+
+  uint32_t h;
+
+  MurmurHash3_x86_32("c",1,0,&h);
+
+  RootNode rootNode;
+
+  size_t node = rootNode.addNode();
+
+  rootNode.splitterNames_.push_back("T:in");
+  rootNode.setSplitter(node,0.0,0,h);
+
+  size_t leftChild = rootNode.leftChild(node);
+  size_t rightChild = rootNode.rightChild(node);
+
+  newassert( !rootNode.hasMissingChild(node) );
+
+  for ( size_t i = 0; i < 20; ++i ) {
+    newassert( rootNode.percolate(&treeData,i) == ( 5 <= i && i < 15 ? leftChild : rightChild ) );
+  }
+
+  // With the splitter scrambled, the sample follows the path of the sample it reads the splitter from
+  size_t featureIdx = treeData.getFeatureIdx("T:in");
+
+  for ( size_t i = 0; i < 20; ++i ) {
+    newassert( rootNode.percolate(&treeData,i,featureIdx,19-i) == rootNode.percolate(&treeData,19-i) );
+    newassert( rootNode.percolate(&treeData,i,treeData.end(),19-i) == rootNode.percolate(&treeData,i) );
+  }
+
+  // Splitters resolved to feature indices once lead the samples the same way
+  vector<size_t> splitterFeatureIcs;
+  rootNode.getSplitterFeatureIcs(&treeData,splitterFeatureIcs);
+
+  newassert( splitterFeatureIcs.size() == 1 );
+  newassert( splitterFeatureIcs[0] == featureIdx );
+
+  for ( size_t i = 0; i < 20; ++i ) {
+    newassert( rootNode.percolate(&treeData,i,splitterFeatureIcs,featureIdx,19-i) == rootNode.percolate(&treeData,i,featureIdx,19-i) );
+    newassert( rootNode.percolate(&treeData,i,splitterFeatureIcs,treeData.end(),i) == rootNode.percolate(&treeData,i) );
+  }
+
+}
+
+void rootnode_newtest_writeAndLoadTree() {
+
+  RootNode rootNode;
+
+  rootNode.forestType_ = forest_t::QRF;
+  rootNode.targetName_ = "N:y";
+  rootNode.isTargetNumerical_ = true;
+  rootNode.reset();
+
+  size_t node = rootNode.addNode();
+
+  rootNode.splitterNames_ = {"N:x","C:z"};
+  rootNode.setSplitter(node,1.5,0,static_cast<num_t>(2.0));
+  unordered_map<cat_t,uint32_t> categoryIcs;
+  rootNode.setSplitter(rootNode.leftChild(node),0.5,1,unordered_set<cat_t>({"a"}),categoryIcs);
+
+  size_t nodeR = rootNode.rightChild(node);
+  size_t nodeLL = rootNode.leftChild(rootNode.leftChild(node));
+  size_t nodeLR = rootNode.rightChild(rootNode.leftChild(node));
+
+  rootNode.numTargetData_ = make_shared<const vector<num_t> >(vector<num_t>({4,3,2,1}));
+  rootNode.trainSampleIcs_ = {3,2,1,0};
+  rootNode.trainDataBegin_[nodeLL] = 0; rootNode.trainDataEnd_[nodeLL] = 1;
+  rootNode.trainDataBegin_[nodeLR] = 1; rootNode.trainDataEnd_[nodeLR] = 3;
+  rootNode.trainDataBegin_[nodeR] = 3; rootNode.trainDataEnd_[nodeR] = 4;
+  rootNode.numTrainPrediction_[nodeR] = 4;
+  rootNode.nLeaves_ = 3;
+
+  string fileName = "test/data/rootnode_newtest.sf";
+
+  ofstream toFile(fileName.c_str());
+  rootNode.writeTree(toFile);
+  toFile.close();
+
+  ifstream treeStream(fileName.c_str());
+  RootNode loadedNode(treeStream);
+  treeStream.close();
+
+  remove(fileName.c_str());
+
+  newassert( loadedNode.getTargetName() == "N:y" );
+  newassert( loadedNode.isTargetNumerical() );
+  newassert( loadedNode.nNodes() == rootNode.nNodes() );
+  newassert( loadedNode.nLeaves() == 3 );
+
+  unordered_map<string,num_t> DI = loadedNode.getDI();
+  newassert( fabs(DI["N:x"] - 1.5) < datadefs::EPS );
+  newassert( fabs(DI["C:z"] - 0.5) < datadefs::EPS );
+
+  // Subtrees own contiguous ranges of the leaf data
+  size_t loadedL = loadedNode.leftChild(0);
+  newassert( loadedNode.trainDataEnd_[loadedL] - loadedNode.trainDataBegin_[loadedL] == 3 );
+  newassert( loadedNode.trainDataEnd_[0] - loadedNode.trainDataBegin_[0] == 4 );
+  newassert( fabs(loadedNode.getNumTrainData(loadedL,2) - 3) < datadefs::EPS );
+  newassert( fabs(loadedNode.getNumTrainData(0,3) - 4) < datadefs::EPS );
+  newassert( loadedNode.isLeftValue(loadedL,"a") );
+  newassert( fabs(loadedNode.numTrainPrediction_[loadedNode.rightChild(0)] - 4) < datadefs::EPS );
+
+  loadedNode.verifyIntegrity();
+
+}
+
+void rootnode_newtest_sampleIcsPool() {
+
+  RootNode::SplitCache splitCache;
+
+  splitCache.sampleIcs_left = {1,2,3};
+
+  vector<size_t> sampleIcs;
+
+  splitCache.takeSampleIcs(splitCache.sampleIcs_left,sampleIcs);
+
+  newassert( sampleIcs.size() == 3 );
+  newassert( sampleIcs[2] == 3 );
+  newassert( splitCache.sampleIcs_left.size() == 0 );
+
+  const size_t* buffer = sampleIcs.data();
+
+  splitCache.releaseSampleIcs(sampleIcs);
+
+  newassert( sampleIcs.size() == 0 );
+  newassert( splitCache.sampleIcsPool.size() == 1 );
+
+  // The released buffer is handed out again
+  splitCache.sampleIcs_right = {4};
+  splitCache.takeSampleIcs(splitCache.sampleIcs_right,sampleIcs);
+
+  newassert( sampleIcs.size() == 1 );
+  newassert( splitCache.sampleIcs_right.size() == 0 );
+  newassert( splitCache.sampleIcs_right.data() == buffer );
+  newassert( splitCache.sampleIcsPool.size() == 0 );
+
+}
+
+void rootnode_newtest_growTree() {
+
+  DenseTreeData treeData("test_103by300_mixed_matrix.afm",'\t',':');
+
+  size_t targetIdx = treeData.getFeatureIdx("N:output");
+
+  ForestOptions forestOptions(forest_t::QRF);
+  forestOptions.mTry = 30;
+
+  vector<num_t> featureWeights(treeData.nFeatures(),1.0);
+  featureWeights[targetIdx] = 0.0;
+
+  distributions::PMF pmf(featureWeights);
+  distributions::Random random(0);
+
+  RootNode rootNode;
+  RootNode::SplitCache splitCache;
+
+  rootNode.growTree(&treeData,targetIdx,&pmf,&forestOptions,&random,splitCache);
+
+  rootNode.verifyIntegrity();
+
+  // Every in-bag draw ends up in exactly one leaf
+  newassert( rootNode.nTrainSamples(0) == splitCache.bootstrapIcs.size() );
+
+  // Out-of-bag membership survives the growth, the index lists do not
+  vector<size_t> oobIcs = rootNode.getOobIcs();
+  newassert( oobIcs.size() == rootNode.nOobSamples() );
+  newassert( oobIcs == splitCache.oobIcs );
+
+  bool isConsistent = true;
+  for ( size_t i = 0; i < splitCache.bootstrapIcs.size(); ++i ) {
+    isConsistent = isConsistent && !rootNode.isOobSample(splitCache.bootstrapIcs[i]);
+  }
+  newassert( isConsistent );
+
+  newassert( *rootNode.numTargetData_ == treeData.feature(targetIdx)->numData );
+
+  // A tree grown with the same cache on another target keeps to its own column
+  size_t otherIdx = 0;
+  while ( otherIdx == targetIdx || !treeData.feature(otherIdx)->isNumerical() ) {
+    ++otherIdx;
+  }
+
+  featureWeights[targetIdx] = 1.0;
+  featureWeights[otherIdx] = 0.0;
+  distributions::PMF otherPmf(featureWeights);
+
+  RootNode otherNode;
+  otherNode.growTree(&treeData,otherIdx,&otherPmf,&forestOptions,&random,splitCache);
+
+  otherNode.verifyIntegrity();
+
+  newassert( *otherNode.numTargetData_ == treeData.feature(otherIdx)->numData );
+  newassert( *rootNode.numTargetData_ == treeData.feature(targetIdx)->numData );
+
+}
+
+void rootnode_newtest_minDepth() {
+
+  DenseTreeData treeData("test_103by300_mixed_matrix.afm",'\t',':');
+
+  size_t targetIdx = treeData.getFeatureIdx("N:output");
+
+  ForestOptions forestOptions(forest_t::QRF);
+  forestOptions.mTry = 30;
+
+  vector<num_t> featureWeights(treeData.nFeatures(),1.0);
+  featureWeights[targetIdx] = 0.0;
+
+  distributions::PMF pmf(featureWeights);
+  distributions::Random random(0);
+
+  RootNode rootNode;
+  RootNode::SplitCache splitCache;
+  splitCache.minDepthSums.assign(2*treeData.nFeatures(),0);
+
+  rootNode.growTree(&treeData,targetIdx,&pmf,&forestOptions,&random,splitCache);
+
+  // Depths recomputed from the finished tree; parents precede their children
+  vector<size_t> depths(rootNode.nNodes(),0);
+  vector<size_t> minDepths(rootNode.splitterNames_.size(),rootNode.nNodes());
+
+  for ( size_t nodeIdx = 0; nodeIdx < rootNode.nNodes(); ++nodeIdx ) {
+    if ( rootNode.hasChildren(nodeIdx) ) {
+      depths[rootNode.leftChild(nodeIdx)] = depths[nodeIdx] + 1;
+      depths[rootNode.rightChild(nodeIdx)] = depths[nodeIdx] + 1;
+      if ( rootNode.hasMissingChild(nodeIdx) ) {
+	depths[rootNode.missingChild(nodeIdx)] = depths[nodeIdx] + 1;
+      }
+      size_t splitterIdx = rootNode.splitterIdx_[nodeIdx];
+      minDepths[splitterIdx] = min(minDepths[splitterIdx],depths[nodeIdx]);
+    }
+  }
+
+  newassert( splitCache.minDepthBySplitter.size() == minDepths.size() );
+  newassert( splitCache.minDepthBySplitter[ rootNode.splitterIdx_[0] ] == 0 );
+
+  bool isEqual = true;
+  for ( size_t splitterIdx = 0; splitterIdx < minDepths.size(); ++splitterIdx ) {
+    size_t featureIdx = splitCache.splitterFeatureIcs[splitterIdx];
+    isEqual = isEqual && splitCache.minDepthBySplitter[splitterIdx] == minDepths[splitterIdx];
+    isEqual = isEqual && splitCache.minDepthSums[featureIdx] == minDepths[splitterIdx];
+    isEqual = isEqual && treeData.feature(featureIdx)->name() == rootNode.splitterNames_[splitterIdx];
+  }
+  newassert( isEqual );
 
 }
 
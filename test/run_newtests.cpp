@@ -7,8 +7,9 @@
 #include "rface_newtest.hpp"
 #include "distributions_newtest.hpp"
 #include "utils_newtest.hpp"
+#include "splitengine_newtest.hpp"
 #include "datadefs_newtest.hpp"
-#include "node_newtest.hpp"
+#include "rootnode_newtest.hpp"
 #include "math_newtest.hpp"
 
 using namespace std;
@@ -31,12 +32,15 @@ int main() {
   
   cout << endl << "Testing Utils namespace:" << endl;
   utils_newtest();
+
+  cout << endl << "Testing Splitengine namespace:" << endl;
+  splitengine_newtest();
   
   cout << endl << "Testing Datadefs namespace:" << endl;
   datadefs_newtest();
 
-  cout << endl << "Testing Node class:" << endl;
-  node_newtest();
+  cout << endl << "Testing RootNode class:" << endl;
+  rootnode_newtest();
 
   cout << endl << "Testing math namespace:" << endl;
   math_newtest();
@@ -0,0 +1,329 @@
+#ifndef SPLITENGINE_NEWTEST_HPP
+#define SPLITENGINE_NEWTEST_HPP
+
+#include <cstdlib>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cmath>
+
+#include "datadefs.hpp"
+#include "newtest.hpp"
+#include "splitengine.hpp"
+#include "math.hpp"
+
+using namespace std;
+using datadefs::num_t;
+
+void splitengine_newtest_numericalFeatureSplitNumericalTarget();
+void splitengine_newtest_numericalFeatureSplitCategoricalTarget();
+void splitengine_newtest_numericalFeatureSplitWeighted();
+void splitengine_newtest_categoricalFeatureSplitNumericalTarget();
+void splitengine_newtest_categoricalFeatureSplitCategoricalTarget();
+void splitengine_newtest_textualFeatureSplit();
+void splitengine_newtest_randomNumericalFeatureSplit();
+void splitengine_newtest_categoricalFeatureSubsetSplit();
+void splitengine_newtest_separateMissingSamples();
+
+void splitengine_newtest() {
+
+  newtest( "numericalFeatureSplit(x) with numerical target", &splitengine_newtest_numericalFeatureSplitNumericalTarget );
+  newtest( "numericalFeatureSplit(x) with categorical target", &splitengine_newtest_numericalFeatureSplitCategoricalTarget );
+  newtest( "numericalFeatureSplit(x) with sample weights", &splitengine_newtest_numericalFeatureSplitWeighted );
+  newtest( "categoricalFeatureSplit(x) with numerical target", &splitengine_newtest_categoricalFeatureSplitNumericalTarget );
+  newtest( "categoricalFeatureSplit(x) with categorical target", &splitengine_newtest_categoricalFeatureSplitCategoricalTarget );
+  newtest( "textualFeatureSplit(x)", &splitengine_newtest_textualFeatureSplit );
+  newtest( "randomNumericalFeatureSplit(x)", &splitengine_newtest_randomNumericalFeatureSplit );
+  newtest( "categoricalFeatureSubsetSplit(x)", &splitengine_newtest_categoricalFeatureSubsetSplit );
+  newtest( "separateMissingSamples(x)", &splitengine_newtest_separateMissingSamples );
+
+}
+
+void splitengine_newtest_numericalFeatureSplitNumericalTarget() {
+
+  vector<num_t> fv = {1,2,3,4,5,6,7,8};
+  vector<num_t> tv = {1,1,1,1,5,5,5,6};
+
+  size_t splitIdx = datadefs::MAX_IDX;
+
+  splitengine::TargetStat<num_t> tot,stat_left,stat_right;
+
+  num_t DI = splitengine::numericalFeatureSplit(tv,fv,vector<uint8_t>(fv.size(),1),1,splitIdx,tot,stat_left,stat_right);
+
+  num_t DI_ref = math::deltaImpurity_regr(math::mean(tv),8,1.0,4,math::mean({5,5,5,6}),4);
+
+  newassert( splitIdx == 3 );
+  newassert( fabs( DI - DI_ref ) < 1e-5 );
+
+  // Statistics of the best split are carried out of the scan
+  newassert( stat_left.n == 4 );
+  newassert( stat_right.n == 4 );
+  newassert( fabs( stat_left.mu - 1.0 ) < 1e-5 );
+  newassert( fabs( stat_right.mu - 5.25 ) < 1e-5 );
+
+  // Repeated feature values cannot be split apart
+  fv = {1,1,1,1,1,1,1,2};
+  splitIdx = datadefs::MAX_IDX;
+
+  DI = splitengine::numericalFeatureSplit(tv,fv,vector<uint8_t>(fv.size(),1),1,splitIdx,tot,stat_left,stat_right);
+
+  newassert( splitIdx == 6 );
+
+  // Minimum branch size prevents the only possible split
+  splitIdx = datadefs::MAX_IDX;
+
+  DI = splitengine::numericalFeatureSplit(tv,fv,vector<uint8_t>(fv.size(),1),2,splitIdx,tot,stat_left,stat_right);
+
+  newassert( splitIdx == datadefs::MAX_IDX );
+  newassert( fabs( DI ) < 1e-5 );
+
+}
+
+void splitengine_newtest_numericalFeatureSplitCategoricalTarget() {
+
+  vector<num_t> fv = {1,2,3,4,5,6};
+  vector<cat_t> tv = {"a","a","b","b","b","b"};
+
+  size_t splitIdx = datadefs::MAX_IDX;
+
+  splitengine::TargetStat<cat_t> tot,stat_left,stat_right;
+
+  num_t DI = splitengine::numericalFeatureSplit(tv,fv,vector<uint8_t>(fv.size(),1),1,splitIdx,tot,stat_left,stat_right);
+
+  newassert( splitIdx == 1 );
+  newassert( fabs( DI - math::deltaImpurity_class(20,6,4,2,16,4) ) < 1e-5 );
+  newassert( stat_left.n == 2 );
+  newassert( stat_right.n == 4 );
+  newassert( splitengine::prediction(stat_left) == "a" );
+  newassert( splitengine::prediction(stat_right) == "b" );
+
+}
+
+void splitengine_newtest_numericalFeatureSplitWeighted() {
+
+  // Weighted samples must split exactly like the samples duplicated by their weights
+  vector<num_t> fv = {1,2,3,4};
+  vector<num_t> tv = {1,1,5,6};
+  vector<uint8_t> wv = {2,2,3,1};
+
+  vector<num_t> fv_dup = {1,1,2,2,3,3,3,4};
+  vector<num_t> tv_dup = {1,1,1,1,5,5,5,6};
+
+  size_t splitIdx = datadefs::MAX_IDX;
+  size_t splitIdx_dup = datadefs::MAX_IDX;
+
+  splitengine::TargetStat<num_t> tot,stat_left,stat_right;
+  splitengine::TargetStat<num_t> stat_left_dup,stat_right_dup;
+
+  num_t DI = splitengine::numericalFeatureSplit(tv,fv,wv,2,splitIdx,tot,stat_left,stat_right);
+  num_t DI_dup = splitengine::numericalFeatureSplit(tv_dup,fv_dup,vector<uint8_t>(8,1),2,splitIdx_dup,tot,stat_left_dup,stat_right_dup);
+
+  newassert( splitIdx == 1 );
+  newassert( splitIdx_dup == 3 );
+  newassert( fabs( DI - DI_dup ) < 1e-5 );
+  newassert( stat_left.n == stat_left_dup.n );
+  newassert( stat_right.n == stat_right_dup.n );
+  newassert( fabs( stat_left.mu - stat_left_dup.mu ) < 1e-5 );
+  newassert( fabs( stat_right.mu - stat_right_dup.mu ) < 1e-5 );
+
+  // The same holds for categorical targets
+  vector<cat_t> cv = {"a","a","b","b"};
+  vector<cat_t> cv_dup = {"a","a","a","a","b","b","b","b"};
+
+  splitengine::TargetStat<cat_t> ctot,cstat_left,cstat_right;
+  splitengine::TargetStat<cat_t> cstat_left_dup,cstat_right_dup;
+
+  DI = splitengine::numericalFeatureSplit(cv,fv,wv,1,splitIdx,ctot,cstat_left,cstat_right);
+  DI_dup = splitengine::numericalFeatureSplit(cv_dup,fv_dup,vector<uint8_t>(8,1),1,splitIdx_dup,ctot,cstat_left_dup,cstat_right_dup);
+
+  newassert( fabs( DI - DI_dup ) < 1e-5 );
+  newassert( cstat_left.n == 4 );
+  newassert( cstat_left.sf == cstat_left_dup.sf );
+  newassert( cstat_right.sf == cstat_right_dup.sf );
+
+}
+
+void splitengine_newtest_categoricalFeatureSplitNumericalTarget() {
+
+  vector<cat_t> fv = {"1","1","1","2","2","2","3","3","3","4","4","4"};
+  vector<num_t> tv = {1,1,1,2,3,4,5,6,7,8,9,10};
+
+  splitengine::CategoryGroups catGroups;
+  splitengine::TargetStat<num_t> tot,stat_left,stat_right;
+
+  num_t DI = splitengine::categoricalFeatureSplit(tv,fv,vector<uint8_t>(fv.size(),1),1,{"1","2","3","4"},catGroups,tot,stat_left,stat_right);
+
+  num_t DI_ref = math::deltaImpurity_regr(math::mean(tv),12,math::mean({1,1,1,2,3,4}),6,math::mean({5,6,7,8,9,10}),6);
+
+  newassert( fabs( DI - DI_ref ) < 1e-5 );
+  newassert( stat_left.n == 6 );
+  newassert( stat_right.n == 6 );
+  newassert( fabs( stat_left.mu - 2.0 ) < 1e-5 );
+  newassert( fabs( stat_right.mu - 7.5 ) < 1e-5 );
+
+  fv = {"1","1","1","1","1","1","1","1","1","1","1","1"};
+
+  DI = splitengine::categoricalFeatureSplit(tv,fv,vector<uint8_t>(fv.size(),1),1,{"1"},catGroups,tot,stat_left,stat_right);
+
+  DI_ref = 0;
+
+  newassert( fabs( DI - DI_ref ) < 1e-3 );  
+  
+}
+
+void splitengine_newtest_categoricalFeatureSplitCategoricalTarget() {
+  
+  vector<cat_t> fv = {"1","1","1","2","2","2","3","3","3","4","4","4"};
+  vector<cat_t> tv = {"1","1","1","2","3","4","5","6","7","8","9","10"};
+
+  splitengine::CategoryGroups catGroups;
+  splitengine::TargetStat<cat_t> tot,stat_left,stat_right;
+
+  num_t DI = splitengine::categoricalFeatureSplit(tv,fv,vector<uint8_t>(fv.size(),1),1,{"1","2","3","4"},catGroups,tot,stat_left,stat_right);
+
+  newassert( stat_left.n == 3 );
+  newassert( stat_right.n == 9 );
+  newassert( splitengine::prediction(stat_left) == "1" );
+
+  unordered_map<cat_t,size_t> freq_left,freq_right,freq_tot;
+  size_t sf_left = 0;
+  size_t sf_right = 0;
+  size_t sf_tot = 0;
+
+  for ( size_t i = 0; i < tv.size(); ++i ) {
+    math::incrementSquaredFrequency(tv[i],freq_tot,sf_tot);
+  }
+  
+  for ( size_t i = 0; i < 3; ++i ) {
+    math::incrementSquaredFrequency(tv[i],freq_left,sf_left);
+  }
+
+  for ( size_t i = 3; i < 12; ++i ) {
+    math::incrementSquaredFrequency(tv[i],freq_right,sf_right);
+  }
+  
+  num_t DI_ref = math::deltaImpurity_class(sf_tot,12,sf_left,3,sf_right,9);
+ 
+  newassert( fabs( DI - DI_ref ) < 1e-5 );
+
+  fv = {"1","1","1","1","1","1","1","1","1","1","1","1"};
+
+  DI = splitengine::categoricalFeatureSplit(tv,fv,vector<uint8_t>(fv.size(),1),1,{"1"},catGroups,tot,stat_left,stat_right);
+
+  DI_ref = 0;
+
+  newassert( fabs( DI - DI_ref ) < 1e-5 );
+
+}
+
+void splitengine_newtest_textualFeatureSplit() {
+
+  vector<num_t> tv = {1,2,3,4,5};
+  vector<unordered_set<uint32_t> > txtData = {{1,2},{2},{1},{3},{}};
+
+  vector<size_t> sampleIcs = {0,1,2,3,4};
+
+  splitengine::TargetStat<num_t> stat_left,stat_right;
+
+  num_t DI = splitengine::textualFeatureSplit(tv,txtData,1,sampleIcs,vector<uint8_t>(tv.size(),1),stat_left,stat_right);
+
+  newassert( stat_left.n == 2 );
+  newassert( stat_right.n == 2 );
+  newassert( fabs( DI - math::deltaImpurity_regr(2.5,4,2.0,2,3.0,2) ) < 1e-5 );
+
+}
+
+void splitengine_newtest_randomNumericalFeatureSplit() {
+
+  vector<num_t> fv = {8,datadefs::NUM_NAN,2,6,4};
+  vector<num_t> tv = {1,100,2,3,4};
+  vector<size_t> sampleIcs = {0,1,2,3,4};
+
+  splitengine::TargetStat<num_t> stat_left,stat_right;
+  num_t splitValue = datadefs::NUM_NAN;
+
+  // Threshold halfway between the min and max, samples with missing data skipped
+  num_t DI = splitengine::randomNumericalFeatureSplit(tv,fv,sampleIcs,vector<uint8_t>(tv.size(),1),0.5,splitValue,stat_left,stat_right);
+
+  newassert( fabs( splitValue - 5.0 ) < 1e-5 );
+  newassert( stat_left.n == 2 );
+  newassert( stat_right.n == 2 );
+  newassert( fabs( stat_left.mu - 3.0 ) < 1e-5 );
+  newassert( fabs( stat_right.mu - 2.0 ) < 1e-5 );
+  newassert( fabs( DI - math::deltaImpurity_regr(2.5,4,3.0,2,2.0,2) ) < 1e-5 );
+
+  // The smallest value always falls to the left
+  DI = splitengine::randomNumericalFeatureSplit(tv,fv,sampleIcs,vector<uint8_t>(tv.size(),1),0.0,splitValue,stat_left,stat_right);
+
+  newassert( fabs( splitValue - 2.0 ) < 1e-5 );
+  newassert( stat_left.n == 1 );
+  newassert( stat_right.n == 3 );
+
+  // Constant features cannot be split
+  fv = {1,1,datadefs::NUM_NAN,1,1};
+  DI = splitengine::randomNumericalFeatureSplit(tv,fv,sampleIcs,vector<uint8_t>(tv.size(),1),0.5,splitValue,stat_left,stat_right);
+
+  newassert( fabs( DI ) < 1e-5 );
+
+}
+
+void splitengine_newtest_categoricalFeatureSubsetSplit() {
+
+  vector<cat_t> fv = {"a","b","NA","c","a"};
+  vector<cat_t> tv = {"1","2","1","2","1"};
+  vector<size_t> sampleIcs = {0,1,2,3,4};
+
+  splitengine::TargetStat<cat_t> stat_left,stat_right;
+
+  num_t DI = splitengine::categoricalFeatureSubsetSplit(tv,fv,sampleIcs,vector<uint8_t>(tv.size(),1),{"a"},stat_left,stat_right);
+
+  newassert( stat_left.n == 2 );
+  newassert( stat_right.n == 2 );
+  newassert( splitengine::prediction(stat_left) == "1" );
+  newassert( splitengine::prediction(stat_right) == "2" );
+  newassert( fabs( DI - math::deltaImpurity_class(8,4,4,2,4,2) ) < 1e-5 );
+
+  // All categories on one side yield no split
+  DI = splitengine::categoricalFeatureSubsetSplit(tv,fv,sampleIcs,vector<uint8_t>(tv.size(),1),{"a","b","c"},stat_left,stat_right);
+
+  newassert( fabs( DI ) < 1e-5 );
+
+}
+
+void splitengine_newtest_separateMissingSamples() {
+
+  vector<num_t> numData = {1,datadefs::NUM_NAN,3,datadefs::NUM_NAN};
+  vector<size_t> sampleIcs = {3,2,1,0};
+  vector<size_t> missingIcs;
+
+  splitengine::separateMissingSamples(numData,sampleIcs,missingIcs);
+
+  newassert( sampleIcs.size() == 2 );
+  newassert( sampleIcs[0] == 2 );
+  newassert( sampleIcs[1] == 0 );
+  newassert( missingIcs.size() == 2 );
+  newassert( missingIcs[0] == 3 );
+  newassert( missingIcs[1] == 1 );
+
+  vector<cat_t> catData = {"a","NA","b"};
+  sampleIcs = {0,1,2};
+
+  splitengine::separateMissingSamples(catData,sampleIcs,missingIcs);
+
+  newassert( sampleIcs.size() == 2 );
+  newassert( missingIcs.size() == 1 );
+  newassert( missingIcs[0] == 1 );
+
+  vector<unordered_set<uint32_t> > txtData = {{},{1}};
+  sampleIcs = {0,1};
+
+  splitengine::separateMissingSamples(txtData,sampleIcs,missingIcs);
+
+  newassert( sampleIcs.size() == 1 );
+  newassert( sampleIcs[0] == 1 );
+  newassert( missingIcs.size() == 1 );
+  newassert( missingIcs[0] == 0 );
+
+}
+
+#endif
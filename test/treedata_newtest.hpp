@@ -21,6 +21,7 @@ void treedata_newtest_categoricalFeatureSplitsNumericalTarget();
 void treedata_newtest_end();
 void treedata_newtest_hashFeature();
 void treedata_newtest_bootstrapRealSamples();
+void treedata_newtest_bootstrapWeightsFromRealSamples();
 void treedata_newtest_separateMissingSamples();
 
 void treedata_newtest() {
@@ -36,6 +37,7 @@ void treedata_newtest() {
   newtest( "end(x)" , &treedata_newtest_end );
   newtest( "hashFeature(x)", &treedata_newtest_hashFeature );
   newtest( "bootstrapRealSamples(x)", &treedata_newtest_bootstrapRealSamples );
+  newtest( "bootstrapWeightsFromRealSamples(x)", &treedata_newtest_bootstrapWeightsFromRealSamples );
   newtest( "separateMissingSamples(x)", &treedata_newtest_separateMissingSamples );
 
 }
@@ -262,11 +264,15 @@ void treedata_newtest_numericalFeatureSplitsNumericalTarget() {
 
   DenseTreeData treeData("test_103by300_mixed_matrix.afm",'\t',':',true);
 
+  vector<size_t> sampleIcs = utils::range(300);
+  vector<uint8_t> sampleWeights(300,1);
   vector<size_t> sampleIcs_left(0);
-  vector<size_t> sampleIcs_right = utils::range(300);
+  vector<size_t> sampleIcs_right(0);
   vector<size_t> sampleIcs_missing(0);
 
   datadefs::num_t splitValue;
+  splitengine::TargetStat<num_t> stat_left,stat_right;
+  splitengine::SplitScratch<num_t> scratch;
   datadefs::num_t deltaImpurity;
 
   size_t minSamples = 1;
@@ -277,9 +283,19 @@ void treedata_newtest_numericalFeatureSplitsNumericalTarget() {
   deltaImpurity = treeData.numericalFeatureSplit(targetIdx,
 						 featureIdx,
 						 minSamples,
-						 sampleIcs_left,
-						 sampleIcs_right,
-						 splitValue);
+						 sampleIcs,
+						 sampleWeights,
+						 splitValue,
+						 stat_left,
+						 stat_right,
+						 scratch);
+
+  treeData.numericalFeaturePartition(featureIdx,
+				     splitValue,
+				     sampleIcs,
+				     sampleIcs_left,
+				     sampleIcs_right,
+				     sampleIcs_missing);
   
   {
     set<size_t> leftIcs(sampleIcs_left.begin(),sampleIcs_left.end());
@@ -290,6 +306,9 @@ void treedata_newtest_numericalFeatureSplitsNumericalTarget() {
 
     newassert( sampleIcs_left.size() == 127 );
     newassert( sampleIcs_right.size() == 173 );
+    newassert( sampleIcs_missing.size() == 0 );
+    newassert( stat_left.n == sampleIcs_left.size() );
+    newassert( stat_right.n == sampleIcs_right.size() );
 
     newassert( leftIcs.find(198) != leftIcs.end() );
     newassert( leftIcs.find(8)   != leftIcs.end() );
@@ -315,21 +334,35 @@ void treedata_newtest_numericalFeatureSplitsCategoricalTarget() {
   size_t targetIdx = 1; // categorical
   size_t featureIdx = 2; // numerical
 
+  vector<size_t> sampleIcs = utils::range(300);
+  vector<uint8_t> sampleWeights(300,1);
   vector<size_t> sampleIcs_left(0);
-  vector<size_t> sampleIcs_right = utils::range(300);
+  vector<size_t> sampleIcs_right(0);
   vector<size_t> sampleIcs_missing(0);
 
   datadefs::num_t splitValue;
+  splitengine::TargetStat<cat_t> stat_left,stat_right;
+  splitengine::SplitScratch<cat_t> scratch;
   datadefs::num_t deltaImpurity;
 
   size_t minSamples = 1;
 
   deltaImpurity = treeData.numericalFeatureSplit(targetIdx,
-						  featureIdx,
-						  minSamples,
-						  sampleIcs_left,
-						  sampleIcs_right,
-						  splitValue);
+						 featureIdx,
+						 minSamples,
+						 sampleIcs,
+						 sampleWeights,
+						 splitValue,
+						 stat_left,
+						 stat_right,
+						 scratch);
+
+  treeData.numericalFeaturePartition(featureIdx,
+				     splitValue,
+				     sampleIcs,
+				     sampleIcs_left,
+				     sampleIcs_right,
+				     sampleIcs_missing);
   
   {
     set<size_t> leftIcs(sampleIcs_left.begin(),sampleIcs_left.end());
@@ -340,6 +373,8 @@ void treedata_newtest_numericalFeatureSplitsCategoricalTarget() {
 
     newassert( sampleIcs_left.size() == 295 );
     newassert( sampleIcs_right.size() == 5 );
+    newassert( stat_left.n == sampleIcs_left.size() );
+    newassert( stat_right.n == sampleIcs_right.size() );
 
     newassert( leftIcs.find(261) != leftIcs.end() );
     newassert( leftIcs.find(185) != leftIcs.end() );
@@ -359,11 +394,15 @@ void treedata_newtest_categoricalFeatureSplitsNumericalTarget() {
 
   DenseTreeData treeData("test_103by300_mixed_matrix.afm",'\t',':',true);
 
+  vector<size_t> sampleIcs = utils::range(300);
+  vector<uint8_t> sampleWeights(300,1);
   vector<size_t> sampleIcs_left(0);
-  vector<size_t> sampleIcs_right = utils::range(300);
+  vector<size_t> sampleIcs_right(0);
   vector<size_t> sampleIcs_missing(0);
 
-  unordered_set<cat_t> splitValues_left,splitValues_right;
+  unordered_set<cat_t> splitValues_left;
+  splitengine::TargetStat<num_t> stat_left,stat_right;
+  splitengine::SplitScratch<num_t> scratch;
   
   size_t featureIdx = 1;
   size_t targetIdx = 0;
@@ -373,13 +412,35 @@ void treedata_newtest_categoricalFeatureSplitsNumericalTarget() {
 								   featureIdx,
 								   {"1","2"},
 								   minSamples,
-								   sampleIcs_left,
-								   sampleIcs_right,
-								   splitValues_left);
+								   sampleIcs,
+								   sampleWeights,
+								   splitValues_left,
+								   stat_left,
+								   stat_right,
+								   scratch);
   
 
   newassert( fabs( deltaImpurity - 1.102087375288799 ) < 1e-5 );
 
+  treeData.categoricalFeaturePartition(featureIdx,
+				       splitValues_left,
+				       sampleIcs,
+				       sampleIcs_left,
+				       sampleIcs_right,
+				       sampleIcs_missing);
+
+  newassert( sampleIcs_left.size() + sampleIcs_right.size() + sampleIcs_missing.size() == 300 );
+  newassert( stat_left.n == sampleIcs_left.size() );
+  newassert( stat_right.n == sampleIcs_right.size() );
+
+  for ( size_t i = 0; i < sampleIcs_left.size(); ++i ) {
+    newassert( splitValues_left.find(treeData.feature(featureIdx)->getCatData(sampleIcs_left[i])) != splitValues_left.end() );
+  }
+
+  for ( size_t i = 0; i < sampleIcs_right.size(); ++i ) {
+    newassert( splitValues_left.find(treeData.feature(featureIdx)->getCatData(sampleIcs_right[i])) == splitValues_left.end() );
+  }
+
 }
 
 void treedata_newtest_end() {
@@ -455,6 +516,60 @@ void treedata_newtest_bootstrapRealSamples() {
 
 }
 
+void treedata_newtest_bootstrapWeightsFromRealSamples() {
+
+  DenseTreeData treeData("test_103by300_mixed_nan_matrix.afm",'\t',':',true);
+
+  distributions::Random random;
+
+  num_t sampleSize = 1.0;
+  size_t featureIdx = 0;
+  size_t nRealSamples = treeData.feature(featureIdx)->nRealSamples();
+  vector<uint8_t> sampleWeights;
+  vector<size_t> ics,oobIcs;
+
+  num_t oobFraction = 0.0;
+
+  for ( size_t i = 0; i < 1000; ++i ) {
+
+    treeData.bootstrapWeightsFromRealSamples(&random,true,sampleSize,featureIdx,sampleWeights,ics,oobIcs);
+
+    oobFraction += 1.0 * oobIcs.size();
+
+    size_t nDrawn = 0;
+    bool isConsistent = true;
+    for ( size_t j = 0; j < ics.size(); ++j ) {
+      isConsistent = isConsistent && sampleWeights[ics[j]] > 0 && ( j == 0 || ics[j-1] < ics[j] );
+      nDrawn += sampleWeights[ics[j]];
+    }
+
+    for ( size_t j = 0; j < oobIcs.size(); ++j ) {
+      isConsistent = isConsistent && sampleWeights[oobIcs[j]] == 0;
+    }
+
+    newassert( isConsistent );
+
+    newassert( sampleWeights.size() == treeData.nSamples() );
+    newassert( nDrawn == nRealSamples );
+    newassert( ics.size() + oobIcs.size() == nRealSamples );
+    newassert( !datadefs::containsNAN(treeData.feature(featureIdx)->getNumData(ics)) );
+    newassert( !datadefs::containsNAN(treeData.feature(featureIdx)->getNumData(oobIcs)) );
+
+  }
+
+  oobFraction /= 1000 * nRealSamples;
+
+  newassert( fabs( oobFraction - 0.36 ) < 0.05 );
+
+  // Without replacement every sample is drawn at most once
+  treeData.bootstrapWeightsFromRealSamples(&random,false,0.5,featureIdx,sampleWeights,ics,oobIcs);
+
+  newassert( ics.size() == nRealSamples / 2 );
+  newassert( ics.size() + oobIcs.size() == nRealSamples );
+  newassert( count(sampleWeights.begin(),sampleWeights.end(),1) == static_cast<int>(ics.size()) );
+
+}
+
 
 void treedata_newtest_name2idxMap() {
 
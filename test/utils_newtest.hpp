@@ -16,8 +16,6 @@ using namespace std;
 using datadefs::num_t;
 
 
-void utils_newtest_categoricalFeatureSplitsNumericalTarget();
-void utils_newtest_categoricalFeatureSplitsCategoricalTarget();
 void utils_newtest_parse();
 void utils_newtest_str2();
 void utils_newtest_write();
@@ -34,8 +32,6 @@ void utils_newtest_text2tokens();
 
 void utils_newtest() {
 
-  newtest( "categoricalFeatureSplitsNumericalTarget(x)", &utils_newtest_categoricalFeatureSplitsNumericalTarget);
-  newtest( "categoricalFeatureSplitsCategoricalTarget(x)", &utils_newtest_categoricalFeatureSplitsCategoricalTarget);
   newtest( "parse(x)", &utils_newtest_parse );
   newtest( "str2(x)", &utils_newtest_str2 );
   newtest( "write(x)", &utils_newtest_write );
@@ -52,69 +48,6 @@ void utils_newtest() {
 
 }
 
-void utils_newtest_categoricalFeatureSplitsNumericalTarget() {
-
-  vector<cat_t> fv = {"1","1","1","2","2","2","3","3","3","4","4","4"};
-  vector<num_t> tv = {1,1,1,2,3,4,5,6,7,8,9,10};
-
-  unordered_map<cat_t,vector<size_t> > fmap_left,fmap_right;
-
-  num_t DI = utils::categoricalFeatureSplitsNumericalTarget(tv,fv,1,{"1","2","3","4"},fmap_left,fmap_right);
-
-  num_t DI_ref = math::deltaImpurity_regr(math::mean(tv),12,math::mean({1,1,1,2,3,4}),6,math::mean({5,6,7,8,9,10}),6);
-
-  newassert( fabs( DI - DI_ref ) < 1e-5 );
-
-  fv = {"1","1","1","1","1","1","1","1","1","1","1","1"};
-
-  DI = utils::categoricalFeatureSplitsNumericalTarget(tv,fv,1,{"1"},fmap_left,fmap_right);
-
-  DI_ref = 0;
-
-  newassert( fabs( DI - DI_ref ) < 1e-3 );  
-  
-}
-
-void utils_newtest_categoricalFeatureSplitsCategoricalTarget() {
-  
-  vector<cat_t> fv = {"1","1","1","2","2","2","3","3","3","4","4","4"};
-  vector<cat_t> tv = {"1","1","1","2","3","4","5","6","7","8","9","10"};
-
-  unordered_map<cat_t,vector<size_t> > fmap_left,fmap_right;
-
-  num_t DI = utils::categoricalFeatureSplitsCategoricalTarget(tv,fv,1,{"1","2","3","4"},fmap_left,fmap_right);
-
-  unordered_map<cat_t,size_t> freq_left,freq_right,freq_tot;
-  size_t sf_left = 0;
-  size_t sf_right = 0;
-  size_t sf_tot = 0;
-
-  for ( size_t i = 0; i < tv.size(); ++i ) {
-    math::incrementSquaredFrequency(tv[i],freq_tot,sf_tot);
-  }
-  
-  for ( size_t i = 0; i < 3; ++i ) {
-    math::incrementSquaredFrequency(tv[i],freq_left,sf_left);
-  }
-
-  for ( size_t i = 3; i < 12; ++i ) {
-    math::incrementSquaredFrequency(tv[i],freq_right,sf_right);
-  }
-  
-  num_t DI_ref = math::deltaImpurity_class(sf_tot,12,sf_left,3,sf_right,9);
- 
-  newassert( fabs( DI - DI_ref ) < 1e-5 );
-
-  fv = {"1","1","1","1","1","1","1","1","1","1","1","1"};
-
-  DI = utils::categoricalFeatureSplitsCategoricalTarget(tv,fv,1,{"1"},fmap_left,fmap_right);
-
-  DI_ref = 0;
-
-  newassert( fabs( DI - DI_ref ) < 1e-5 );
-
-}
-
 void utils_newtest_parse() {
 
   string s1("KEY1=val1,KEY2='val2',key3='val3,which=continues\"here'");